@@ -19,10 +19,43 @@ exampleList = {
 "px_sched_example6.cpp",
 "px_sched_example7.cpp",
 "px_sched_example8.cpp",
+"px_sched_example9.cpp",
+"px_sched_example10.cpp",
+"px_sched_example11.cpp",
+"px_sched_example12.cpp",
+"px_sched_example13.cpp",
+"px_sched_example14.cpp",
+"px_sched_example15.cpp",
+"px_sched_example16.cpp",
+"px_sched_example17.cpp",
+"px_sched_example18.cpp",
+"px_sched_example19.cpp",
+"px_sched_example20.cpp",
+"px_sched_example21.cpp",
+"px_sched_example22.cpp",
+"px_sched_example23.cpp",
+"px_sched_example24.cpp",
+"px_sched_example25.cpp",
+"px_sched_example26.cpp",
+"px_sched_example27.cpp",
+"px_sched_example28.cpp",
+"px_sched_example29.cpp",
+"px_sched_example30.cpp",
+"px_sched_example31.cpp",
+"px_sched_example32.cpp",
+"px_sched_example33.cpp",
 }
 
 for _,a in ipairs(exampleList) do
   project(a)
   kind "ConsoleApp"
   files{"../"..a}
+  if a == "px_sched_example33.cpp" then
+    -- px_sched_execution.h needs C++17
+    configuration {"vs*"}
+      buildoptions {"/std:c++17"}
+    configuration {"not vs*"}
+      buildoptions_cpp {"-std=c++17"}
+    configuration {}
+  end
 end
@@ -0,0 +1,150 @@
+// Example-10:
+// Asynchronous file reads, every read completes into a Sync object that can
+// be used to launch the tasks that process the data
+
+#include <cstdlib>
+#include <unistd.h>
+
+#define PX_SCHED_IMPLEMENTATION 1
+#define PX_SCHED_IO_IMPLEMENTATION 1
+#include "../px_sched.h"
+#include "../px_sched_io.h"
+#include "common/mem_check.h"
+#include <cassert>
+
+static const size_t kChunkSize = 4096;
+static const size_t kNumChunks = 64;
+
+void test_reads(px_sched::Scheduler &schd, int fd, bool force_io_threads) {
+  px_sched::IO io;
+  px_sched::IOParams io_params;
+  io_params.max_pending_reads = 16;
+  io_params.force_io_threads = force_io_threads;
+  io.init(&schd, io_params);
+  printf("Reading with %s\n", io.usingIOUring()? "io_uring" : "I/O threads");
+
+  static uint8_t buffer[kNumChunks][kChunkSize];
+  static int64_t bytes[kNumChunks];
+  memset(buffer, 0, sizeof(buffer));
+  std::atomic<uint32_t> checked = {0};
+  px_sched::Sync all_decoded;
+  for(size_t i = 0; i < kNumChunks; ++i) {
+    px_sched::Sync read_done;
+    // the last chunk asks for more data than available in the file
+    size_t size = (i == kNumChunks-1)? kChunkSize*2 : kChunkSize;
+    io.read(fd, buffer[i], size, i*kChunkSize, &read_done, &bytes[i]);
+    // "decode" once the data is in memory, without blocking any worker
+    schd.runAfter(read_done, [i, &checked] {
+      assert(bytes[i] == static_cast<int64_t>(kChunkSize));
+      for(size_t j = 0; j < kChunkSize; ++j) {
+        assert(buffer[i][j] == static_cast<uint8_t>((i*kChunkSize+j)*7));
+      }
+      checked.fetch_add(1);
+    }, &all_decoded);
+  }
+
+  // reads of an invalid file descriptor report the error
+  px_sched::Sync bad_read;
+  int64_t bad_result = 0;
+  uint8_t bad_buffer[16];
+  io.read(-1, bad_buffer, sizeof(bad_buffer), 0, &bad_read, &bad_result);
+
+  schd.waitFor(all_decoded);
+  schd.waitFor(bad_read);
+  assert(checked.load() == kNumChunks);
+  assert(bad_result < 0);
+  printf("  %u chunks read and checked, invalid read returned %lld\n",
+      checked.load(), static_cast<long long>(bad_result));
+  io.stop();
+}
+
+int main(int, char **) {
+  atexit(mem_report);
+  px_sched::Scheduler schd;
+  px_sched::SchedulerParams s_params;
+  s_params.mem_callbacks.alloc_fn = mem_check_alloc;
+  s_params.mem_callbacks.free_fn = mem_check_free;
+  schd.init(s_params);
+
+  // create a local file with known content
+  char path[] = "/tmp/px_sched_example10_XXXXXX";
+  int fd = mkstemp(path);
+  assert(fd >= 0);
+  unlink(path);
+  for(size_t i = 0; i < kNumChunks*kChunkSize; ++i) {
+    uint8_t v = static_cast<uint8_t>(i*7);
+    ssize_t w = write(fd, &v, 1);
+    assert(w == 1);
+  }
+
+  test_reads(schd, fd, false);
+  test_reads(schd, fd, true);
+  schd.stop();
+
+#if PX_SCHED_IMP_REGULAR_THREADS
+  // one read in flight at most, back to back reads find it taken
+  typedef std::chrono::steady_clock Clock;
+  static uint8_t data[kNumChunks*kChunkSize];
+  for(int force_io_threads = 0; force_io_threads < 2; ++force_io_threads) {
+    px_sched::IOParams io_params;
+    io_params.max_pending_reads = 1;
+    io_params.force_io_threads = force_io_threads != 0;
+
+    // the only worker waits for a task that only the thread waiting for
+    // room can run
+    px_sched::SchedulerParams p = s_params;
+    p.num_threads = 1;
+    p.max_running_threads = 1;
+    schd.init(p);
+    px_sched::IO io;
+    io.init(&schd, io_params);
+    std::atomic<bool> started = {false};
+    std::atomic<bool> helped = {false};
+    px_sched::Sync blocker, reads;
+    const Clock::time_point limit = Clock::now() + std::chrono::seconds(5);
+    schd.run([&] {
+      started.store(true);
+      while (!helped.load() && Clock::now() < limit) std::this_thread::yield();
+    }, &blocker);
+    while (!started.load()) std::this_thread::yield();
+    schd.run([&helped] { helped.store(true); });
+    uint32_t num_reads = 0;
+    while (!helped.load() && Clock::now() < limit) {
+      assert(io.read(fd, data, sizeof(data), 0, &reads));
+      num_reads++;
+    }
+    schd.waitFor(reads);
+    schd.waitFor(blocker);
+    printf("Reads waiting for room (%s): helped after %u reads\n",
+        io.usingIOUring()? "io_uring" : "I/O threads", num_reads);
+    assert(helped.load());
+    io.stop();
+    schd.stop();
+
+    // with Fail they return false instead
+    p = s_params;
+    p.overflow_policy = px_sched::OverflowPolicy::Fail;
+    schd.init(p);
+    io.init(&schd, io_params);
+    uint32_t accepted = 0, dropped = 0;
+    reads = px_sched::Sync();
+    while (!dropped && Clock::now() < limit + std::chrono::seconds(5)) {
+      px_sched::Sync s;
+      if (io.read(fd, data, sizeof(data), 0, &s)) {
+        accepted++;
+        schd.runAfter(s, [] {}, &reads);
+      } else {
+        assert(schd.hasFinished(s));
+        dropped++;
+      }
+    }
+    schd.waitFor(reads);
+    printf("  with Fail: %u reads accepted before one was dropped\n", accepted);
+    assert(dropped == 1);
+    io.stop();
+    schd.stop();
+  }
+#endif
+  close(fd);
+  return 0;
+}
@@ -0,0 +1,128 @@
+// Example-11:
+// Parallel algorithms (sort, scan, partition, transform_reduce), checked and
+// measured against the serial std:: versions
+
+#include <cstdlib>
+#include <vector>
+
+#define PX_SCHED_IMPLEMENTATION 1
+#include "../px_sched.h"
+#include "../px_sched_algorithms.h"
+#include "common/mem_check.h"
+#include <cassert>
+
+typedef std::chrono::steady_clock Clock;
+
+static double elapsed_ms(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+template<class A, class B>
+static void report(const char *name, A serial, B parallel) {
+  Clock::time_point t0 = Clock::now();
+  serial();
+  double ts = elapsed_ms(t0);
+  t0 = Clock::now();
+  parallel();
+  double tp = elapsed_ms(t0);
+  printf("%-28s std:: %8.2fms   px_sched:: %8.2fms   (x%.2f)\n", name, ts, tp, ts/tp);
+}
+
+int main(int, char **) {
+  atexit(mem_report);
+  px_sched::Scheduler schd;
+  px_sched::SchedulerParams s_params;
+  s_params.mem_callbacks.alloc_fn = mem_check_alloc;
+  s_params.mem_callbacks.free_fn = mem_check_free;
+  schd.init(s_params);
+  printf("Workers: %u (max running %u)\n", s_params.num_threads, schd.params().max_running_threads);
+
+  const size_t N = 1 << 20;
+  std::vector<uint32_t> keys(N);
+  srand(42);
+  for(auto &k : keys) k = static_cast<uint32_t>(rand());
+
+  { // sort render keys
+    std::vector<uint32_t> a = keys, b = keys;
+    report("parallel_sort",
+      [&] { std::sort(a.begin(), a.end()); },
+      [&] { px_sched::parallel_sort(schd, b.begin(), b.end()); });
+    assert(a == b);
+    // custom comparison, and small inputs
+    std::vector<uint32_t> c(keys.begin(), keys.begin()+100);
+    px_sched::parallel_sort(schd, c.begin(), c.end(), [](uint32_t x, uint32_t y) { return x > y; });
+    assert(std::is_sorted(c.begin(), c.end(), [](uint32_t x, uint32_t y) { return x > y; }));
+  }
+
+  { // prefix sum of visibility masks
+    std::vector<uint32_t> mask(N), a(N), b(N);
+    for(size_t i = 0; i < N; ++i) mask[i] = keys[i] & 1;
+    report("parallel_inclusive_scan",
+      [&] { std::partial_sum(mask.begin(), mask.end(), a.begin()); },
+      [&] { px_sched::parallel_inclusive_scan(schd, mask.begin(), mask.end(), b.begin()); });
+    assert(a == b);
+    // in place
+    px_sched::parallel_inclusive_scan(schd, mask.begin(), mask.end(), mask.begin());
+    assert(a == mask);
+  }
+
+  { // partition (stable)
+    std::vector<uint32_t> a = keys, b = keys;
+    auto pred = [](uint32_t k) { return (k % 3) == 0; };
+    std::vector<uint32_t>::iterator pa, pb;
+    report("parallel_partition",
+      [&] { pa = std::stable_partition(a.begin(), a.end(), pred); },
+      [&] { pb = px_sched::parallel_partition(schd, b.begin(), b.end(), pred); });
+    assert(a == b);
+    assert((pa - a.begin()) == (pb - b.begin()));
+  }
+
+  { // transform reduce
+    uint64_t a = 0, b = 0;
+    auto square = [](uint32_t k) { return static_cast<uint64_t>(k & 0xFFFF)*(k & 0xFFFF); };
+    report("parallel_transform_reduce",
+      [&] {
+        for(auto k : keys) a += square(k);
+      },
+      [&] {
+        b = px_sched::parallel_transform_reduce(schd, keys.begin(), keys.end(), static_cast<uint64_t>(0),
+          [](uint64_t x, uint64_t y) { return x+y; }, square);
+      });
+    assert(a == b);
+  }
+
+  { // parallel_for
+    std::vector<uint32_t> v(N, 1);
+    px_sched::parallel_for(schd, 0, N, 1024, [&v](size_t b, size_t e) {
+      for(size_t i = b; i < e; ++i) v[i] += static_cast<uint32_t>(i);
+    });
+    for(size_t i = 0; i < N; ++i) assert(v[i] == i+1);
+  }
+
+  { // Fail: with the pool almost full, rejected chunks run on this thread
+    px_sched::Scheduler small;
+    px_sched::SchedulerParams p = s_params;
+    p.max_number_tasks = 16;
+    p.overflow_policy = px_sched::OverflowPolicy::Fail;
+    small.init(p);
+    px_sched::Sync gate, held;
+    small.incrementSync(&gate);
+    uint32_t accepted = 0;
+    while (accepted < 14 && small.runAfter(gate, [] {}, &held)) accepted++;
+    std::vector<uint32_t> expected(keys.begin(), keys.begin()+N/4), sorted = expected;
+    std::sort(expected.begin(), expected.end());
+    px_sched::parallel_sort(small, sorted.begin(), sorted.end());
+    assert(expected == sorted);
+    std::vector<uint32_t> v(N/4, 1);
+    px_sched::parallel_for(small, 0, v.size(), 1024, [&v](size_t b, size_t e) {
+      for(size_t i = b; i < e; ++i) v[i] += static_cast<uint32_t>(i);
+    });
+    for(size_t i = 0; i < v.size(); ++i) assert(v[i] == i+1);
+    small.decrementSync(&gate);
+    small.waitFor(held);
+    small.stop();
+  }
+
+  printf("DONE\n");
+  return 0;
+}
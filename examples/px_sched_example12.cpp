@@ -0,0 +1,81 @@
+// Example-12:
+// Lanes: limit how many tasks of a group can run at the same time
+
+#define PX_SCHED_IMPLEMENTATION 1
+#include "../px_sched.h"
+#include "common/mem_check.h"
+#include <cassert>
+
+int main(int, char **) {
+  atexit(mem_report);
+  px_sched::Scheduler schd;
+  px_sched::SchedulerParams s_params;
+  s_params.num_threads = 4;
+  s_params.max_running_threads = 4;
+  s_params.mem_callbacks.alloc_fn = mem_check_alloc;
+  s_params.mem_callbacks.free_fn = mem_check_free;
+  schd.init(s_params);
+
+  const uint32_t kLaneSize = 2;
+  const uint32_t kNumTasks = 20;
+  px_sched::Lane lane;
+  lane.init(&schd, kLaneSize);
+
+  std::atomic<uint32_t> in_flight = {0};
+  std::atomic<uint32_t> max_in_flight = {0};
+  std::atomic<uint32_t> lane_done = {0};
+  std::atomic<bool> open = {false};
+  auto lane_task = [&] {
+    uint32_t n = in_flight.fetch_add(1) + 1;
+    uint32_t prev = max_in_flight.load();
+    while (n > prev && !max_in_flight.compare_exchange_weak(prev, n)) {}
+#if PX_SCHED_IMP_REGULAR_THREADS
+    // keep the lane busy until the main thread says so
+    while (!open.load()) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+#endif
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    in_flight.fetch_sub(1);
+    lane_done.fetch_add(1);
+  };
+
+  px_sched::Sync lane_sync;
+  for(uint32_t i = 0; i < kNumTasks; ++i) {
+    lane.run(lane_task, &lane_sync);
+  }
+
+#if PX_SCHED_IMP_REGULAR_THREADS
+  // the lane is saturated, but it only takes kLaneSize workers
+  assert(lane.num_running() == kLaneSize);
+  assert(lane.num_pending() == kNumTasks - kLaneSize);
+  px_sched::Sync other_sync;
+  std::atomic<uint32_t> other_done = {0};
+  for(uint32_t i = 0; i < 100; ++i) {
+    schd.run([&other_done] { other_done.fetch_add(1); }, &other_sync);
+  }
+  schd.waitFor(other_sync);
+  printf("Other tasks done (%u) while the lane has %u running and %u pending\n",
+    other_done.load(), lane.num_running(), lane.num_pending());
+  assert(other_done.load() == 100);
+  assert(lane_done.load() == 0);
+  open.store(true);
+#endif
+
+  // runAfter through a lane waits for the trigger and for a free slot
+  px_sched::Sync after_sync;
+  for(uint32_t i = 0; i < 4; ++i) {
+    lane.runAfter(lane_sync, [&] {
+      assert(lane_done.load() >= kNumTasks);
+      lane_task();
+    }, &after_sync);
+  }
+  schd.waitFor(after_sync);
+
+  printf("Lane tasks done %u, max in flight %u (limit %u)\n",
+    lane_done.load(), max_in_flight.load(), kLaneSize);
+  assert(lane_done.load() == kNumTasks + 4);
+  assert(max_in_flight.load() <= kLaneSize);
+  assert(lane.num_running() == 0 && lane.num_pending() == 0);
+
+  schd.stop();
+  return 0;
+}
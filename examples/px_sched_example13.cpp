@@ -0,0 +1,92 @@
+// Example-13:
+// Stall reports and the watchdog: long running tasks, orphan sync objects
+// (incrementSync without decrementSync) and sync cycles.
+
+#define PX_SCHED_IMPLEMENTATION 1
+#include "../px_sched.h"
+#include "common/mem_check.h"
+#include <cassert>
+
+struct WatchdogStats {
+  std::atomic<uint32_t> reports = {0};
+  std::atomic<uint32_t> long_tasks = {0};
+  std::atomic<uint32_t> orphans = {0};
+  std::atomic<uint32_t> cycles = {0};
+};
+
+static void OnStall(const px_sched::StallReport &report, void *user_data) {
+  WatchdogStats *stats = static_cast<WatchdogStats*>(user_data);
+  char buffer[1024];
+  report.format(buffer, sizeof(buffer));
+  printf("Watchdog report from %s:\n%s", px_sched::Scheduler::current_thread_name(), buffer);
+  stats->reports.fetch_add(1);
+  stats->long_tasks.fetch_add(report.num_long_tasks);
+  stats->orphans.fetch_add(report.num_orphans);
+  stats->cycles.fetch_add(report.num_cycles);
+}
+
+int main(int, char **) {
+  atexit(mem_report);
+  WatchdogStats stats;
+  px_sched::Scheduler schd;
+  px_sched::SchedulerParams s_params;
+  s_params.mem_callbacks.alloc_fn = mem_check_alloc;
+  s_params.mem_callbacks.free_fn = mem_check_free;
+  s_params.watchdog_threshold_in_microseconds = 20000;
+  s_params.watchdog_fn = OnStall;
+  s_params.watchdog_user_data = &stats;
+  schd.init(s_params);
+
+  px_sched::StallReport report;
+  char buffer[1024];
+
+#if PX_SCHED_IMP_REGULAR_THREADS
+  // (a) a task running for longer than the threshold
+  px_sched::Sync slow;
+  schd.run([] { std::this_thread::sleep_for(std::chrono::milliseconds(100)); }, &slow);
+  schd.waitFor(slow);
+  assert(stats.long_tasks.load() > 0);
+#endif
+
+  // (b) a sync object only kept alive by incrementSync, with a task waiting
+  px_sched::Sync manual;
+  std::atomic<bool> released = {false};
+  schd.incrementSync(&manual);
+  schd.runAfter(manual, [&released] { released.store(true); });
+  schd.getStallReport(&report);
+  report.format(buffer, sizeof(buffer));
+  printf("Orphan report:\n%s", buffer);
+  assert(report.num_orphans == 1 && report.num_cycles == 0);
+  assert(report.orphans[0].user_count == 1 && report.orphans[0].waiting_tasks == 1);
+#if PX_SCHED_IMP_REGULAR_THREADS
+  // nothing else runs meanwhile, the watchdog reports it too
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  assert(stats.orphans.load() > 0);
+#endif
+  schd.decrementSync(&manual);
+  schd.waitFor(manual);
+  while (!released.load()) std::this_thread::yield();
+  schd.getStallReport(&report);
+  assert(report.num_orphans == 0 && report.num_cycles == 0);
+
+  // (c) a task that waits for the sync object it has to release, it will
+  // never run (the scheduler cleans it on stop)
+  px_sched::Sync cycle;
+  schd.incrementSync(&cycle);
+  schd.runAfter(cycle, [] { abort(); }, &cycle);
+  schd.decrementSync(&cycle);
+  schd.getStallReport(&report);
+  report.format(buffer, sizeof(buffer));
+  printf("Cycle report:\n%s", buffer);
+  assert(report.num_cycles == 1 && report.num_orphans == 0);
+  assert(report.cycles[0].owner_tasks == 1 && report.cycles[0].waiting_tasks == 1);
+#if PX_SCHED_IMP_REGULAR_THREADS
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  assert(stats.cycles.load() > 0);
+#endif
+
+  printf("Watchdog reports: %u (long tasks %u, orphans %u, cycles %u)\n",
+    stats.reports.load(), stats.long_tasks.load(), stats.orphans.load(), stats.cycles.load());
+  schd.stop();
+  return 0;
+}
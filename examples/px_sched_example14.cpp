@@ -0,0 +1,99 @@
+// Example-14:
+// Introspection: iterate over tasks and sync objects, and export the
+// dependency graph as JSON or Graphviz DOT.
+
+#define PX_SCHED_IMPLEMENTATION 1
+#include "../px_sched.h"
+#include "common/mem_check.h"
+#include <cassert>
+#include <cstring>
+#include <vector>
+
+int main(int, char **) {
+  atexit(mem_report);
+  px_sched::Scheduler schd;
+  px_sched::SchedulerParams s_params;
+  s_params.num_threads = 1;
+  s_params.mem_callbacks.alloc_fn = mem_check_alloc;
+  s_params.mem_callbacks.free_fn = mem_check_free;
+  schd.init(s_params);
+
+  // gate: a sync object kept alive by hand, two tasks wait on it and release
+  // stage2, which gates one more task
+  px_sched::Sync gate, stage2, last;
+  schd.incrementSync(&gate);
+  schd.runAfter(gate, [] {}, &stage2);
+  schd.runAfter(gate, [] {}, &stage2);
+  schd.runAfter(stage2, [] {}, &last);
+
+#if PX_SCHED_IMP_REGULAR_THREADS
+  // keep the only worker busy, so the next tasks stay in the ready queue
+  // (after the ring has been used)
+  std::atomic<bool> open = {false};
+  std::atomic<bool> started = {false};
+  px_sched::Sync busy, queued;
+  schd.run([&] { started.store(true); while (!open.load()) std::this_thread::yield(); }, &busy);
+  while (!started.load()) std::this_thread::yield();
+  for(int i = 0; i < 3; ++i) schd.run([] {}, &queued);
+  std::vector<uint32_t> ready;
+  schd.forEachReadyTask([&](uint32_t tid) { ready.push_back(tid); });
+  assert(ready.size() == 3);
+  uint32_t ready_found = 0;
+  schd.forEachTask([&](const px_sched::Scheduler::TaskInfo &t) {
+    for(uint32_t r : ready) {
+      if (r == t.id) {
+        assert(t.sync == queued.id());
+        ready_found++;
+      }
+    }
+  });
+  assert(ready_found == 3);
+#endif
+
+  uint32_t waiting_on_gate = 0;
+  schd.forEachWaitingTask(gate.id(), [&](const px_sched::Scheduler::TaskInfo &t) {
+    assert(t.sync == stage2.id());
+    waiting_on_gate++;
+  });
+  assert(waiting_on_gate == 2);
+  bool gate_found = false;
+  schd.forEachSync([&](const px_sched::Scheduler::SyncInfo &c) {
+    if (c.id == gate.id()) {
+      gate_found = true;
+      assert(c.user_count == 1 && c.first_task != 0);
+    }
+  });
+  assert(gate_found);
+
+  // exporters return the size needed, so a small buffer is never silently
+  // truncated
+  char small[16];
+  size_t json_size = schd.exportJSON(small, sizeof(small));
+  assert(json_size >= sizeof(small) && strlen(small) == sizeof(small)-1);
+  std::vector<char> json(json_size+1);
+  assert(schd.exportJSON(json.data(), json.size()) == json_size);
+  printf("JSON:\n%s", json.data());
+  assert(strstr(json.data(), "\"tasks\":[") && strstr(json.data(), "\"ready\":["));
+
+  size_t dot_size = schd.exportDOT(nullptr, 0);
+  std::vector<char> dot(dot_size+1);
+  schd.exportDOT(dot.data(), dot.size());
+  printf("DOT:\n%s", dot.data());
+  char edge[64];
+  snprintf(edge, sizeof(edge), "s%u -> t", gate.id());
+  assert(strstr(dot.data(), "digraph px_sched {") && strstr(dot.data(), edge));
+
+  size_t status_size = schd.getDebugStatus(nullptr, 0);
+  std::vector<char> status(status_size+1);
+  assert(schd.getDebugStatus(status.data(), status.size()) == status_size);
+  printf("Debug status:\n%s", status.data());
+
+#if PX_SCHED_IMP_REGULAR_THREADS
+  open.store(true);
+  schd.waitFor(queued);
+#endif
+  schd.decrementSync(&gate);
+  schd.waitFor(last);
+  schd.stop();
+  return 0;
+}
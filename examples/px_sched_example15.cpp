@@ -0,0 +1,91 @@
+// Example-15:
+// Elastic worker pool: workers are started when tasks back up, retired when
+// idle, and max running threads can be changed at runtime.
+
+#define PX_SCHED_IMPLEMENTATION 1
+#include "../px_sched.h"
+#include "common/mem_check.h"
+#include <cassert>
+
+int main(int, char **) {
+  atexit(mem_report);
+  px_sched::Scheduler schd;
+  px_sched::SchedulerParams s_params;
+  s_params.num_threads = 4;
+  s_params.max_running_threads = 4;
+  s_params.min_threads = 1;
+  s_params.thread_retire_on_idle_in_microseconds = 20000;
+  s_params.mem_callbacks.alloc_fn = mem_check_alloc;
+  s_params.mem_callbacks.free_fn = mem_check_free;
+  schd.init(s_params);
+
+  typedef px_sched::Scheduler::Clock Clock;
+  auto wait_until = [](const std::function<bool()> &cond) {
+    const Clock::time_point limit = Clock::now() + std::chrono::seconds(5);
+    while (!cond() && Clock::now() < limit) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return cond();
+  };
+
+#if PX_SCHED_IMP_REGULAR_THREADS
+  printf("Live threads after init: %u\n", schd.num_live_threads());
+  assert(schd.num_live_threads() == 1);
+
+  // (a) four tasks that only finish when all of them are running at once,
+  // the pool has to grow up to num_threads
+  std::atomic<uint32_t> started = {0};
+  px_sched::Sync all;
+  for(int i = 0; i < 4; ++i) {
+    schd.run([&] {
+      started.fetch_add(1);
+      const Clock::time_point limit = Clock::now() + std::chrono::seconds(5);
+      while (started.load() < 4 && Clock::now() < limit) std::this_thread::yield();
+    }, &all);
+  }
+  schd.waitFor(all);
+  printf("Tasks running at the same time %u, live threads %u\n", started.load(), schd.num_live_threads());
+  assert(started.load() == 4);
+  assert(schd.num_live_threads() == 4);
+
+  // (b) once idle, workers retire down to min_threads
+  bool shrunk = wait_until([&] { return schd.num_live_threads() == 1; });
+  printf("Live threads after being idle: %u\n", schd.num_live_threads());
+  assert(shrunk);
+#endif
+
+  // (c) max running threads changed at runtime
+  schd.setMaxRunningThreads(2);
+  std::atomic<uint32_t> running = {0};
+  std::atomic<uint32_t> max_running = {0};
+  px_sched::Sync limited;
+  for(int i = 0; i < 16; ++i) {
+    schd.run([&] {
+      uint32_t n = running.fetch_add(1) + 1;
+      uint32_t prev = max_running.load();
+      while (n > prev && !max_running.compare_exchange_weak(prev, n)) {}
+      std::this_thread::sleep_for(std::chrono::milliseconds(2));
+      running.fetch_sub(1);
+    }, &limited);
+  }
+  schd.waitFor(limited);
+  printf("Max running threads %u, observed %u\n", schd.max_running_threads(), max_running.load());
+#if PX_SCHED_IMP_REGULAR_THREADS
+  assert(schd.max_running_threads() == 2);
+  assert(max_running.load() <= 2);
+#endif
+
+  // retired workers are started again when needed
+  schd.setMaxRunningThreads(4);
+  std::atomic<uint32_t> count = {0};
+  px_sched::Sync again;
+  for(int i = 0; i < 100; ++i) {
+    schd.run([&count] { count.fetch_add(1); }, &again);
+  }
+  schd.waitFor(again);
+  assert(count.load() == 100);
+  (void)wait_until;
+
+  schd.stop();
+  return 0;
+}
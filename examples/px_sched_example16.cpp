@@ -0,0 +1,64 @@
+// Example-16:
+// BlockingScope: a job that blocks lets another worker run in its place
+
+#define PX_SCHED_IMPLEMENTATION 1
+#include "../px_sched.h"
+#include "common/mem_check.h"
+#include <cassert>
+#include <condition_variable>
+#include <mutex>
+
+int main(int, char **) {
+  atexit(mem_report);
+  px_sched::Scheduler schd;
+  px_sched::SchedulerParams s_params;
+  s_params.num_threads = 4;
+  s_params.max_running_threads = 1;
+  s_params.mem_callbacks.alloc_fn = mem_check_alloc;
+  s_params.mem_callbacks.free_fn = mem_check_free;
+  schd.init(s_params);
+
+#if PX_SCHED_IMP_REGULAR_THREADS
+  // only one worker can run at a time: the consumer blocks on an external
+  // condition variable that only the producer task will signal
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool produced = false;
+  std::atomic<bool> consumer_started = {false};
+  px_sched::Sync done;
+  schd.run([&] {
+    consumer_started.store(true);
+    px_sched::Scheduler::BlockingScope blocking(&schd);
+    std::unique_lock<std::mutex> lk(mutex);
+    cv.wait(lk, [&produced] { return produced; });
+    printf("Consumer unblocked on %s\n", px_sched::Scheduler::current_thread_name());
+  }, &done);
+  while (!consumer_started.load()) std::this_thread::yield();
+  schd.run([&] {
+    printf("Producer running on %s (active threads %u)\n",
+        px_sched::Scheduler::current_thread_name(), schd.active_threads());
+    std::lock_guard<std::mutex> lk(mutex);
+    produced = true;
+    cv.notify_all();
+  }, &done);
+  schd.waitFor(done);
+#endif
+
+  // waitFor from inside a task is compensated the same way
+  px_sched::Sync outer;
+  std::atomic<uint32_t> inner_done = {0};
+  schd.run([&] {
+    px_sched::Sync inner;
+    for(int i = 0; i < 8; ++i) {
+      schd.run([&inner_done] { inner_done.fetch_add(1); }, &inner);
+    }
+    schd.waitFor(inner);
+    assert(inner_done.load() == 8);
+  }, &outer);
+  schd.waitFor(outer);
+  printf("Inner tasks done %u\n", inner_done.load());
+  assert(inner_done.load() == 8);
+
+  schd.stop();
+  return 0;
+}
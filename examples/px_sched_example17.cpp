@@ -0,0 +1,70 @@
+// Example-17:
+// Benchmark: cost of run() with many workers, when they are all sleeping
+// (run() wakes them up) and when they are all busy (nobody to wake up).
+
+#define PX_SCHED_IMPLEMENTATION 1
+#include "../px_sched.h"
+#include "common/mem_check.h"
+#include <cassert>
+
+int main(int, char **) {
+  atexit(mem_report);
+  px_sched::Scheduler schd;
+  px_sched::SchedulerParams s_params;
+  s_params.num_threads = 64;
+  s_params.max_running_threads = 64;
+  s_params.mem_callbacks.alloc_fn = mem_check_alloc;
+  s_params.mem_callbacks.free_fn = mem_check_free;
+  schd.init(s_params);
+
+  typedef px_sched::Scheduler::Clock Clock;
+  const int kRounds = 200;
+  const int kTasksPerRound = 64;
+  std::atomic<uint32_t> count = {0};
+  Clock::duration run_time = Clock::duration::zero();
+  for(int r = 0; r < kRounds; ++r) {
+    // let workers go back to sleep, so every round has to wake them up
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+    px_sched::Sync s;
+    Clock::time_point start = Clock::now();
+    for(int i = 0; i < kTasksPerRound; ++i) {
+      schd.run([&count] { count.fetch_add(1); }, &s);
+    }
+    run_time += Clock::now() - start;
+    schd.waitFor(s);
+  }
+  assert(count.load() == kRounds*kTasksPerRound);
+  double ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(run_time).count());
+  printf("run() with %u idle workers: %.1f ns per call (%d calls)\n",
+      static_cast<unsigned>(s_params.num_threads), ns/(kRounds*kTasksPerRound), kRounds*kTasksPerRound);
+
+#if PX_SCHED_IMP_REGULAR_THREADS
+  // all workers blocked (but not counted as running), run() looks for an
+  // idle worker and finds none
+  std::atomic<bool> open = {false};
+  std::atomic<uint32_t> blocked = {0};
+  px_sched::Sync blockers;
+  for(uint16_t i = 0; i < s_params.num_threads; ++i) {
+    schd.run([&] {
+      px_sched::Scheduler::BlockingScope scope(&schd);
+      blocked.fetch_add(1);
+      while (!open.load()) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }, &blockers);
+  }
+  while (blocked.load() < s_params.num_threads) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  const int kBusyCalls = 512;
+  px_sched::Sync busy;
+  Clock::time_point start = Clock::now();
+  for(int i = 0; i < kBusyCalls; ++i) {
+    schd.run([&count] { count.fetch_add(1); }, &busy);
+  }
+  ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+  printf("run() with %u busy workers: %.1f ns per call (%d calls)\n",
+      static_cast<unsigned>(s_params.num_threads), ns/kBusyCalls, kBusyCalls);
+  open.store(true);
+  schd.waitFor(blockers);
+  schd.waitFor(busy);
+#endif
+  schd.stop();
+  return 0;
+}
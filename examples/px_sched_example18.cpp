@@ -0,0 +1,45 @@
+// Example-18:
+// Benchmark: releasing a sync object with many dependent tasks, the tasks
+// go to the ready queue in bulk.
+
+#define PX_SCHED_IMPLEMENTATION 1
+#include "../px_sched.h"
+#include "common/mem_check.h"
+#include <cassert>
+
+int main(int, char **) {
+  atexit(mem_report);
+  px_sched::Scheduler schd;
+  px_sched::SchedulerParams s_params;
+  s_params.num_threads = 8;
+  s_params.max_running_threads = 8;
+  s_params.max_number_tasks = 2048;
+  s_params.mem_callbacks.alloc_fn = mem_check_alloc;
+  s_params.mem_callbacks.free_fn = mem_check_free;
+  schd.init(s_params);
+
+  typedef px_sched::Scheduler::Clock Clock;
+  const int kRounds = 20;
+  const int kDependents = 1000;
+  std::atomic<uint32_t> count = {0};
+  Clock::duration release_time = Clock::duration::zero();
+  for(int r = 0; r < kRounds; ++r) {
+    px_sched::Sync gate, done;
+    schd.incrementSync(&gate);
+    for(int i = 0; i < kDependents; ++i) {
+      schd.runAfter(gate, [&count] { count.fetch_add(1); }, &done);
+    }
+    // let workers go to sleep
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    Clock::time_point start = Clock::now();
+    schd.decrementSync(&gate);
+    release_time += Clock::now() - start;
+    schd.waitFor(done);
+  }
+  assert(count.load() == kRounds*kDependents);
+  double us = static_cast<double>(std::chrono::duration_cast<std::chrono::microseconds>(release_time).count());
+  printf("Releasing %d dependent tasks: %.1f us (%d rounds)\n", kDependents, us/kRounds, kRounds);
+
+  schd.stop();
+  return 0;
+}
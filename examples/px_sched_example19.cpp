@@ -0,0 +1,50 @@
+// Example-19:
+// Structure-of-arrays object pools: states and elements in separate arrays.
+// Prints the memory used by the scheduler and the cost of a scan over all
+// the sync objects (build with -DPX_SCHED_POOL_SOA=0 to compare).
+
+#ifndef PX_SCHED_POOL_SOA
+#define PX_SCHED_POOL_SOA 1
+#endif
+#define PX_SCHED_IMPLEMENTATION 1
+#include "../px_sched.h"
+#include "common/mem_check.h"
+#include <cassert>
+
+int main(int, char **) {
+  atexit(mem_report);
+  px_sched::Scheduler schd;
+  px_sched::SchedulerParams s_params;
+  s_params.num_threads = 4;
+  s_params.max_number_tasks = 16384;
+  s_params.mem_callbacks.alloc_fn = mem_check_alloc;
+  s_params.mem_callbacks.free_fn = mem_check_free;
+  size_t before_init = GLOBAL_amount_alloc;
+  schd.init(s_params);
+  printf("Scheduler memory (%u tasks, SoA pools %d): %zu bytes\n",
+      static_cast<unsigned>(s_params.max_number_tasks), PX_SCHED_POOL_SOA, GLOBAL_amount_alloc - before_init);
+
+  // the pools work the same way with either layout
+  std::atomic<uint32_t> count = {0};
+  px_sched::Sync stage1, stage2;
+  for(int i = 0; i < 1000; ++i) {
+    schd.run([&count] { count.fetch_add(1); }, &stage1);
+    schd.runAfter(stage1, [&count] { count.fetch_add(1); }, &stage2);
+  }
+  schd.waitFor(stage2);
+  assert(count.load() == 2000);
+
+  typedef px_sched::Scheduler::Clock Clock;
+  const int kScans = 200;
+  uint32_t found = 0;
+  Clock::time_point start = Clock::now();
+  for(int i = 0; i < kScans; ++i) {
+    schd.forEachSync([&found](const px_sched::Scheduler::SyncInfo &) { found++; });
+  }
+  double us = static_cast<double>(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count());
+  printf("Scan over %u sync objects: %.1f us\n", static_cast<unsigned>(s_params.max_number_tasks), us/kScans);
+  assert(found == 0);
+
+  schd.stop();
+  return 0;
+}
@@ -0,0 +1,87 @@
+// Example-20:
+// Task labels: shown by the trace hook, the debug status and stall reports.
+
+#include <atomic>
+#include <cstring>
+
+// counts how many times labeled jobs go through the trace hook
+struct TraceScope {
+  static std::atomic<unsigned> physics;
+  static std::atomic<unsigned> render;
+  explicit TraceScope(const char *name) {
+    if (strcmp(name, "physics") == 0) physics.fetch_add(1);
+    if (strcmp(name, "render") == 0) render.fetch_add(1);
+  }
+};
+std::atomic<unsigned> TraceScope::physics = {0};
+std::atomic<unsigned> TraceScope::render = {0};
+
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+#define PX_SCHED_TRACE_FN(name) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#define PX_SCHED_TASK_LABELS 1
+#define PX_SCHED_IMPLEMENTATION 1
+#include "../px_sched.h"
+#include "common/mem_check.h"
+#include <cassert>
+#include <vector>
+
+int main(int, char **) {
+  atexit(mem_report);
+  px_sched::Scheduler schd;
+  px_sched::SchedulerParams s_params;
+  s_params.num_threads = 2;
+  // only to make workers track their current task (see getStallReport)
+  s_params.watchdog_threshold_in_microseconds = 10000000;
+  s_params.mem_callbacks.alloc_fn = mem_check_alloc;
+  s_params.mem_callbacks.free_fn = mem_check_free;
+  schd.init(s_params);
+
+  px_sched::Sync physics, render;
+  for(int i = 0; i < 4; ++i) {
+    schd.run([] {}, &physics, "physics");
+  }
+  schd.runAfter(physics, [] {}, &render, "render");
+  schd.waitFor(render);
+  printf("Traced physics %u, render %u\n", TraceScope::physics.load(), TraceScope::render.load());
+  assert(TraceScope::physics.load() == 4 && TraceScope::render.load() == 1);
+
+  // labels of pending tasks
+  px_sched::Sync gate, last;
+  schd.incrementSync(&gate);
+  schd.runAfter(gate, [] {}, &last, "waiting-for-gate");
+  bool found = false;
+  schd.forEachTask([&found](const px_sched::Scheduler::TaskInfo &t) {
+    if (t.label && strcmp(t.label, "waiting-for-gate") == 0) found = true;
+  });
+  assert(found);
+  size_t size = schd.getDebugStatus(nullptr, 0);
+  std::vector<char> status(size+1);
+  schd.getDebugStatus(status.data(), status.size());
+  printf("Debug status:\n%s", status.data());
+  assert(strstr(status.data(), "(waiting-for-gate)"));
+  schd.decrementSync(&gate);
+  schd.waitFor(last);
+
+#if PX_SCHED_IMP_REGULAR_THREADS
+  // labels of long running tasks
+  px_sched::Sync slow;
+  std::atomic<bool> started = {false};
+  schd.run([&started] {
+    started.store(true);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }, &slow, "slow-io");
+  while (!started.load()) std::this_thread::yield();
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  px_sched::StallReport report;
+  schd.getStallReport(&report, 10000);
+  char buffer[1024];
+  report.format(buffer, sizeof(buffer));
+  printf("Stall report:\n%s", buffer);
+  assert(report.num_long_tasks == 1 && strcmp(report.long_tasks[0].label, "slow-io") == 0);
+  schd.waitFor(slow);
+#endif
+
+  schd.stop();
+  return 0;
+}
@@ -0,0 +1,67 @@
+// Example-21:
+// Schedulers with different job types in the same program: plain structs
+// (trivially copyable, copied with memcpy) and the default std::function.
+
+#define PX_SCHED_IMPLEMENTATION 1
+#include "../px_sched.h"
+#include "common/mem_check.h"
+#include <cassert>
+
+struct PodJob {
+  void (*func)(void *arg);
+  void *arg;
+  void operator()() { func(arg); }
+};
+static_assert(std::is_trivially_copyable<PodJob>::value, "PodJob must be trivially copyable");
+
+PX_SCHED_INSTANTIATE(PodJob);
+
+typedef px_sched::BasicScheduler<PodJob> PodScheduler;
+
+static void Increment(void *arg) {
+  static_cast<std::atomic<uint32_t>*>(arg)->fetch_add(1);
+}
+
+int main(int, char **) {
+  atexit(mem_report);
+  px_sched::SchedulerParams s_params;
+  s_params.num_threads = 2;
+  s_params.mem_callbacks.alloc_fn = mem_check_alloc;
+  s_params.mem_callbacks.free_fn = mem_check_free;
+
+  PodScheduler hot;
+  px_sched::Scheduler tools;
+  hot.init(s_params);
+  tools.init(s_params);
+
+  std::atomic<uint32_t> count = {0};
+  PodJob job = { Increment, &count };
+  px_sched::Sync first, second;
+  for(int i = 0; i < 100; ++i) {
+    hot.run(PodJob(job), &first);
+  }
+  hot.runAfter(first, PodJob(job), &second);
+  hot.waitFor(second);
+  assert(count.load() == 101);
+
+  // lanes work with any job type
+  PodScheduler::Lane lane;
+  lane.init(&hot, 1);
+  px_sched::Sync lane_sync;
+  for(int i = 0; i < 10; ++i) {
+    lane.run(PodJob(job), &lane_sync);
+  }
+  hot.waitFor(lane_sync);
+  assert(count.load() == 111);
+
+  // the default scheduler still takes lambdas
+  px_sched::Sync tools_sync;
+  tools.run([&count] { count.fetch_add(1000); }, &tools_sync);
+  tools.waitFor(tools_sync);
+  printf("Count %u\n", count.load());
+  assert(count.load() == 1111);
+
+  hot.stop();
+  tools.stop();
+  return 0;
+}
@@ -0,0 +1,111 @@
+// Example-22:
+// Overflow policies: what run/runAfter do when there is no room for more
+// tasks (pools sized for the typical case instead of the worst case).
+
+#define PX_SCHED_IMPLEMENTATION 1
+#include "../px_sched.h"
+#include "common/mem_check.h"
+#include <cassert>
+
+static px_sched::SchedulerParams Params(px_sched::OverflowPolicy policy) {
+  px_sched::SchedulerParams s_params;
+  s_params.num_threads = 2;
+  s_params.max_number_tasks = 16;
+  s_params.overflow_policy = policy;
+  s_params.mem_callbacks.alloc_fn = mem_check_alloc;
+  s_params.mem_callbacks.free_fn = mem_check_free;
+  return s_params;
+}
+
+// binary tree of tasks, every node launches its two children
+static void Node(px_sched::Scheduler *schd, px_sched::Sync *sync, std::atomic<uint32_t> *count, int depth) {
+  count->fetch_add(1);
+  if (depth == 0) return;
+  for(int i = 0; i < 2; ++i) {
+    bool ok = schd->run([=] { Node(schd, sync, count, depth-1); }, sync);
+    assert(ok);
+    (void)ok;
+  }
+}
+
+int main(int, char **) {
+  atexit(mem_report);
+
+  { // RunInline: the tree has 2047 nodes, with room for 16 tasks
+    px_sched::Scheduler schd;
+    schd.init(Params(px_sched::OverflowPolicy::RunInline));
+    std::atomic<uint32_t> count = {0};
+    px_sched::Sync tree;
+    schd.run([&] { Node(&schd, &tree, &count, 10); }, &tree);
+    schd.waitFor(tree);
+    printf("RunInline: %u nodes\n", count.load());
+    assert(count.load() == 2047);
+    schd.stop();
+  }
+
+  { // Fail: tasks waiting for a gate fill the pool
+    px_sched::Scheduler schd;
+    schd.init(Params(px_sched::OverflowPolicy::Fail));
+    std::atomic<uint32_t> count = {0};
+    px_sched::Sync gate, done;
+    schd.incrementSync(&gate);
+    uint32_t accepted = 0;
+    while (schd.runAfter(gate, [&count] { count.fetch_add(1); }, &done)) accepted++;
+    printf("Fail: %u tasks accepted\n", accepted);
+    assert(accepted > 0 && accepted <= 16);
+#if PX_SCHED_IMP_REGULAR_THREADS
+    // (on single threaded mode run executes the job right away)
+    assert(!schd.run([] { abort(); }));
+#endif
+    // lanes, channels and resources drop their jobs too
+    px_sched::Lane lane;
+    lane.init(&schd);
+    assert(!lane.run([] { abort(); }));
+    assert(!lane.runAfter(gate, [] { abort(); }));
+    px_sched::Channel<uint32_t, 4> channel;
+    channel.init(&schd);
+    assert(!channel.onReceive([] { abort(); }));
+    assert(channel.trySend(7));
+#if PX_SCHED_IMP_REGULAR_THREADS
+    // (with an item available the receiver is launched with run)
+    assert(!channel.onReceive([] { abort(); }));
+#endif
+    px_sched::Resource<uint32_t> res;
+    res.init(&schd);
+    px_sched::Sync res_done;
+    assert(!res.executeWrite([](uint32_t*) { abort(); }, &res_done));
+    assert(!res.executeRead([](const uint32_t*) { abort(); }, &res_done));
+    assert(schd.hasFinished(res_done));
+    schd.decrementSync(&gate);
+    schd.waitFor(done);
+    assert(count.load() == accepted);
+    // the item was not taken by the dropped receivers
+    uint32_t item = 0;
+    assert(channel.tryReceive(&item) && item == 7);
+    assert(res.executeWrite([](uint32_t *v) { *v = 1; }));
+    assert(res.executeRead([](const uint32_t *v) { assert(*v == 1); }, &res_done));
+    res.finish();
+    assert(schd.hasFinished(res_done));
+    // room again
+    assert(schd.run([&count] { count.fetch_add(1); }, &done));
+    schd.waitFor(done);
+    schd.stop();
+  }
+
+  { // WaitAndHelp: the caller executes ready tasks while the pool is full
+    px_sched::Scheduler schd;
+    schd.init(Params(px_sched::OverflowPolicy::WaitAndHelp));
+    std::atomic<uint32_t> count = {0};
+    px_sched::Sync done;
+    for(int i = 0; i < 1000; ++i) {
+      bool ok = schd.run([&count] { count.fetch_add(1); }, &done);
+      assert(ok);
+      (void)ok;
+    }
+    schd.waitFor(done);
+    printf("WaitAndHelp: %u tasks\n", count.load());
+    assert(count.load() == 1000);
+    schd.stop();
+  }
+  return 0;
+}
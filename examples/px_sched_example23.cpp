@@ -0,0 +1,137 @@
+// Example-23:
+// Pipeline: read -> decompress -> parse -> index, with a bounded number of
+// items in flight. The index stage is serial and must see the items in the
+// order they were read.
+
+#include <vector>
+
+#define PX_SCHED_IMPLEMENTATION 1
+#include "../px_sched.h"
+#include "../px_sched_algorithms.h"
+#include "common/mem_check.h"
+#include <cassert>
+
+struct Record {
+  uint32_t seq;
+  uint32_t raw;
+  uint64_t data;
+  uint64_t key;
+};
+
+static void max_update(std::atomic<uint32_t> *max, uint32_t value) {
+  uint32_t prev = max->load();
+  while (value > prev && !max->compare_exchange_weak(prev, value)) {}
+}
+
+int main(int, char **) {
+  atexit(mem_report);
+  px_sched::Scheduler schd;
+  px_sched::SchedulerParams s_params;
+  s_params.num_threads = 4;
+  s_params.max_running_threads = 4;
+  s_params.mem_callbacks.alloc_fn = mem_check_alloc;
+  s_params.mem_callbacks.free_fn = mem_check_free;
+  schd.init(s_params);
+
+  const uint32_t kItems = 5000;
+  const size_t kTokens = 8;
+  std::vector<Record> slots(kTokens);
+  std::atomic<uint32_t> in_flight = {0};
+  std::atomic<uint32_t> max_in_flight = {0};
+  std::atomic<uint32_t> decompressing = {0};
+  std::atomic<uint32_t> max_decompressing = {0};
+  uint32_t read = 0;
+  uint32_t indexed = 0;
+  uint64_t checksum = 0;
+
+  px_sched::Pipeline()
+    .input([&](size_t t) {
+      if (read == kItems) return false;
+      max_update(&max_in_flight, in_flight.fetch_add(1) + 1);
+      slots[t].seq = read;
+      slots[t].raw = read*2654435761u;
+      read++;
+      return true;
+    })
+    .stage(px_sched::Pipeline::Mode::Parallel, [&](size_t t) {
+      // decompress
+      max_update(&max_decompressing, decompressing.fetch_add(1) + 1);
+      uint64_t v = slots[t].raw;
+      for(int i = 0; i < 2000; ++i) v = v*6364136223846793005ull + 1442695040888963407ull;
+      slots[t].data = v;
+      decompressing.fetch_sub(1);
+    })
+    .stage(px_sched::Pipeline::Mode::Parallel, [&](size_t t) {
+      // parse
+      slots[t].key = slots[t].data >> 32;
+    })
+    .stage(px_sched::Pipeline::Mode::SerialInOrder, [&](size_t t) {
+      // index
+      assert(slots[t].seq == indexed);
+      indexed++;
+      checksum = checksum*31 + slots[t].key;
+      in_flight.fetch_sub(1);
+    })
+    .run(schd, kTokens);
+
+  printf("Items %u indexed in order, max in flight %u (tokens %u), max decompressing at once %u\n",
+      indexed, max_in_flight.load(), static_cast<unsigned>(kTokens), max_decompressing.load());
+  assert(read == kItems && indexed == kItems);
+  assert(max_in_flight.load() <= kTokens);
+
+  // same pipeline computed serially
+  uint64_t expected = 0;
+  for(uint32_t i = 0; i < kItems; ++i) {
+    uint64_t v = i*2654435761u;
+    for(int j = 0; j < 2000; ++j) v = v*6364136223846793005ull + 1442695040888963407ull;
+    expected = expected*31 + (v >> 32);
+  }
+  assert(checksum == expected);
+
+  // an empty input finishes right away
+  uint32_t calls = 0;
+  px_sched::Pipeline()
+    .input([&](size_t) { calls++; return false; })
+    .stage(px_sched::Pipeline::Mode::SerialInOrder, [](size_t) { abort(); })
+    .run(schd, 4);
+  assert(calls == 1);
+
+  { // Fail: with the pool almost full, rejected stages run on the thread
+    // that finished the previous one
+    px_sched::Scheduler small;
+    px_sched::SchedulerParams p = s_params;
+    p.max_number_tasks = 8;
+    p.overflow_policy = px_sched::OverflowPolicy::Fail;
+    small.init(p);
+    px_sched::Sync gate, held;
+    small.incrementSync(&gate);
+    uint32_t accepted = 0;
+    while (accepted < 7 && small.runAfter(gate, [] {}, &held)) accepted++;
+    read = 0;
+    indexed = 0;
+    uint64_t sum = 0;
+    std::vector<uint64_t> values(kTokens);
+    px_sched::Pipeline()
+      .input([&](size_t t) {
+        if (read == kItems) return false;
+        slots[t].seq = read++;
+        return true;
+      })
+      .stage(px_sched::Pipeline::Mode::Parallel, [&](size_t t) { values[t] = slots[t].seq*3u; })
+      .stage(px_sched::Pipeline::Mode::SerialInOrder, [&](size_t t) {
+        assert(slots[t].seq == indexed);
+        indexed++;
+        sum += values[t];
+      })
+      .run(small, kTokens);
+    assert(read == kItems && indexed == kItems);
+    assert(sum == 3ull*kItems*(kItems-1)/2);
+    small.decrementSync(&gate);
+    small.waitFor(held);
+    small.stop();
+  }
+
+  schd.stop();
+  (void)expected;
+  return 0;
+}
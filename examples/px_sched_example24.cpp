@@ -0,0 +1,92 @@
+// Example-24:
+// Channel: consumers are tasks launched when items arrive, producers wait
+// for free space with a sync object instead of blocking a worker.
+
+#define PX_SCHED_IMPLEMENTATION 1
+#include "../px_sched.h"
+#include "common/mem_check.h"
+#include <cassert>
+
+int main(int, char **) {
+  atexit(mem_report);
+  px_sched::Scheduler schd;
+  px_sched::SchedulerParams s_params;
+  s_params.num_threads = 4;
+  s_params.max_running_threads = 4;
+  s_params.mem_callbacks.alloc_fn = mem_check_alloc;
+  s_params.mem_callbacks.free_fn = mem_check_free;
+  schd.init(s_params);
+
+  px_sched::Channel<uint32_t, 8> channel;
+  channel.init(&schd);
+
+  // backpressure: a full channel rejects items, and its space sync object
+  // is released by the next receive
+  for(uint32_t i = 0; i < channel.capacity(); ++i) {
+    bool sent = channel.trySend(i);
+    assert(sent);
+    (void)sent;
+  }
+  assert(!channel.trySend(100));
+  px_sched::Sync space = channel.spaceSync();
+  assert(space.id() != 0);
+  uint32_t item = 0;
+  assert(channel.tryReceive(&item) && item == 0);
+  schd.waitFor(space);
+  assert(channel.spaceSync().id() == 0);
+  assert(channel.trySend(8));
+  for(uint32_t i = 1; i <= channel.capacity(); ++i) {
+    assert(channel.tryReceive(&item) && item == i);
+  }
+  assert(!channel.tryReceive(&item) && channel.size() == 0);
+
+  // producers and consumers, all of them tasks
+  const uint32_t kItems = 20000;
+  const uint32_t kProducers = 4;
+  const uint32_t kConsumers = 3;
+  std::atomic<uint32_t> registered = {0};
+  std::atomic<uint32_t> received = {0};
+  std::atomic<uint64_t> sum = {0};
+  std::atomic<uint32_t> full = {0};
+  px_sched::Sync done;
+
+  std::function<void()> listen;
+  auto consume = [&] {
+    uint32_t v;
+    channel.receive(&v);
+    sum.fetch_add(v);
+    received.fetch_add(1);
+    listen();
+  };
+  listen = [&] {
+    // one receiver per item
+    if (registered.fetch_add(1) < kItems) channel.onReceive(consume, &done);
+  };
+  for(uint32_t i = 0; i < kConsumers; ++i) listen();
+
+  uint32_t next[kProducers];
+  std::function<void(uint32_t)> produce = [&](uint32_t p) {
+    while (next[p] < kItems) {
+      if (!channel.trySend(next[p])) {
+        full.fetch_add(1);
+        schd.runAfter(channel.spaceSync(), [&produce, p] { produce(p); }, &done);
+        return;
+      }
+      next[p] += kProducers;
+    }
+  };
+  for(uint32_t p = 0; p < kProducers; ++p) {
+    next[p] = p;
+    schd.run([&produce, p] { produce(p); }, &done);
+  }
+  schd.waitFor(done);
+
+  printf("Items received %u, sum %llu, producers found the channel full %u times\n",
+      received.load(), static_cast<unsigned long long>(sum.load()), full.load());
+  assert(received.load() == kItems);
+  assert(sum.load() == static_cast<uint64_t>(kItems)*(kItems-1)/2);
+  assert(channel.size() == 0);
+
+  schd.stop();
+  return 0;
+}
@@ -0,0 +1,124 @@
+// Example-25:
+// Benchmark: px_sched::Resource throughput for read-heavy mixes, against a
+// reader/writer scheduler that takes a spinlock on every operation (the
+// previous version of example 7). Operations are submitted from several
+// tasks at once.
+
+#include <mutex>
+
+#define PX_SCHED_IMPLEMENTATION 1
+#include "../px_sched.h"
+#include "common/mem_check.h"
+#include <cassert>
+
+struct State {
+  uint64_t a = 0;
+  uint64_t b = 0;
+  mutable std::atomic<uint32_t> reads = {0};
+};
+
+// reads batched by a spinlock protected state
+template<class T>
+class LockedMRSW {
+public:
+  ~LockedMRSW() { sched_->waitFor(next_); }
+  void init(px_sched::Scheduler *s) { sched_ = s; }
+
+  template<class F>
+  void executeRead(F func) {
+    std::lock_guard<px_sched::Spinlock> g(lock_);
+    if (!read_mode_) {
+      read_mode_ = true;
+      prev_ = next_;
+      next_ = px_sched::Sync();
+    }
+    const T *obj = &obj_;
+    sched_->runAfter(prev_, [obj, func] { func(obj); }, &next_);
+  }
+
+  template<class F>
+  void executeWrite(F func) {
+    std::lock_guard<px_sched::Spinlock> g(lock_);
+    read_mode_ = false;
+    px_sched::Sync new_next;
+    T *obj = &obj_;
+    sched_->runAfter(next_, [obj, func] { func(obj); }, &new_next);
+    next_ = new_next;
+  }
+
+  void finish() { sched_->waitFor(next_); }
+  const T& get() const { return obj_; }
+private:
+  px_sched::Scheduler *sched_ = nullptr;
+  T obj_;
+  px_sched::Sync prev_;
+  px_sched::Sync next_;
+  px_sched::Spinlock lock_;
+  bool read_mode_ = true;
+};
+
+static const uint32_t kSubmitters = 4;
+static const uint32_t kOpsPerSubmitter = 10000;
+
+template<class R>
+static double bench(px_sched::Scheduler &schd, R &resource, uint32_t write_every, const State **out) {
+  typedef px_sched::Scheduler::Clock Clock;
+  Clock::time_point start = Clock::now();
+  px_sched::Sync submitted;
+  for(uint32_t s = 0; s < kSubmitters; ++s) {
+    schd.run([&resource, write_every] {
+      for(uint32_t i = 0; i < kOpsPerSubmitter; ++i) {
+        if (i % write_every == 0) {
+          resource.executeWrite([](State *st) { st->a++; st->b++; });
+        } else {
+          resource.executeRead([](const State *st) {
+            assert(st->a == st->b);
+            st->reads.fetch_add(1, std::memory_order_relaxed);
+          });
+        }
+      }
+    }, &submitted);
+  }
+  schd.waitFor(submitted);
+  resource.executeRead([out](const State *st) { *out = st; });
+  resource.finish();
+  double secs = std::chrono::duration<double>(Clock::now() - start).count();
+  return (kSubmitters*kOpsPerSubmitter)/secs;
+}
+
+int main(int, char **) {
+  atexit(mem_report);
+  px_sched::Scheduler schd;
+  px_sched::SchedulerParams s_params;
+  s_params.num_threads = 4;
+  s_params.max_running_threads = 4;
+  s_params.max_number_tasks = 60000;
+  s_params.mem_callbacks.alloc_fn = mem_check_alloc;
+  s_params.mem_callbacks.free_fn = mem_check_free;
+  schd.init(s_params);
+
+  const uint32_t mixes[] = { 10, 100, 1000 }; // one write every N operations
+  for(uint32_t write_every : mixes) {
+    const uint32_t writes = kSubmitters*((kOpsPerSubmitter + write_every - 1)/write_every);
+    const uint32_t reads = kSubmitters*kOpsPerSubmitter - writes;
+    const State *st = nullptr;
+
+    px_sched::Resource<State> resource;
+    resource.init(&schd);
+    double resource_ops = bench(schd, resource, write_every, &st);
+    assert(st->a == writes && st->b == writes && st->reads.load() == reads);
+
+    LockedMRSW<State> locked;
+    locked.init(&schd);
+    double locked_ops = bench(schd, locked, write_every, &st);
+    assert(st->a == writes && st->b == writes && st->reads.load() == reads);
+
+    printf("1 write every %4u ops: Resource %.2f Mops/s, spinlock MRSW %.2f Mops/s\n",
+        write_every, resource_ops/1e6, locked_ops/1e6);
+    (void)writes;
+    (void)reads;
+  }
+
+  schd.stop();
+  return 0;
+}
@@ -0,0 +1,108 @@
+// Example-26:
+// Benchmark: lock contention from 1 to 64 threads. Every thread takes the
+// lock around a tiny critical section, the table shows nanoseconds per
+// acquisition and the percentage of acquisitions that had to wait.
+
+#include <mutex>
+#include <vector>
+
+#define PX_SCHED_LOCK_STATS 1
+#define PX_SCHED_IMPLEMENTATION 1
+#include "../px_sched.h"
+#include "common/mem_check.h"
+#include <cassert>
+
+typedef std::chrono::steady_clock Clock;
+
+static const uint32_t kTotalOps = 200000;
+static const uint32_t kThreadCounts[] = { 1, 2, 4, 8, 16, 32, 64 };
+
+struct Shared {
+  uint64_t a = 0;
+  uint64_t b = 0;
+};
+
+template<class L> static px_sched::LockStats stats_of(const L &lock) { return lock.stats(); }
+static px_sched::LockStats stats_of(const std::mutex &) { return px_sched::LockStats(); }
+static px_sched::LockStats stats_of(const px_sched::Spinlock &) { return px_sched::LockStats(); }
+
+template<class L> static void lock_read(L &lock) { lock.lock(); }
+template<class L> static void unlock_read(L &lock) { lock.unlock(); }
+static void lock_read(px_sched::RWSpinlock &lock) { lock.lock_shared(); }
+static void unlock_read(px_sched::RWSpinlock &lock) { lock.unlock_shared(); }
+
+// one out of write_every operations is a write, the rest are reads (only
+// different for RWSpinlock)
+template<class L>
+static void bench(const char *name, uint32_t write_every = 1) {
+  printf("%-22s", name);
+  for(uint32_t threads : kThreadCounts) {
+    L lock;
+    Shared shared;
+    std::atomic<bool> go = {false};
+    std::vector<std::thread> workers;
+    const uint32_t ops = kTotalOps/threads;
+    for(uint32_t t = 0; t < threads; ++t) {
+      workers.emplace_back([&] {
+        while (!go.load()) std::this_thread::yield();
+        for(uint32_t i = 0; i < ops; ++i) {
+          if (i % write_every == 0) {
+            lock.lock();
+            shared.a++;
+            shared.b++;
+            lock.unlock();
+          } else {
+            lock_read(lock);
+            assert(shared.a == shared.b);
+            unlock_read(lock);
+          }
+        }
+      });
+    }
+    Clock::time_point start = Clock::now();
+    go.store(true);
+    for(std::thread &w : workers) w.join();
+    double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    assert(shared.a == shared.b && shared.a == threads*((ops + write_every - 1)/write_every));
+    px_sched::LockStats st = stats_of(lock);
+    if (st.acquisitions) {
+      printf(" %7.1f(%3.0f%%)", ns/(ops*threads), 100.0*st.contended/st.acquisitions);
+    } else {
+      printf(" %12.1f", ns/(ops*threads));
+    }
+  }
+  printf("\n");
+}
+
+int main(int, char **) {
+  atexit(mem_report);
+
+  // single thread sanity checks
+  px_sched::TicketLock ticket;
+  assert(ticket.try_lock() && !ticket.try_lock());
+  ticket.unlock();
+  px_sched::MCSLock mcs;
+  assert(mcs.try_lock() && !mcs.try_lock());
+  mcs.unlock();
+  px_sched::RWSpinlock rw;
+  assert(rw.try_lock_shared() && rw.try_lock_shared() && !rw.try_lock());
+  rw.unlock_shared();
+  rw.unlock_shared();
+  assert(rw.try_lock() && !rw.try_lock_shared());
+  rw.unlock();
+
+  printf("%-22s", "ns per op (contended)");
+  for(uint32_t threads : kThreadCounts) printf(" %8u thr.", threads);
+  printf("\n");
+  bench<std::mutex>("std::mutex");
+#if PX_SCHED_IMP_REGULAR_THREADS
+  // (on single threaded mode its owner is not atomic, it is not thread safe)
+  bench<px_sched::Spinlock>("Spinlock");
+#endif
+  bench<px_sched::TTASLock>("TTASLock");
+  bench<px_sched::TicketLock>("TicketLock");
+  bench<px_sched::MCSLock>("MCSLock");
+  bench<px_sched::RWSpinlock>("RWSpinlock");
+  bench<px_sched::RWSpinlock>("RWSpinlock 90% reads", 10);
+  return 0;
+}
@@ -0,0 +1,164 @@
+// Example-27:
+// Dataflow: dependencies inferred from the data every task reads and
+// writes. A small frame graph is checked for ordering, and timed against
+// running the same tasks one after another.
+
+#define PX_SCHED_IMPLEMENTATION 1
+#include "../px_sched.h"
+#include "../px_sched_dataflow.h"
+#include "common/mem_check.h"
+#include <cassert>
+
+typedef std::chrono::steady_clock Clock;
+
+struct Event {
+  std::atomic<uint32_t> start = {0};
+  std::atomic<uint32_t> end = {0};
+};
+
+// both tasks of a pair wait (up to a limit) until the other one is running
+struct Meet {
+  std::atomic<uint32_t> arrived = {0};
+  std::atomic<bool> met = {false};
+};
+
+int main(int, char **) {
+  atexit(mem_report);
+  px_sched::Scheduler schd;
+  px_sched::SchedulerParams s_params;
+  s_params.num_threads = 4;
+  s_params.max_running_threads = 4;
+  s_params.mem_callbacks.alloc_fn = mem_check_alloc;
+  s_params.mem_callbacks.free_fn = mem_check_free;
+  schd.init(s_params);
+
+  px_sched::Dataflow df;
+  df.init(&schd);
+
+  // frame graph: input -> (physics, animation) -> draw, and next frame
+  // input written while draw still runs
+  int input = 0, bodies = 0, skeletons = 0, draw_list = 0;
+  std::atomic<uint32_t> clock = {1};
+  Event ev[5];
+  Meet physics_animation, draw_input;
+  auto work = [&](Event *e, Meet *m) {
+    return [&clock, e, m] {
+      e->start.store(clock.fetch_add(1));
+#if PX_SCHED_IMP_REGULAR_THREADS
+      if (m) {
+        m->arrived.fetch_add(1);
+        const Clock::time_point limit = Clock::now() + std::chrono::seconds(5);
+        while (m->arrived.load() < 2 && Clock::now() < limit) std::this_thread::yield();
+        if (m->arrived.load() == 2) m->met.store(true);
+      }
+#else
+      (void)m;
+#endif
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      e->end.store(clock.fetch_add(1));
+    };
+  };
+
+  Clock::time_point start = Clock::now();
+  df.task(work(&ev[0], nullptr)).writes(&input).submit();                       // read input
+  df.task(work(&ev[1], &physics_animation)).reads(&input).writes(&bodies).submit();    // physics
+  df.task(work(&ev[2], &physics_animation)).reads(&input).writes(&skeletons).submit(); // animation
+  df.task(work(&ev[3], &draw_input)).reads(&bodies).reads(&skeletons).writes(&draw_list).submit(); // draw
+  df.task(work(&ev[4], &draw_input)).writes(&input).submit();                   // next input
+  df.waitAll();
+  double dataflow_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+  assert(ev[0].end < ev[1].start && ev[0].end < ev[2].start);
+  assert(ev[1].end < ev[3].start && ev[2].end < ev[3].start);
+  // the next input waits for the readers of the previous one, not for draw
+  assert(ev[1].end < ev[4].start && ev[2].end < ev[4].start);
+  bool physics_with_animation = physics_animation.met.load();
+  bool draw_with_input = draw_input.met.load();
+
+  // same tasks, one after another (what a conservative chain of syncs does)
+  start = Clock::now();
+  px_sched::Sync chain;
+  Event serial[5];
+  for(int i = 0; i < 5; ++i) {
+    px_sched::Sync next;
+    schd.runAfter(chain, work(&serial[i], nullptr), &next);
+    chain = next;
+  }
+  schd.waitFor(chain);
+  double serial_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+  printf("Dataflow %.1f ms (physics along animation: %s, draw along next input: %s), serial chain %.1f ms\n",
+      dataflow_ms, physics_with_animation? "yes" : "no", draw_with_input? "yes" : "no", serial_ms);
+#if PX_SCHED_IMP_REGULAR_THREADS
+  assert(physics_with_animation && draw_with_input);
+#endif
+
+  // many readers of one datum, then a writer that must wait for all of them
+  const uint32_t kReaders = 64;
+  std::atomic<uint32_t> reads_done = {0};
+  uint32_t seen_by_writer = 0;
+  int shared = 0;
+  for(uint32_t i = 0; i < kReaders; ++i) {
+    df.task([&reads_done] { reads_done.fetch_add(1); }).reads(&shared).submit();
+  }
+  px_sched::Sync written;
+  df.task([&] { seen_by_writer = reads_done.load(); }).writes(&shared).submit(&written);
+  schd.waitFor(written);
+  assert(seen_by_writer == kReaders);
+  df.waitAll();
+
+  (void)input; (void)bodies; (void)skeletons; (void)draw_list; (void)shared;
+  schd.stop();
+
+  // few task slots (max_tasks): submit waits and helps, as run does
+  {
+    px_sched::SchedulerParams p = s_params;
+    p.overflow_policy = px_sched::OverflowPolicy::WaitAndHelp;
+    schd.init(p);
+    px_sched::Dataflow small;
+    px_sched::DataflowParams df_params;
+    df_params.max_tasks = 4;
+    small.init(&schd, df_params);
+    int a = 0, b = 0;
+    std::atomic<uint32_t> checked = {0};
+    for(int i = 0; i < 100; ++i) {
+      assert(small.task([&a] { a++; }).writes(&a).submit());
+      assert(small.task([&b] { b++; }).writes(&b).submit());
+      assert(small.task([&a, &b, &checked, i] {
+        assert(a == i+1 && b == i+1);
+        checked.fetch_add(1);
+      }).reads(&a).reads(&b).submit());
+    }
+    small.waitAll();
+    assert(checked.load() == 100);
+    printf("Dataflow with 4 task slots: %u tasks checked\n", checked.load());
+    schd.stop();
+  }
+
+#if PX_SCHED_IMP_REGULAR_THREADS
+  // Fail: submit returns false once the slots are taken
+  {
+    px_sched::SchedulerParams p = s_params;
+    p.overflow_policy = px_sched::OverflowPolicy::Fail;
+    schd.init(p);
+    px_sched::Dataflow small;
+    px_sched::DataflowParams df_params;
+    df_params.max_tasks = 2;
+    small.init(&schd, df_params);
+    std::atomic<bool> release = {false};
+    int a = 0, b = 0;
+    auto wait_release = [&release] { while (!release.load()) std::this_thread::yield(); };
+    assert(small.task(wait_release).writes(&a).submit());
+    assert(small.task(wait_release).writes(&b).submit());
+    assert(!small.task([] { abort(); }).reads(&a).submit());
+    release.store(true);
+    small.waitAll();
+    px_sched::Sync done;
+    assert(small.task([] {}).reads(&a).submit(&done));
+    schd.waitFor(done);
+    small.waitAll();
+    schd.stop();
+  }
+#endif
+  return 0;
+}
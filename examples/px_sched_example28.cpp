@@ -0,0 +1,136 @@
+// Example-28:
+// Earliest deadline first: with ReadyOrder::EarliestDeadline workers take
+// the ready task with the earliest deadline, and deadline misses are
+// counted per label. Frames on an oversubscribed pool, FIFO vs EDF.
+
+#define PX_SCHED_IMPLEMENTATION 1
+#define PX_SCHED_TASK_LABELS 1
+#include "../px_sched.h"
+#include "common/mem_check.h"
+#include <cassert>
+#include <vector>
+
+typedef px_sched::Scheduler::Clock Clock;
+
+static void work(uint32_t us) {
+  std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+static void printStats(px_sched::Scheduler &schd, const char *title) {
+  px_sched::Scheduler::DeadlineStats stats[px_sched::Scheduler::kMaxDeadlineLabels];
+  uint32_t n = schd.getDeadlineStats(stats, px_sched::Scheduler::kMaxDeadlineLabels);
+  printf("%s\n", title);
+  for(uint32_t i = 0; i < n; ++i) {
+    double worst = std::chrono::duration<double, std::milli>(stats[i].worst_lateness).count();
+    printf("  %-10s completed %3u missed %3u worst lateness %6.2f ms\n",
+        stats[i].label? stats[i].label : "(none)", stats[i].completed, stats[i].missed, worst);
+  }
+}
+
+static uint32_t missed(px_sched::Scheduler &schd, const char *label) {
+  px_sched::Scheduler::DeadlineStats stats[px_sched::Scheduler::kMaxDeadlineLabels];
+  uint32_t n = schd.getDeadlineStats(stats, px_sched::Scheduler::kMaxDeadlineLabels);
+  for(uint32_t i = 0; i < n; ++i) {
+    if (stats[i].label && strcmp(stats[i].label, label) == 0) return stats[i].missed;
+  }
+  return 0;
+}
+
+// every frame launches the background work first, then physics (8 ms) and
+// audio (5 ms), there are ~9 ms of work for two running threads
+static void frames(px_sched::Scheduler &schd, int num_frames) {
+  const uint32_t kBackground = 12, kPhysics = 4, kAudio = 2;
+  for(int f = 0; f < num_frames; ++f) {
+    const Clock::time_point start = Clock::now();
+    px_sched::Sync frame;
+    for(uint32_t i = 0; i < kBackground; ++i) {
+      schd.runWithDeadline(start + std::chrono::milliseconds(16), [] { work(1000); }, &frame, "background");
+    }
+    for(uint32_t i = 0; i < kPhysics; ++i) {
+      schd.runWithDeadline(start + std::chrono::milliseconds(8), [] { work(1000); }, &frame, "physics");
+    }
+    for(uint32_t i = 0; i < kAudio; ++i) {
+      schd.runWithDeadline(start + std::chrono::milliseconds(5), [] { work(500); }, &frame, "audio");
+    }
+    schd.waitFor(frame);
+  }
+}
+
+int main(int, char **) {
+  atexit(mem_report);
+  px_sched::SchedulerParams s_params;
+  s_params.mem_callbacks.alloc_fn = mem_check_alloc;
+  s_params.mem_callbacks.free_fn = mem_check_free;
+
+#if PX_SCHED_IMP_REGULAR_THREADS
+  { // the order of the ready tasks, the only worker is kept busy meanwhile
+    px_sched::Scheduler schd;
+    px_sched::SchedulerParams p = s_params;
+    p.num_threads = 1;
+    p.max_running_threads = 1;
+    p.ready_order = px_sched::ReadyOrder::EarliestDeadline;
+    schd.init(p);
+    std::atomic<bool> open = {false};
+    std::atomic<bool> blocked = {false};
+    px_sched::Sync done;
+    schd.run([&] {
+      blocked.store(true);
+      while (!open.load()) std::this_thread::yield();
+    }, &done);
+    while (!blocked.load()) std::this_thread::yield();
+
+    std::vector<int> order;
+    const Clock::time_point t0 = Clock::now() + std::chrono::seconds(1);
+    auto push = [&order](int v) { return [&order, v] { order.push_back(v); }; };
+    px_sched::Sync trigger;
+    schd.incrementSync(&trigger);
+    schd.run(push(7), &done);                                                  // no deadline
+    schd.runWithDeadline(t0 + std::chrono::milliseconds(30), push(4), &done);
+    schd.runAfterWithDeadline(trigger, t0 + std::chrono::milliseconds(10), push(2), &done);
+    schd.runWithDeadline(t0 + std::chrono::milliseconds(10), push(1), &done);
+    schd.runWithDeadline(t0 + std::chrono::milliseconds(20), push(3), &done);
+    schd.run(push(8), &done);                                                  // no deadline
+    schd.runAfterWithDeadline(trigger, t0 + std::chrono::milliseconds(40), push(6), &done);
+    schd.runWithDeadline(t0 + std::chrono::milliseconds(30), push(5), &done);
+    schd.decrementSync(&trigger);
+    open.store(true);
+    schd.waitFor(done);
+    printf("Execution order:");
+    for(size_t i = 0; i < order.size(); ++i) printf(" %d", order[i]);
+    printf("\n");
+    // equal deadlines keep the order in which they became ready
+    const int expected[] = {1, 2, 3, 4, 5, 6, 7, 8};
+    assert(order.size() == 8);
+    for(size_t i = 0; i < order.size(); ++i) assert(order[i] == expected[i]);
+    (void)expected;
+    schd.stop();
+  }
+#endif
+
+  const int kFrames = 10;
+  uint32_t fifo_audio = 0, edf_audio = 0;
+  for(int edf = 0; edf < 2; ++edf) {
+    px_sched::Scheduler schd;
+    px_sched::SchedulerParams p = s_params;
+    p.num_threads = 4;
+    p.max_running_threads = 2;
+    p.ready_order = edf? px_sched::ReadyOrder::EarliestDeadline : px_sched::ReadyOrder::FIFO;
+    schd.init(p);
+    frames(schd, kFrames);
+    printStats(schd, edf? "EarliestDeadline" : "FIFO");
+    (edf? edf_audio : fifo_audio) = missed(schd, "audio");
+
+    px_sched::Scheduler::DeadlineStats stats[px_sched::Scheduler::kMaxDeadlineLabels];
+    uint32_t n = schd.getDeadlineStats(stats, px_sched::Scheduler::kMaxDeadlineLabels);
+    uint32_t completed = 0;
+    for(uint32_t i = 0; i < n; ++i) completed += stats[i].completed;
+    assert(n == 3);
+    assert(completed == kFrames*18u);
+    schd.resetDeadlineStats();
+    assert(schd.getDeadlineStats(stats, 0) == 0);
+    (void)completed;
+    schd.stop();
+  }
+  printf("Audio deadlines missed: FIFO %u, EDF %u\n", fifo_audio, edf_audio);
+  return 0;
+}
@@ -0,0 +1,105 @@
+// Example-29:
+// Several threads waiting for the same sync object, waits with a timeout
+// and tryWait.
+
+#define PX_SCHED_IMPLEMENTATION 1
+#include "../px_sched.h"
+#include "common/mem_check.h"
+#include <cassert>
+#include <vector>
+
+typedef px_sched::Scheduler::Clock Clock;
+
+int main(int, char **) {
+  atexit(mem_report);
+  px_sched::Scheduler schd;
+  px_sched::SchedulerParams s_params;
+  s_params.num_threads = 4;
+  s_params.max_running_threads = 4;
+  s_params.timer_resolution_in_microseconds = 500;
+  s_params.mem_callbacks.alloc_fn = mem_check_alloc;
+  s_params.mem_callbacks.free_fn = mem_check_free;
+  schd.init(s_params);
+
+  // a timer releases the sync object, waits shorter than that time out
+  px_sched::Sync timer_done;
+  schd.runAfterDelay(std::chrono::milliseconds(20), [] {}, &timer_done);
+  assert(!schd.tryWait(timer_done));
+  Clock::time_point start = Clock::now();
+  bool finished = schd.waitFor(timer_done, std::chrono::milliseconds(2));
+  double waited = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+  printf("Short wait: finished %d after %.2f ms\n", finished, waited);
+  assert(!finished && waited >= 2.0);
+  finished = schd.waitFor(timer_done, std::chrono::seconds(5));
+  printf("Long wait: finished %d\n", finished);
+  assert(finished && schd.tryWait(timer_done));
+  // empty and already released sync objects never block
+  assert(schd.tryWait(px_sched::Sync()));
+  assert(schd.waitFor(timer_done, Clock::duration::zero()));
+  (void)waited;
+
+#if PX_SCHED_IMP_REGULAR_THREADS
+  { // render and audio threads (and a task) waiting for the same frame, the
+    // timed waiters give up first and leave the others in the list
+    const uint32_t kWaiters = 4, kTimed = 3;
+    px_sched::Sync frame;
+    schd.incrementSync(&frame);
+    std::atomic<uint32_t> released = {0};
+    std::atomic<uint32_t> timed_out = {0};
+    std::vector<std::thread> threads;
+    for(uint32_t i = 0; i < kWaiters; ++i) {
+      threads.push_back(std::thread([&] {
+        schd.waitFor(frame);
+        assert(schd.hasFinished(frame));
+        released.fetch_add(1);
+      }));
+    }
+    for(uint32_t i = 0; i < kTimed; ++i) {
+      threads.push_back(std::thread([&] {
+        if (!schd.waitFor(frame, std::chrono::milliseconds(5))) timed_out.fetch_add(1);
+      }));
+    }
+    px_sched::Sync task_waiter;
+    schd.run([&] {
+      schd.waitFor(frame);
+      released.fetch_add(1);
+    }, &task_waiter);
+    for(uint32_t i = kWaiters; i < threads.size(); ++i) threads[i].join();
+    assert(released.load() == 0);
+    schd.decrementSync(&frame);
+    for(uint32_t i = 0; i < kWaiters; ++i) threads[i].join();
+    schd.waitFor(task_waiter);
+    printf("Waiters released %u, timed out %u\n", released.load(), timed_out.load());
+    assert(released.load() == kWaiters + 1);
+    assert(timed_out.load() == kTimed);
+  }
+
+  { // timeouts racing with the release
+    const int kRounds = 300;
+    uint32_t results[2] = {0, 0};
+    for(int r = 0; r < kRounds; ++r) {
+      px_sched::Sync s;
+      const uint32_t us = static_cast<uint32_t>((r*37)%200);
+      schd.run([us] { std::this_thread::sleep_for(std::chrono::microseconds(us)); }, &s);
+      std::atomic<uint32_t> done[2] = {{0}, {0}};
+      std::thread other([&] {
+        bool f = schd.waitFor(s, std::chrono::microseconds(100));
+        assert(!f || schd.hasFinished(s));
+        done[f].fetch_add(1);
+      });
+      bool f = schd.waitFor(s, std::chrono::microseconds(100));
+      assert(!f || schd.hasFinished(s));
+      done[f].fetch_add(1);
+      schd.waitFor(s);
+      other.join();
+      results[0] += done[0].load();
+      results[1] += done[1].load();
+    }
+    printf("Racing waits: %u finished, %u timed out\n", results[1], results[0]);
+    assert(results[0] + results[1] == 2*kRounds);
+  }
+#endif
+
+  schd.stop();
+  return 0;
+}
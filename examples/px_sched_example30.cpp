@@ -0,0 +1,62 @@
+// Example-30:
+// Benchmark: a long chain of tasks, each one launched after the previous.
+// The successor released by a task runs next on the same worker, without
+// going through the ready queue (or waking up another worker).
+
+#define PX_SCHED_IMPLEMENTATION 1
+#include "../px_sched.h"
+#include "common/mem_check.h"
+#include <cassert>
+#include <vector>
+
+int main(int, char **) {
+  atexit(mem_report);
+#if PX_SCHED_IMP_REGULAR_THREADS
+  const uint32_t kLinks = 16000;
+#else
+  // single threaded mode runs the chain recursively (each task inside the
+  // release of the previous one)
+  const uint32_t kLinks = 1000;
+#endif
+  px_sched::Scheduler schd;
+  px_sched::SchedulerParams s_params;
+  s_params.num_threads = 4;
+  s_params.max_running_threads = 4;
+  s_params.max_number_tasks = kLinks + 64;
+  s_params.mem_callbacks.alloc_fn = mem_check_alloc;
+  s_params.mem_callbacks.free_fn = mem_check_free;
+  schd.init(s_params);
+
+  typedef px_sched::Scheduler::Clock Clock;
+  std::vector<const char*> ran_on(kLinks);
+  std::vector<px_sched::Sync> links(kLinks);
+  uint32_t value = 0;
+  px_sched::Sync start;
+  schd.incrementSync(&start);
+  for(uint32_t i = 0; i < kLinks; ++i) {
+    // tasks of the chain never run at the same time, no need for atomics
+    schd.runAfter(i? links[i-1] : start, [i, &value, &ran_on] {
+      assert(value == i);
+      value++;
+      ran_on[i] = px_sched::Scheduler::current_thread_name();
+    }, &links[i]);
+  }
+  Clock::time_point t0 = Clock::now();
+  schd.decrementSync(&start);
+  schd.waitFor(links[kLinks-1]);
+  double ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - t0).count());
+  assert(value == kLinks);
+
+  uint32_t switches = 0;
+  for(uint32_t i = 1; i < kLinks; ++i) {
+    if (ran_on[i] != ran_on[i-1]) switches++;
+  }
+  printf("Chain of %u tasks: %.1f ns per link, %u worker switches\n", kLinks, ns/kLinks, switches);
+#if PX_SCHED_IMP_REGULAR_THREADS
+  // only the links that go through the ready queue can change of worker
+  assert(switches <= kLinks/px_sched::Scheduler::kMaxContinuations + 1);
+#endif
+
+  schd.stop();
+  return 0;
+}
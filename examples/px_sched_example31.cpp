@@ -0,0 +1,182 @@
+// Example-31:
+// Locality hints: the second pass over a chunk runs on the worker that ran
+// the first pass, unless that worker keeps it waiting for too long.
+
+#define PX_SCHED_IMPLEMENTATION 1
+#include "../px_sched.h"
+#include "common/mem_check.h"
+#include <cassert>
+#include <vector>
+
+typedef px_sched::Scheduler::Clock Clock;
+
+int main(int, char **) {
+  atexit(mem_report);
+  px_sched::Scheduler schd;
+  px_sched::SchedulerParams s_params;
+  s_params.num_threads = 4;
+  s_params.max_running_threads = 4;
+  s_params.max_local_tasks = 64;
+  s_params.local_steal_after_in_microseconds = 20000;
+  s_params.mem_callbacks.alloc_fn = mem_check_alloc;
+  s_params.mem_callbacks.free_fn = mem_check_free;
+  schd.init(s_params);
+
+  assert(px_sched::Scheduler::current_worker_index() == px_sched::Scheduler::kNoWorker);
+
+  // two passes over every chunk, the second one hinted to the worker of the
+  // first one
+  const uint32_t kChunks = 64;
+  std::vector<uint16_t> first(kChunks), second(kChunks);
+  std::vector<uint32_t> data(kChunks*1024, 1);
+  px_sched::Sync pass1;
+  for(uint32_t c = 0; c < kChunks; ++c) {
+    schd.run([c, &first, &data] {
+      for(uint32_t i = 0; i < 1024; ++i) data[c*1024+i] *= 3;
+      first[c] = px_sched::Scheduler::current_worker_index();
+    }, &pass1);
+  }
+  schd.waitFor(pass1);
+  px_sched::Sync pass2;
+  for(uint32_t c = 0; c < kChunks; ++c) {
+    schd.run([c, &second, &data] {
+      for(uint32_t i = 0; i < 1024; ++i) data[c*1024+i] += 1;
+      second[c] = px_sched::Scheduler::current_worker_index();
+    }, &pass2, nullptr, first[c]);
+  }
+  schd.waitFor(pass2);
+  uint32_t same = 0;
+  for(uint32_t c = 0; c < kChunks; ++c) {
+    if (first[c] == second[c]) same++;
+    assert(data[c*1024] == 4);
+  }
+  printf("Second pass on the worker of the first pass: %u of %u chunks\n", same, kChunks);
+#if PX_SCHED_IMP_REGULAR_THREADS
+  for(uint32_t c = 0; c < kChunks; ++c) assert(first[c] < s_params.num_threads);
+  // most of them: a worker kept busy (or asleep) for longer than the steal
+  // timeout loses its chunks to the others
+  assert(same >= kChunks/2);
+#else
+  assert(first[0] == px_sched::Scheduler::kNoWorker);
+#endif
+  (void)same;
+  schd.stop();
+
+#if PX_SCHED_IMP_REGULAR_THREADS
+  { // the hinted worker is busy, other workers take its tasks after a while
+    px_sched::SchedulerParams p = s_params;
+    p.local_steal_after_in_microseconds = 1000;
+    schd.init(p);
+    std::atomic<uint16_t> busy_worker = {px_sched::Scheduler::kNoWorker};
+    std::atomic<bool> release = {false};
+    px_sched::Sync blocker;
+    schd.run([&] {
+      busy_worker.store(px_sched::Scheduler::current_worker_index());
+      const Clock::time_point limit = Clock::now() + std::chrono::seconds(5);
+      while (!release.load() && Clock::now() < limit) {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+      }
+    }, &blocker);
+    while (busy_worker.load() == px_sched::Scheduler::kNoWorker) std::this_thread::yield();
+
+    const uint32_t kTasks = 16;
+    std::atomic<uint32_t> stolen = {0};
+    px_sched::Sync hinted;
+    Clock::time_point start = Clock::now();
+    for(uint32_t i = 0; i < kTasks; ++i) {
+      schd.run([&] {
+        if (px_sched::Scheduler::current_worker_index() != busy_worker.load()) stolen.fetch_add(1);
+      }, &hinted, nullptr, busy_worker.load());
+    }
+    schd.waitFor(hinted);
+    double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    printf("Tasks hinted to a busy worker: %u of %u taken by others in %.2f ms\n", stolen.load(), kTasks, ms);
+    assert(stolen.load() == kTasks);
+    release.store(true);
+    schd.waitFor(blocker);
+    (void)ms;
+    schd.stop();
+  }
+
+  { // same, with the task hinted from a worker of another scheduler that
+    // has the busy worker's index
+    px_sched::SchedulerParams p = s_params;
+    p.local_steal_after_in_microseconds = 1000;
+    schd.init(p);
+    px_sched::Scheduler other;
+    other.init(s_params);
+    std::atomic<uint16_t> busy_worker = {px_sched::Scheduler::kNoWorker};
+    std::atomic<bool> release = {false};
+    px_sched::Sync blocker;
+    schd.run([&] {
+      busy_worker.store(px_sched::Scheduler::current_worker_index());
+      const Clock::time_point limit = Clock::now() + std::chrono::seconds(5);
+      while (!release.load() && Clock::now() < limit) {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+      }
+    }, &blocker);
+    while (busy_worker.load() == px_sched::Scheduler::kNoWorker) std::this_thread::yield();
+
+    std::atomic<uint16_t> ran_on = {px_sched::Scheduler::kNoWorker};
+    px_sched::Sync hinted, submitted;
+    other.run([&] {
+      schd.run([&] { ran_on.store(px_sched::Scheduler::current_worker_index()); }, &hinted, nullptr, busy_worker.load());
+    }, &submitted, nullptr, busy_worker.load());
+    other.waitFor(submitted);
+    schd.waitFor(hinted);
+    printf("Task hinted from another scheduler's worker %u: ran on worker %u\n",
+        static_cast<unsigned>(busy_worker.load()), static_cast<unsigned>(ran_on.load()));
+    assert(ran_on.load() != busy_worker.load());
+    release.store(true);
+    schd.waitFor(blocker);
+    other.stop();
+    schd.stop();
+  }
+
+  { // threads helping while the pool is full take hinted tasks too
+    px_sched::SchedulerParams p = s_params;
+    p.num_threads = 1;
+    p.max_running_threads = 1;
+    p.max_number_tasks = 4;
+    p.overflow_policy = px_sched::OverflowPolicy::WaitAndHelp;
+    p.local_steal_after_in_microseconds = 1000;
+    schd.init(p);
+    std::atomic<bool> started = {false};
+    std::atomic<bool> release = {false};
+    px_sched::Sync blocker;
+    schd.run([&] {
+      started.store(true);
+      while (!release.load()) std::this_thread::yield();
+    }, &blocker);
+    while (!started.load()) std::this_thread::yield();
+    std::atomic<uint32_t> helped = {0};
+    px_sched::Sync hinted;
+    for(uint32_t i = 0; i < 16; ++i) {
+      schd.run([&helped] {
+        if (px_sched::Scheduler::current_worker_index() == px_sched::Scheduler::kNoWorker) helped.fetch_add(1);
+      }, &hinted, nullptr, 0);
+    }
+    printf("Hinted tasks run by the submitting thread: %u of 16\n", helped.load());
+    assert(helped.load() > 0);
+    release.store(true);
+    schd.waitFor(hinted);
+    schd.waitFor(blocker);
+    schd.stop();
+  }
+
+  { // without local queues (max_local_tasks = 0) hints are ignored
+    px_sched::SchedulerParams p = s_params;
+    p.max_local_tasks = 0;
+    schd.init(p);
+    std::atomic<uint32_t> count = {0};
+    px_sched::Sync s;
+    for(uint16_t i = 0; i < 16; ++i) {
+      schd.run([&count] { count.fetch_add(1); }, &s, nullptr, static_cast<uint16_t>(i % p.num_threads));
+    }
+    schd.waitFor(s);
+    assert(count.load() == 16);
+    schd.stop();
+  }
+#endif
+  return 0;
+}
@@ -0,0 +1,118 @@
+// Example-32:
+// StaticScheduler: pools, queues and workers sized at compile time and kept
+// inside the object, nothing is allocated. The same code runs on both.
+
+#define PX_SCHED_IMPLEMENTATION 1
+#include "../px_sched.h"
+#include "common/mem_check.h"
+#include <cassert>
+
+typedef px_sched::Scheduler::Clock Clock;
+
+// fan out, fan in, a lane and a timer
+static uint32_t workload(px_sched::Scheduler &schd) {
+  std::atomic<uint32_t> count = {0};
+  px_sched::Sync stage1, stage2, done;
+  for(int i = 0; i < 64; ++i) {
+    schd.run([&count] { count.fetch_add(1); }, &stage1);
+  }
+  for(int i = 0; i < 64; ++i) {
+    schd.runAfter(stage1, [&count] { count.fetch_add(2); }, &stage2);
+  }
+  px_sched::Lane lane;
+  lane.init(&schd, 1);
+  uint32_t serial = 0;
+  for(int i = 0; i < 16; ++i) {
+    lane.runAfter(stage2, [&serial] { serial++; }, &done);
+  }
+  schd.runAfterDelay(std::chrono::milliseconds(1), [&count] { count.fetch_add(1000); }, &done);
+  schd.waitFor(done);
+  return count.load() + serial;
+}
+
+int main(int, char **) {
+  atexit(mem_report);
+  px_sched::SchedulerParams s_params;
+  s_params.max_running_threads = 4;
+  s_params.mem_callbacks.alloc_fn = mem_check_alloc;
+  s_params.mem_callbacks.free_fn = mem_check_free;
+
+  {
+    static px_sched::StaticScheduler<256, 128, 4, 16> schd;
+    schd.init(s_params);
+    assert(schd.params().num_threads == 4);
+    assert(schd.params().max_number_tasks == 256);
+    uint32_t r = workload(schd);
+    printf("StaticScheduler: result %u, %zu bytes, allocated %zu bytes\n", r, sizeof(schd), GLOBAL_amount_alloc);
+    assert(r == 64 + 128 + 1000 + 16);
+    // the mem callbacks were never called
+    assert(GLOBAL_amount_alloc == 0);
+    // it can be initialized again
+    schd.init(s_params);
+    assert(workload(schd) == r);
+    assert(GLOBAL_amount_alloc == 0);
+    // stall reports use scratch reserved in the object too
+    px_sched::Sync held, waiting;
+    schd.incrementSync(&held);
+    schd.runAfter(held, [] {}, &waiting);
+    px_sched::StallReport report;
+    schd.getStallReport(&report);
+    assert(report.num_orphans == 1);
+    assert(GLOBAL_amount_alloc == 0);
+    schd.decrementSync(&held);
+    schd.waitFor(waiting);
+    schd.stop();
+    (void)r;
+  }
+
+  { // the ready order is part of the type, the storage only has its queue
+    typedef px_sched::StaticScheduler<256, 128, 4, 16, px_sched::ReadyOrder::EarliestDeadline> EDFScheduler;
+    static EDFScheduler schd;
+    schd.init(s_params);
+    assert(schd.params().ready_order == px_sched::ReadyOrder::EarliestDeadline);
+    assert(workload(schd) == 64 + 128 + 1000 + 16);
+    assert(GLOBAL_amount_alloc == 0);
+    schd.stop();
+    const size_t fifo = px_sched::Scheduler::storageSize(256, 128, 4, 16);
+    const size_t edf = px_sched::Scheduler::storageSize(256, 128, 4, 16, px_sched::ReadyOrder::EarliestDeadline);
+    printf("Storage: %zu bytes FIFO, %zu bytes EarliestDeadline\n", fifo, edf);
+#if PX_SCHED_IMP_REGULAR_THREADS
+    assert(fifo < edf);
+#endif
+    (void)fifo; (void)edf;
+  }
+
+  {
+    px_sched::Scheduler schd;
+    s_params.num_threads = 4;
+    schd.init(s_params);
+    uint32_t r = workload(schd);
+    printf("Scheduler: result %u, allocated %zu bytes\n", r, GLOBAL_amount_alloc);
+    assert(r == 64 + 128 + 1000 + 16);
+    assert(GLOBAL_amount_alloc > 0);
+    schd.stop();
+    (void)r;
+  }
+
+  // cost of run() with power of two (static) and runtime sizes
+  const int kTasks = 4000;
+  double ns[2];
+  for(int variant = 0; variant < 2; ++variant) {
+    static px_sched::StaticScheduler<4096, 4096, 4> static_schd;
+    px_sched::Scheduler dynamic_schd;
+    px_sched::Scheduler &schd = variant? dynamic_schd : static_cast<px_sched::Scheduler&>(static_schd);
+    px_sched::SchedulerParams p = s_params;
+    p.max_number_tasks = 4096;
+    if (variant) dynamic_schd.init(p); else static_schd.init(p);
+    std::atomic<uint32_t> count = {0};
+    px_sched::Sync s;
+    Clock::time_point start = Clock::now();
+    for(int i = 0; i < kTasks; ++i) schd.run([&count] { count.fetch_add(1); }, &s);
+    schd.waitFor(s);
+    ns[variant] = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count())/kTasks;
+    assert(count.load() == static_cast<uint32_t>(kTasks));
+    schd.stop();
+  }
+  printf("Per task: StaticScheduler %.1f ns, Scheduler %.1f ns\n", ns[0], ns[1]);
+  return 0;
+}
@@ -0,0 +1,198 @@
+// Example-33:
+// Sender/receiver adapter (px_sched_execution.h, C++17): schedule(), sync
+// objects as senders and bulk, driven here by plain receivers. Operation
+// states do not allocate.
+
+#define PX_SCHED_IMPLEMENTATION 1
+#include "../px_sched.h"
+#include "../px_sched_algorithms.h"
+#include "../px_sched_execution.h"
+#include "common/mem_check.h"
+#include <cassert>
+#include <cstdlib>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// every operator new is counted, to check that operation states and the
+// tasks they launch do not allocate
+static std::atomic<uint32_t> GLOBAL_num_new = {0};
+void* operator new(size_t size) {
+  GLOBAL_num_new.fetch_add(1);
+  void *ptr = malloc(size? size : 1);
+  if (!ptr) throw std::bad_alloc();
+  return ptr;
+}
+void operator delete(void *ptr) noexcept { free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { free(ptr); }
+
+// completion of an operation, waited for by the main thread
+struct Result {
+  std::atomic<int> state = {0}; // 0 pending, 1 value, 2 stopped, 3 error
+  uint16_t worker = px_sched::Scheduler::kNoWorker;
+  std::exception_ptr error;
+  int error_code = 0;
+  // tryWait services the timers, in single threaded mode nobody else does
+  int wait(px_sched::Scheduler &schd) {
+    while (state.load() == 0) {
+      schd.tryWait(px_sched::Sync());
+      std::this_thread::yield();
+    }
+    return state.load();
+  }
+};
+
+struct Receiver {
+  Result *result;
+  void set_value() && noexcept {
+    result->worker = px_sched::Scheduler::current_worker_index();
+    result->state.store(1);
+  }
+  void set_stopped() && noexcept { result->state.store(2); }
+  void set_error(std::exception_ptr e) && noexcept {
+    result->error = e;
+    result->state.store(3);
+  }
+  void set_error(int code) && noexcept {
+    result->error_code = code;
+    result->state.store(3);
+  }
+};
+
+// predecessor that completes with an error code
+struct FailingSender {
+  template<class R>
+  struct Operation {
+    R rcvr;
+    void start() noexcept { std::move(rcvr).set_error(42); }
+  };
+  template<class R>
+  Operation<R> connect(R rcvr) const { return Operation<R>{std::move(rcvr)}; }
+};
+
+int main(int, char **) {
+  atexit(mem_report);
+  px_sched::Scheduler schd;
+  px_sched::SchedulerParams s_params;
+  s_params.num_threads = 4;
+  s_params.max_running_threads = 4;
+  s_params.mem_callbacks.alloc_fn = mem_check_alloc;
+  s_params.mem_callbacks.free_fn = mem_check_free;
+  schd.init(s_params);
+
+  px_sched::ExecutionScheduler sch(&schd);
+  assert(sch == px_sched::ExecutionScheduler(&schd));
+
+  { // schedule() completes on a worker
+    Result r;
+    const uint32_t before = GLOBAL_num_new.load();
+    auto op = sch.schedule().connect(Receiver{&r});
+    op.start();
+    assert(r.wait(schd) == 1);
+    printf("schedule(): completed on worker %u, %u allocations\n", r.worker, GLOBAL_num_new.load() - before);
+    assert(GLOBAL_num_new.load() == before);
+#if PX_SCHED_IMP_REGULAR_THREADS
+    assert(r.worker < s_params.num_threads);
+#endif
+  }
+
+  { // a sync object as a sender
+    px_sched::Sync loaded;
+    std::atomic<bool> released = {false};
+    schd.runAfterDelay(std::chrono::milliseconds(5), [&released] { released.store(true); }, &loaded);
+    Result r;
+    auto op = sch.whenFinished(loaded).connect(Receiver{&r});
+    op.start();
+    assert(r.wait(schd) == 1);
+    assert(released.load());
+    printf("whenFinished(): completed after the sync object\n");
+  }
+
+  { // bulk after a sync object, split in chunks
+    const uint32_t kN = 100000;
+    std::vector<uint32_t> data(kN, 1);
+    px_sched::Sync ready;
+    schd.incrementSync(&ready);
+    Result r;
+    uint32_t *d = data.data();
+    const uint32_t before = GLOBAL_num_new.load();
+    auto op = sch.bulk(sch.whenFinished(ready), kN, [d](uint32_t i) { d[i] += i; }).connect(Receiver{&r});
+    op.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    assert(r.state.load() == 0);
+    schd.decrementSync(&ready);
+    assert(r.wait(schd) == 1);
+    printf("bulk(): %u elements, %u allocations\n", kN, GLOBAL_num_new.load() - before);
+    assert(GLOBAL_num_new.load() == before);
+    for(uint32_t i = 0; i < kN; ++i) assert(data[i] == i + 1);
+
+    // empty shape completes right away
+    Result empty;
+    auto op2 = sch.bulk(0u, [](uint32_t) { assert(false); }).connect(Receiver{&empty});
+    op2.start();
+    assert(empty.wait(schd) == 1);
+  }
+
+  { // a sender can be connected many times
+    std::atomic<uint32_t> sum = {0};
+    auto sender = sch.bulk(1000, [&sum](int i) { sum.fetch_add(static_cast<uint32_t>(i)); });
+    Result r1, r2;
+    auto op1 = sender.connect(Receiver{&r1});
+    auto op2 = sender.connect(Receiver{&r2});
+    op1.start();
+    op2.start();
+    assert(r1.wait(schd) == 1 && r2.wait(schd) == 1);
+    assert(sum.load() == 2*(999*1000/2));
+  }
+  { // an exception thrown by fn completes with set_error, once every chunk
+    // is done
+    const uint32_t kN = 10000;
+    std::atomic<uint32_t> calls = {0};
+    Result r;
+    auto op = sch.bulk(kN, [&calls](uint32_t i) {
+      calls.fetch_add(1);
+      if (i == 5) throw std::runtime_error("element 5");
+    }).connect(Receiver{&r});
+    op.start();
+    assert(r.wait(schd) == 3);
+    assert(calls.load() <= kN);
+    std::string what;
+    try {
+      std::rethrow_exception(r.error);
+    } catch (const std::runtime_error &e) {
+      what = e.what();
+    }
+    assert(what == "element 5");
+    printf("bulk(): failed with \"%s\" after %u calls\n", what.c_str(), calls.load());
+
+    // errors of the predecessor are forwarded, fn never runs
+    Result failed;
+    auto op2 = sch.bulk(FailingSender(), 100u, [](uint32_t) { assert(false); }).connect(Receiver{&failed});
+    op2.start();
+    assert(failed.wait(schd) == 3 && failed.error_code == 42);
+  }
+  schd.stop();
+
+#if PX_SCHED_IMP_REGULAR_THREADS
+  { // without room for the task the operation completes with set_stopped
+    px_sched::SchedulerParams p = s_params;
+    p.max_number_tasks = 2;
+    p.overflow_policy = px_sched::OverflowPolicy::Fail;
+    schd.init(p);
+    px_sched::Sync gate, blocked;
+    schd.incrementSync(&gate);
+    schd.runAfter(gate, [] {}, &blocked);
+    schd.runAfter(gate, [] {}, &blocked);
+    Result r;
+    auto op = sch.schedule().connect(Receiver{&r});
+    op.start();
+    assert(r.wait(schd) == 2);
+    printf("schedule() without room: stopped\n");
+    schd.decrementSync(&gate);
+    schd.waitFor(blocked);
+    schd.stop();
+  }
+#endif
+  return 0;
+}
@@ -0,0 +1,96 @@
+// Example-9:
+// Delayed and periodic tasks (timers)
+
+#define PX_SCHED_IMPLEMENTATION 1
+#include "../px_sched.h"
+#include "common/mem_check.h"
+#include <cassert>
+
+int main(int, char **) {
+  atexit(mem_report);
+  px_sched::Scheduler schd;
+  px_sched::SchedulerParams s_params;
+  s_params.mem_callbacks.alloc_fn = mem_check_alloc;
+  s_params.mem_callbacks.free_fn = mem_check_free;
+  schd.init(s_params);
+
+  typedef px_sched::Scheduler::Clock Clock;
+  const Clock::time_point start = Clock::now();
+  auto elapsed_ms = [start] {
+    return static_cast<long long>(std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count());
+  };
+
+  // (a) one-shot timers, launched in deadline order no matter the order they
+  // were added, and never before their deadline. Timers already due when
+  // serviced run in parallel, so under load the printed order might differ.
+  // Sync objects work as with any other task
+  px_sched::Sync s1;
+  std::atomic<int> order = {0};
+  for(int i = 4; i > 0; --i) {
+    schd.runAfterDelay(std::chrono::milliseconds(20*i), [i, &order, &elapsed_ms] {
+      int pos = order.fetch_add(1);
+      printf("Timer %d fired after %lldms (pos %d) from %s\n", i, elapsed_ms(), pos,
+        px_sched::Scheduler::current_thread_name());
+      assert(elapsed_ms() >= 20*i);
+    }, &s1);
+  }
+  // a cancelled timer never runs, and releases its sync object
+  px_sched::Timer never = schd.runAt(start + std::chrono::seconds(3600), [] {
+    printf("This should never be printed\n");
+    abort();
+  }, &s1);
+  printf("Waiting for one-shot timers...\n");
+  bool cancelled = schd.cancelTimer(never);
+  assert(cancelled);
+  assert(!schd.cancelTimer(never));
+  schd.waitFor(s1);
+  assert(order.load() == 4);
+  printf("Waiting for one-shot timers...DONE (%lldms)\n", elapsed_ms());
+
+  // (b) periodic timer, cancelled from its own job after 5 ticks. The sync
+  // object waits for the timer to be cancelled.
+  px_sched::Sync s2;
+  std::atomic<int> ticks = {0};
+  px_sched::Timer periodic;
+  periodic = schd.runEvery(std::chrono::milliseconds(10), [&schd, &ticks, &periodic, &elapsed_ms] {
+    int t = ticks.fetch_add(1)+1;
+    printf("Periodic tick %d at %lldms\n", t, elapsed_ms());
+    if (t == 5) schd.cancelTimer(periodic);
+  }, &s2);
+  printf("Waiting for periodic timer...\n");
+  schd.waitFor(s2);
+  assert(ticks.load() == 5);
+  printf("Waiting for periodic timer...DONE (%lldms)\n", elapsed_ms());
+
+  // (c) timers can also trigger regular tasks
+  px_sched::Sync s3, s4;
+  schd.runAfterDelay(std::chrono::milliseconds(5), [] { printf("Timer before dependent tasks\n"); }, &s3);
+  for(int i = 0; i < 8; ++i) {
+    schd.runAfter(s3, [i] { printf("Dependent task %d\n", i); }, &s4);
+  }
+  schd.waitFor(s4);
+
+  // (d) periods that find the task pool full are skipped, the timer goes on
+  // once there is room again
+  schd.stop();
+  px_sched::SchedulerParams small_params = s_params;
+  small_params.max_number_tasks = 4;
+  schd.init(small_params);
+  px_sched::Sync s5, gate, held;
+  std::atomic<int> small_ticks = {0};
+  px_sched::Timer small_periodic;
+  small_periodic = schd.runEvery(std::chrono::milliseconds(2), [&schd, &small_ticks, &small_periodic] {
+    if (small_ticks.fetch_add(1)+1 == 3) schd.cancelTimer(small_periodic);
+  }, &s5);
+  schd.incrementSync(&gate);
+  for(int i = 0; i < 3; ++i) schd.runAfter(gate, [] {}, &held); // the pool is full
+  assert(!schd.waitFor(s5, std::chrono::milliseconds(20)));
+  assert(small_ticks.load() == 0);
+  schd.decrementSync(&gate);
+  schd.waitFor(held);
+  schd.waitFor(s5);
+  assert(small_ticks.load() == 3);
+  printf("Periodic timer with a full task pool...DONE (%lldms)\n", elapsed_ms());
+  printf("DONE\n");
+  return 0;
+}
@@ -49,6 +49,17 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 //
 //  By default Jobs are simply std::function<void()>
 //
+// px_sched::Scheduler is BasicScheduler<px_sched::Job>, to use more than one
+// job type in the same program (e.g. plain structs for the hot path and
+// std::function for the rest) instantiate BasicScheduler for the other types
+// in the file that defines PX_SCHED_IMPLEMENTATION:
+//
+//    #define PX_SCHED_IMPLEMENTATION 1
+//    #include "px_sched.h"
+//    PX_SCHED_INSTANTIATE(MyJob);
+//
+// Trivially copyable jobs are copied with memcpy, and never destroyed.
+//
 #ifndef PX_SCHED_CUSTOM_JOB_DEFINITION
 #include <functional>
 namespace px_sched {
@@ -61,7 +72,8 @@ namespace px_sched {
 // Right now there is only two backends(single-threaded, and regular threads),
 // in the future we will add windows-fibers and posix-ucontext. Meanwhile try
 // to avoid waitFor(...) and use more runAfter if possible. Try not to suspend
-// threads on external mutexes.
+// threads on external mutexes, or wrap the blocking code in a
+// Scheduler::BlockingScope.
 #if !defined(PX_SCHED_CONFIG_SINGLE_THREAD)  && \
     !defined(PX_SCHED_CONFIG_REGULAR_THREADS)
 # define PX_SCHED_CONFIG_REGULAR_THREADS 1
@@ -89,6 +101,23 @@ namespace px_sched {
 #ifndef PX_SCHED_CACHE_LINE_SIZE
 #define PX_SCHED_CACHE_LINE_SIZE 64
 #endif
+
+// -- Object pool layout -------------------------------------------------------
+// By default every element of the internal pools (tasks, sync objects) takes
+// its own cache line together with its state word. Define PX_SCHED_POOL_SOA
+// as 1 to keep the state words in one packed array and the elements in
+// another: pools take a fraction of the memory and scans over the states
+// (debug dumps, stall reports, acquiring free slots) touch far fewer cache
+// lines. Neighbour states might then share a cache line, set
+// PX_SCHED_POOL_SOA_STATE_STRIDE (in 32-bit words) to space them out, e.g.
+// PX_SCHED_CACHE_LINE_SIZE/4 gives every state its own line.
+#ifndef PX_SCHED_POOL_SOA
+#define PX_SCHED_POOL_SOA 0
+#endif
+
+#ifndef PX_SCHED_POOL_SOA_STATE_STRIDE
+#define PX_SCHED_POOL_SOA_STATE_STRIDE 1
+#endif
 // -----------------------------------------------------------------------------
 
 
@@ -128,16 +157,54 @@ namespace px_sched {
 #define PX_SCHED_TRACE_FN(...) /* NO TRACING */
 #endif
 
+// Task labels: run/runAfter accept a label (a static string, not copied)
+// that is shown in the debug status and stall reports, and jobs are executed
+// inside a PX_SCHED_TRACE_FN(label) scope (so it must accept non-literal
+// strings). Disabled by default, then labels are ignored and tasks don't
+// store them.
+#ifndef PX_SCHED_TASK_LABELS
+#define PX_SCHED_TASK_LABELS 0
+#endif
+
+// Lock statistics: TTASLock, TicketLock, MCSLock and RWSpinlock count
+// acquisitions, contended acquisitions and backoff rounds (see LockStats).
+// Disabled by default, it adds shared counters to every acquisition.
+#ifndef PX_SCHED_LOCK_STATS
+#define PX_SCHED_LOCK_STATS 0
+#endif
+
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <new>
 #include <thread>
+#include <type_traits>
+
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <intrin.h>
+#endif
 
 namespace px_sched {
 
   // Sync object
   class Sync {
+  public:
+    // identifier used by the debug functions (getDebugStatus, forEachSync,
+    // exportJSON, ...), 0 means empty
+    uint32_t id() const { return hnd; }
+  private:
+    uint32_t hnd = 0;
+    template<class> friend class BasicScheduler;
+  };
+
+  // Timer object, returned by runAt/runAfterDelay/runEvery and only needed
+  // to cancel a timer before it fires.
+  class Timer {
     uint32_t hnd = 0;
-    friend class Scheduler;
+    template<class> friend class BasicScheduler;
   };
 
 
@@ -153,12 +220,119 @@ namespace px_sched {
     void (*free_fn)(void *ptr) = ::free;
   };
 
+  namespace detail {
+    // where init takes memory from: the MemCallbacks, or a buffer carved in
+    // order and never freed (see StaticScheduler)
+    struct Storage {
+      MemCallbacks mem;
+      unsigned char *next = nullptr;
+      unsigned char *end = nullptr;
+      Storage() = default;
+      Storage(const MemCallbacks &m) : mem(m) {}
+      Storage(void *buffer, size_t size) : next(static_cast<unsigned char*>(buffer)), end(next + size) {}
+      void* alloc(size_t alignment, size_t amount) {
+        if (!end) return mem.alloc_fn(alignment, amount);
+        uintptr_t p = reinterpret_cast<uintptr_t>(next);
+        p = (p + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1);
+        PX_SCHED_CHECK_FN(p + amount <= reinterpret_cast<uintptr_t>(end), "Scheduler storage too small");
+        next = reinterpret_cast<unsigned char*>(p + amount);
+        return reinterpret_cast<void*>(p);
+      }
+      void free(void *ptr) const { if (!end) mem.free_fn(ptr); }
+    };
+  }
+
+  // Snapshot of what might be stalling the scheduler, filled by
+  // Scheduler::getStallReport and by the optional watchdog. Tasks and sync
+  // objects are identified by the same numbers getDebugStatus prints.
+  struct StallReport {
+    static const uint32_t kMaxEntries = 16;
+    struct LongTask {
+      uint16_t worker = 0;      // index of the worker running the task
+      uint32_t task = 0;
+      uint32_t sync = 0;        // sync object the task will release (0 none)
+      uint64_t running_us = 0;  // time running so far
+      const char *label = nullptr; // see PX_SCHED_TASK_LABELS
+    };
+    struct SyncInfo {
+      uint32_t sync = 0;
+      uint32_t pending = 0;       // references still held (see numPendingTasks)
+      uint32_t user_count = 0;    // incrementSync calls not yet decremented
+      uint32_t owner_tasks = 0;   // live tasks that will release it
+      uint32_t waiting_tasks = 0; // tasks launched once it is released
+      bool waited = false;        // a thread is inside waitFor
+    };
+    // tasks running for longer than the given threshold
+    LongTask long_tasks[kMaxEntries];
+    uint32_t num_long_tasks = 0;
+    // sync objects only kept alive by incrementSync, with tasks or threads
+    // waiting on them (a missing decrementSync?)
+    SyncInfo orphans[kMaxEntries];
+    uint32_t num_orphans = 0;
+    // sync objects that depend on themselves through waiting tasks, they
+    // will never be released (e.g. runAfter(s, job, &s))
+    SyncInfo cycles[kMaxEntries];
+    uint32_t num_cycles = 0;
+    // more entries were found than kMaxEntries
+    bool truncated = false;
+    // tasks were completed since the previous watchdog sample
+    bool progress = true;
+
+    // writes a human readable version of the report, returns the number of
+    // characters needed (as snprintf)
+    size_t format(char *buffer, size_t buffer_size) const;
+  };
+
+  // What run/runAfter do when there is no room for one more task (see
+  // SchedulerParams::max_number_tasks)
+  enum class OverflowPolicy {
+    Abort,       // PX_SCHED_CHECK_FN fails (default)
+    RunInline,   // run executes the job on the calling thread, runAfter
+                 // does it too if the trigger was already released
+    WaitAndHelp, // the calling thread executes ready tasks until there is
+                 // room (waits forever if tasks can't finish meanwhile)
+    Fail,        // run/runAfter return false, the job is discarded
+  };
+
+  // Order in which workers take ready tasks (not used on single threaded
+  // mode, where tasks run as soon as they are ready)
+  enum class ReadyOrder {
+    FIFO,             // in the order they became ready (default)
+    EarliestDeadline, // earliest deadline first (see runWithDeadline), tasks
+                      // without deadline go after all the others
+  };
+
   struct SchedulerParams {
     uint16_t num_threads = 16;        // num OS threads created 
     uint16_t max_running_threads = 0; // 0 --> will be set to max hardware concurrency
+    // Elastic pool: with thread_retire_on_idle_in_microseconds != 0 only
+    // min_threads are created on init, more (up to num_threads) are started
+    // when tasks are ready but no worker is idle, and workers idle for longer
+    // than the timeout retire (never going below min_threads).
+    uint16_t min_threads = 1;
+    uint32_t thread_retire_on_idle_in_microseconds = 0; // 0 --> fixed pool of num_threads
+    uint16_t max_blocked_threads = 0; // workers compensated at once inside BlockingScope, 0 --> num_threads
     uint16_t max_number_tasks = 1024; // max number of simultaneous tasks
+    uint16_t max_number_counters = 0; // max number of simultaneous sync objects, 0 --> max_number_tasks
+    OverflowPolicy overflow_policy = OverflowPolicy::Abort; // when max_number_tasks is reached
+    ReadyOrder ready_order = ReadyOrder::FIFO;
     uint16_t thread_num_tries_on_idle = 1;   // number of tries before suspend the thread
     uint32_t thread_sleep_on_idle_in_microseconds = 1; // time spent waiting between tries
+    uint16_t max_number_timers = 64;  // max number of simultaneous timers
+    // tasks hinted to a worker (see hint_worker) wait in its local queue,
+    // with room for max_local_tasks (0 --> no local queues, hints are
+    // ignored). Those waiting for longer than local_steal_after can be taken
+    // by other workers.
+    uint16_t max_local_tasks = 0;
+    uint32_t local_steal_after_in_microseconds = 100;
+    uint32_t timer_resolution_in_microseconds = 1000; // timer wheel tick
+    // Watchdog (not available on single threaded mode): a thread that every
+    // threshold samples the scheduler, and calls watchdog_fn if a task has
+    // been running for longer than the threshold, there is a sync cycle, or
+    // there are orphan sync objects and no task was completed meanwhile.
+    uint32_t watchdog_threshold_in_microseconds = 0; // 0 --> no watchdog
+    void (*watchdog_fn)(const StallReport &report, void *user_data) = nullptr; // nullptr --> prints the report
+    void *watchdog_user_data = nullptr;
     MemCallbacks mem_callbacks;
   };
 
@@ -237,6 +411,8 @@ namespace px_sched {
     ~ObjectPool();
 
     void init(uint32_t count, const MemCallbacks &mem = MemCallbacks());
+    // same, taking the memory from storage
+    void init(uint32_t count, detail::Storage *storage);
     void reset();
 
     // only access objects you've previously referenced
@@ -256,6 +432,9 @@ namespace px_sched {
     // it also increments in one the number of references (no need to call ref)
     uint32_t adquireAndRef();
 
+    // same as adquireAndRef, but returns 0 if the pool is full
+    uint32_t tryAdquireAndRef();
+
     void unref(uint32_t hnd) const;
 
     // decrements the counter, if the object is no longer valid (last ref)
@@ -270,35 +449,145 @@ namespace px_sched {
 
     uint32_t in_use() const { return in_use_.load();}
 
+    // bytes init takes from the MemCallbacks for count objects, alignment
+    // padding included (see StaticScheduler)
+    static constexpr size_t storageSize(uint32_t count) {
+#if PX_SCHED_POOL_SOA
+      return (sizeof(Atomic<uint32_t>)*kStateStride*count + PX_SCHED_CACHE_LINE_SIZE - 1)/PX_SCHED_CACHE_LINE_SIZE*PX_SCHED_CACHE_LINE_SIZE +
+          PX_SCHED_CACHE_LINE_SIZE + sizeof(T)*count + alignof(T);
+#else
+      return sizeof(D)*count + alignof(D);
+#endif
+    }
+
   private:
+    // position of the n-th adquire attempt, a mask with power of two sizes
+    uint32_t wrap(uint32_t n) const { return mask_? (n & mask_) : n % count_; }
     void newElement(uint32_t pos) const;
     void deleteElement(uint32_t pos) const;
+    // returns the handle if the element at pos was free (0 otherwise)
+    uint32_t adquireAt(uint32_t pos);
+
+#if PX_SCHED_POOL_SOA
+    static const uint32_t kStateStride = PX_SCHED_POOL_SOA_STATE_STRIDE;
+    Atomic<uint32_t> &state(uint32_t pos) const { return states_[pos*kStateStride]; }
+    T &element(uint32_t pos) const { return elements_[pos]; }
 
+    Atomic<uint32_t> *states_ = nullptr;
+    T *elements_ = nullptr;
+#else
     struct alignas(PX_SCHED_CACHE_LINE_SIZE) D {
       mutable Atomic<uint32_t> state;
-      uint32_t version = 0;
       T element;
     }; // D struct
 
+    Atomic<uint32_t> &state(uint32_t pos) const { return data_[pos].state; }
+    T &element(uint32_t pos) const { return data_[pos].element; }
+
+    D *data_ = nullptr;
+#endif
+
     mutable Atomic<uint32_t> in_use_;
     Atomic<uint32_t> next_;
-    D *data_ = nullptr;
     uint32_t count_ = 0;
-    MemCallbacks mem_;
+    uint32_t mask_ = 0; // count_-1 if count_ is a power of two (>1)
+    detail::Storage mem_;
   };
 
+  template<class JobT> class BasicLane;
+  template<class T, class JobT = Job> class Resource;
 
-  class Scheduler {
+  // The scheduler is a template over the job type, Scheduler (below) uses
+  // px_sched::Job. Schedulers with other job types can live in the same
+  // program, but they have to be instantiated where the implementation is
+  // (see PX_SCHED_INSTANTIATE).
+  template<class JobT>
+  class BasicScheduler {
   public:
-    Scheduler();
-    ~Scheduler();
+    typedef JobT Job;
+    typedef BasicLane<JobT> Lane;
+
+    BasicScheduler();
+    ~BasicScheduler();
 
     void init(const SchedulerParams &params = SchedulerParams());
     void stop();
 
-    void run(Job &&job, Sync *out_sync_obj = nullptr);
-    void runAfter(Sync sync,Job &&job, Sync *out_sync_obj = nullptr);
-    void waitFor(Sync sync); //< suspend current thread 
+    // run/runAfter return false only if the task could not be created (see
+    // SchedulerParams::overflow_policy)
+    bool run(Job &&job, Sync *out_sync_obj = nullptr);
+    bool runAfter(Sync sync,Job &&job, Sync *out_sync_obj = nullptr);
+    void waitFor(Sync sync); //< suspend current thread (see BlockingScope)
+
+    // Same as above with a task label (see PX_SCHED_TASK_LABELS), and a
+    // worker that should run the task (e.g. the one that produced its data,
+    // see current_worker_index). The hint is soft: the task waits in that
+    // worker's local queue, and other workers take it if it waits for longer
+    // than SchedulerParams::local_steal_after_in_microseconds. Ignored if
+    // the worker does not exist (or is asleep and can not be woken up now),
+    // and on single threaded mode.
+    static const uint16_t kNoWorker = 0xFFFF;
+    bool run(Job &&job, Sync *out_sync_obj, const char *label, uint16_t hint_worker = kNoWorker);
+    bool runAfter(Sync sync, Job &&job, Sync *out_sync_obj, const char *label, uint16_t hint_worker = kNoWorker);
+
+    // Use it inside jobs that must block (external mutex, synchronous
+    // syscall...). While the scope is alive the worker is not counted as
+    // active, so another worker can be woken up to keep the max running
+    // threads busy (up to SchedulerParams::max_blocked_threads workers at
+    // once). Outside workers, and on single threaded mode, it does nothing.
+    // waitFor uses it when called from a worker.
+    class BlockingScope {
+    public:
+      explicit BlockingScope(BasicScheduler *schd);
+      ~BlockingScope();
+      BlockingScope(const BlockingScope&) = delete;
+      BlockingScope& operator=(const BlockingScope&) = delete;
+    private:
+      BasicScheduler *schd_ = nullptr;
+    };
+
+    // Timers: the job is launched (as with run) once the given time is reached.
+    // There is no timer thread, timers are serviced by idle workers before
+    // they go to sleep, and sleeping workers wake up on the next deadline. On
+    // single threaded mode timers are serviced while inside waitFor.
+    typedef std::chrono::steady_clock Clock;
+    Timer runAt(Clock::time_point when, Job &&job, Sync *out_sync_obj = nullptr);
+    Timer runAfterDelay(Clock::duration delay, Job &&job, Sync *out_sync_obj = nullptr);
+
+    // Periodic timer, the job is copied and launched every period (the first
+    // time after one period). The sync object will not be released until the
+    // timer is cancelled, and all its launched jobs have finished.
+    Timer runEvery(Clock::duration period, const Job &job, Sync *out_sync_obj = nullptr);
+
+    // Running out of timers (max_number_timers) is an error, with checks
+    // disabled the job is dropped and its sync object released. A period
+    // that finds the task pool full is skipped.
+
+    // returns true if the timer was still active, a cancelled timer will
+    // never launch its job again.
+    bool cancelTimer(Timer t);
+
+    // Deadlines: the task should be finished before the given (absolute)
+    // time. With SchedulerParams::ready_order = EarliestDeadline workers take
+    // the ready task with the earliest deadline first, otherwise the deadline
+    // is only used for the stats below. A deadline never cancels or delays a
+    // task, late tasks still run.
+    bool runWithDeadline(Clock::time_point deadline, Job &&job, Sync *out_sync_obj = nullptr, const char *label = nullptr);
+    bool runAfterWithDeadline(Sync sync, Clock::time_point deadline, Job &&job, Sync *out_sync_obj = nullptr, const char *label = nullptr);
+
+    // Tasks with a deadline finished, and how many of them too late, per
+    // label (see PX_SCHED_TASK_LABELS, without labels everything is counted
+    // under nullptr, as the labels that do not fit in kMaxDeadlineLabels).
+    static const uint32_t kMaxDeadlineLabels = 32;
+    struct DeadlineStats {
+      const char *label = nullptr;
+      uint32_t completed = 0;
+      uint32_t missed = 0;
+      Clock::duration worst_lateness = Clock::duration::zero();
+    };
+    // copies up to max_entries, returns the number of labels
+    uint32_t getDeadlineStats(DeadlineStats *out, uint32_t max_entries);
+    void resetDeadlineStats();
 
     // returns the number of tasks not yet finished associated to the sync object
     // thus 0 means all of them has finished (or the sync object was empty, or
@@ -306,10 +595,52 @@ namespace px_sched {
     uint32_t numPendingTasks(Sync s);
 
     bool hasFinished(Sync s) { return numPendingTasks(s) == 0; }
+
+    // Any number of threads can wait for the same sync object, they are all
+    // released at once. With a timeout returns false if the time was reached
+    // first, tryWait never blocks (on single threaded mode it services the
+    // expired timers first).
+    bool waitFor(Sync sync, Clock::duration timeout);
+    bool tryWait(Sync sync);
   
     // Call this only to print the internal state of the scheduler, mainly if it 
     // stops working and want to see who is waiting for what, and so on.
-    void getDebugStatus(char *buffer, size_t buffer_size);
+    // Returns the number of characters needed (as snprintf), if it is equal or
+    // bigger than buffer_size the output was truncated.
+    size_t getDebugStatus(char *buffer, size_t buffer_size);
+
+    // -- Introspection (debug) ------------------------------------------------
+    // Iterates over live tasks and sync objects. The scheduler keeps running
+    // meanwhile so this is a snapshot, not an exact picture. The callbacks
+    // receive copies and can call the scheduler.
+    struct TaskInfo {
+      uint32_t id = 0;
+      uint32_t sync = 0;         // sync object released by the task (0 none)
+      uint32_t next_sibling = 0; // next task waiting on the same sync object
+      const char *label = nullptr; // see PX_SCHED_TASK_LABELS
+    };
+    struct SyncInfo {
+      uint32_t id = 0;           // same as Sync::id()
+      uint32_t pending = 0;      // see numPendingTasks
+      uint32_t user_count = 0;   // incrementSync calls not yet decremented
+      uint32_t first_task = 0;   // first task waiting for it (chained by next_sibling)
+      bool waited = false;       // a thread is inside waitFor
+    };
+    template<class F> void forEachTask(F &&f);               // f(const TaskInfo&)
+    template<class F> void forEachSync(F &&f);               // f(const SyncInfo&)
+    template<class F> void forEachWaitingTask(uint32_t sync_id, F &&f); // f(const TaskInfo&)
+    template<class F> void forEachReadyTask(F &&f);          // f(uint32_t task_id)
+
+    // Dependency graph exporters (tasks, sync objects, which task releases
+    // which sync object and which sync object gates which task). Return the
+    // number of characters needed (as snprintf).
+    size_t exportJSON(char *buffer, size_t buffer_size);
+    size_t exportDOT(char *buffer, size_t buffer_size);
+
+    // Looks for tasks running for longer than the threshold, and sync objects
+    // that will probably never be released (see StallReport). It is a debug
+    // tool, the scheduler keeps running while the report is made.
+    void getStallReport(StallReport *report, uint32_t threshold_in_microseconds = 0);
 
     // manually increment the value of a Sync object. Sync objects triggers
     // when they reach 0.
@@ -327,30 +658,118 @@ namespace px_sched {
     // again...
     static void set_current_thread_name(const char *name);
     static const char *current_thread_name();
+    // index of the worker running the calling thread, kNoWorker outside
+    // workers (and always on single threaded mode)
+    static uint16_t current_worker_index();
 
     const SchedulerParams& params() const { return params_; }
 
     // Number of active threads (executing tasks)
     uint32_t active_threads() const { return active_threads_.load(); }
 
+    // Number of OS threads alive (only changes with an elastic pool)
+    uint32_t num_live_threads() const { return live_threads_.load(); }
+
+    // Changes the max number of active threads at runtime (0 --> max hardware
+    // concurrency), workers above the new limit will stop once they finish
+    // their current task.
+    void setMaxRunningThreads(uint16_t max_running_threads);
+    uint32_t max_running_threads() const { return max_running_threads_.load(); }
+
     uint32_t num_tasks() const { return tasks_.in_use(); }
     uint32_t num_counters() const { return counters_.in_use(); }
 
 #if PX_SCHED_IMP_REGULAR_THREADS
-    uint32_t num_tasks_ready() { return ready_tasks_.in_use(); }
+    uint32_t num_tasks_ready() {
+      uint32_t result = ready_tasks_.in_use();
+      for(uint16_t i = 0; workers_ && i < params_.num_threads; ++i) result += workers_[i].local.size();
+      return result;
+    }
+
+    // When a task releases a sync object with exactly one task waiting, the
+    // worker runs that task next instead of sending it to the ready queue.
+    // After kMaxContinuations in a row the next one goes through the queue
+    // (so a long chain does not starve the other ready tasks).
+    static const uint32_t kMaxContinuations = 64;
 #endif
 
 #if PX_SCHED_IMP_SINGLE_THREAD
     uint32_t num_tasks_ready() { return 0; }
 #endif
 
+    // bytes a scheduler with static storage needs for the given sizes: what
+    // init takes from the MemCallbacks, plus the getStallReport scratch (see
+    // StaticScheduler)
+#if PX_SCHED_IMP_REGULAR_THREADS
+    static constexpr size_t storageSize(uint32_t max_tasks, uint32_t max_counters, uint32_t num_threads, uint32_t max_timers,
+        ReadyOrder ready_order = ReadyOrder::FIFO, uint32_t max_local_tasks = 0) {
+      return ObjectPool<Task>::storageSize(max_tasks) + ObjectPool<Counter>::storageSize(max_counters) +
+          sizeof(typename TimerWheel::Entry)*max_timers + alignof(typename TimerWheel::Entry) +
+          (ready_order == ReadyOrder::EarliestDeadline?
+            sizeof(typename DeadlineHeap::Entry)*max_tasks + alignof(typename DeadlineHeap::Entry) :
+            sizeof(uint32_t)*max_tasks + alignof(uint32_t)) +
+          sizeof(Worker)*num_threads + alignof(Worker) +
+          sizeof(typename LocalQueue::Entry)*max_local_tasks*num_threads + alignof(typename LocalQueue::Entry) +
+          sizeof(uint32_t)*stallReportWords(max_tasks, max_counters) + alignof(uint32_t);
+    }
+#else
+    static constexpr size_t storageSize(uint32_t max_tasks, uint32_t max_counters, uint32_t /*num_threads*/, uint32_t max_timers,
+        ReadyOrder /*ready_order*/ = ReadyOrder::FIFO, uint32_t /*max_local_tasks*/ = 0) {
+      return ObjectPool<Task>::storageSize(max_tasks) + ObjectPool<Counter>::storageSize(max_counters) +
+          sizeof(typename TimerWheel::Entry)*max_timers + alignof(typename TimerWheel::Entry) +
+          sizeof(uint32_t)*stallReportWords(max_tasks, max_counters) + alignof(uint32_t);
+    }
+#endif
+
+    // -- Companion headers ---------------------------------------------------
+    // Hooks for primitives built on top of the scheduler (px_sched_dataflow.h,
+    // px_sched_io.h...). A task can be created without launching it, so it
+    // can be linked to something else first, and launched later.
+
+    // Creates a task (as run would, following overflow_policy, helping while
+    // the pool is full if help is true) without launching it. Returns 0 if it
+    // could not be created, the job is left untouched then.
+    uint32_t createTaskWithPolicy(Job &&job, Sync *out_sync_obj, const char *label, bool help);
+    // launches a task from createTaskWithPolicy once trigger is released
+    void runTaskAfter(Sync trigger, uint32_t task_hnd);
+    // executes one ready task on the calling thread (if any), returns false
+    // if waiting can not free room (single threaded mode)
+    bool helpOnce();
+    // Jobs that can not run before their turn (lanes, resources...) can not
+    // run inline either, with RunInline they wait and help as with
+    // WaitAndHelp. True if they should wait and help when the pool is full.
+    bool helpOnOverflow() const {
+      return params_.overflow_policy == OverflowPolicy::WaitAndHelp || params_.overflow_policy == OverflowPolicy::RunInline;
+    }
+
+  protected:
+    // init with the pools, queues, timers and workers carved from the given
+    // buffer (at least storageSize bytes) instead of params.mem_callbacks
+    void init(const SchedulerParams &params, void *storage, size_t size);
+
   private:
+    friend class BasicLane<JobT>;
+    template<class, class> friend class Resource;
     struct TLS;
+    detail::Storage storage_;
+    // getStallReport scratch: per sync object counts and DFS state, and the
+    // graph edges (one per task). Reserved in the storage of a static
+    // scheduler, allocated on every report otherwise.
+    static constexpr size_t stallReportWords(uint32_t max_tasks, uint32_t max_counters) {
+      return 6*static_cast<size_t>(max_counters) + 1 + 3*static_cast<size_t>(max_tasks);
+    }
+    uint32_t *report_scratch_ = nullptr;
+    std::mutex report_mutex_;
+    void initReportScratch();
+    uint16_t numCounters() const { return params_.max_number_counters? params_.max_number_counters : params_.max_number_tasks; }
     static TLS* tls();
     void wakeUpOneThread();
     SchedulerParams params_;
     Atomic<uint32_t> active_threads_;
     Atomic<uint32_t> running_;
+    Atomic<uint32_t> live_threads_;
+    Atomic<uint32_t> max_running_threads_;
+    Atomic<uint32_t> blocked_threads_;
 
     struct WaitFor;
 
@@ -358,19 +777,110 @@ namespace px_sched {
       Job job;
       uint32_t counter_id = 0;
       Atomic<uint32_t> next_sibling_task;
+      Lane *lane = nullptr;
+      Clock::rep deadline = kNoDeadline;
+      uint16_t hint_worker = kNoWorker;
+#if PX_SCHED_TASK_LABELS
+      const char *label = nullptr;
+#endif
     };
+    static const Clock::rep kNoDeadline = std::numeric_limits<Clock::rep>::max();
 
     struct Counter {
       Atomic<uint32_t> task_id;
       Atomic<uint32_t> user_count;
-      WaitFor *wait_ptr = nullptr;
+      Atomic<WaitFor*> wait_ptr; // threads inside waitFor (linked by WaitFor::next)
     };
 
     ObjectPool<Task> tasks_;
     ObjectPool<Counter> counters_;
-    uint32_t createTask(Job &&job, Sync *out_sync_obj);
-    uint32_t createCounter();
+    // with may_fail returns 0 if the pools are full (job is left untouched)
+    uint32_t createTask(Job &&job, Sync *out_sync_obj, const char *label = nullptr, bool may_fail = false);
+    // adds a task to a sync object that is not released yet (as if it was
+    // created with it as out_sync_obj)
+    void joinSync(uint32_t task_hnd, Sync s);
+    typedef std::integral_constant<bool, std::is_trivially_copyable<Job>::value> JobIsTrivial;
+    static void storeJob(Job *dst, Job &&src, std::true_type) { memcpy(static_cast<void*>(dst), &src, sizeof(Job)); }
+    static void storeJob(Job *dst, Job &&src, std::false_type) { *dst = std::move(src); }
+    // executes the job (inside a trace scope with its label)
+    static void executeJob(Job &job, const char *label);
+    static void executeTask(Task &task);
+    static const char* taskLabel(const Task &task);
+    uint32_t createCounter(bool may_fail = false);
     void unrefCounter(uint32_t counter_hnd);
+    // launches a list of tasks linked with next_sibling_task
+    void runTaskChain(uint32_t first_task);
+    // releases a task that will never be executed
+    void discardTask(uint32_t task_hnd);
+    // waitFor without time limit when limit is nullptr
+    bool waitUntil(Sync sync, const Clock::time_point *limit);
+    // run/runAfter with a deadline (kNoDeadline for none)
+    bool runImpl(Job &&job, Sync *out_sync_obj, const char *label, Clock::rep deadline, uint16_t hint_worker = kNoWorker);
+    bool runAfterImpl(Sync trigger, Job &&job, Sync *out_sync_obj, const char *label, Clock::rep deadline, uint16_t hint_worker = kNoWorker);
+
+    // per label deadline stats, protected by a small spinlock
+    struct DeadlineTable {
+      DeadlineStats entries[kMaxDeadlineLabels];
+      uint32_t count = 0;
+      std::atomic_flag lock_ = ATOMIC_FLAG_INIT;
+      void lock() { while(lock_.test_and_set(std::memory_order_acquire)) std::this_thread::yield(); }
+      void unlock() { lock_.clear(std::memory_order_release); }
+    };
+    DeadlineTable deadline_stats_;
+    // called once a task with a deadline has finished
+    void recordDeadline(Clock::rep deadline, const char *label);
+
+    // Hierarchical timer wheel (4 levels of 64 slots), entries are linked by
+    // index (+1, 0 means none) and protected by a small spinlock.
+    struct TimerWheel {
+      static const uint32_t kLevels = 4;
+      static const uint32_t kSlotBits = 6;
+      static const uint32_t kSlots = 1u << kSlotBits;
+      static const uint64_t kNone = ~static_cast<uint64_t>(0);
+      struct Entry {
+        uint64_t deadline = 0; // in ticks
+        uint64_t period = 0;   // in ticks, 0 means one-shot timer
+        uint32_t task = 0;     // task launched (or copied for periodic timers)
+        uint32_t prev = 0;
+        uint32_t next = 0;
+        uint16_t version = 0;
+        uint16_t slot = 0xFFFF;
+      };
+      ~TimerWheel() { reset(); }
+      void init(uint16_t max, detail::Storage *storage);
+      void reset();
+      void insert(uint32_t e);
+      void unlink(uint32_t e);
+      // moves the wheel up to the given tick, returns the list of entries that
+      // reached their deadline (already unlinked)
+      uint32_t advance(uint64_t tick);
+      // first tick where something has to be done (conservative)
+      uint64_t nextEventTick() const;
+      uint32_t slotList(uint32_t level, uint64_t tick) const;
+      void lock() { while(lock_.test_and_set(std::memory_order_acquire)) std::this_thread::yield(); }
+      bool try_lock() { return !lock_.test_and_set(std::memory_order_acquire); }
+      void unlock() { lock_.clear(std::memory_order_release); }
+
+      Entry *entries = nullptr;
+      uint32_t slots[kLevels][kSlots] = {};
+      uint32_t free_list = 0;
+      uint32_t count = 0;
+      uint64_t current = 0; // last tick processed
+      uint16_t max_entries = 0;
+      Clock::time_point epoch;
+      uint64_t resolution = 1; // in microseconds
+      Atomic<uint64_t> next_tick;  // cached result of nextEventTick
+      Atomic<uint64_t> keeper_tick; // tick a sleeping worker will wake up at
+      detail::Storage mem_;
+      std::atomic_flag lock_ = ATOMIC_FLAG_INIT;
+    };
+    TimerWheel timers_;
+    uint64_t timeToTick(Clock::time_point t, bool round_up = false) const;
+    Clock::time_point tickToTime(uint64_t tick) const;
+    Timer addTimer(uint64_t deadline, uint64_t period, uint32_t task);
+    // fires expired timers, returns false if it was being serviced by other thread
+    bool serviceTimers();
+    void initTimers();
 
 #if PX_SCHED_IMP_REGULAR_THREADS
     struct IndexQueue {
@@ -379,27 +889,41 @@ namespace px_sched {
       }
       void reset() {
         if (list_) {
-          mem_.free_fn(list_);
+          mem_.free(list_);
           list_ = nullptr;
         }
         size_ = 0;
         in_use_ = 0;
+        current_ = 0;
       }
-      void init(uint16_t max, const MemCallbacks &mem_cb = MemCallbacks()) {
+      void init(uint16_t max, detail::Storage *storage) {
         _lock();
         reset();
-        mem_ = mem_cb;
+        mem_ = *storage;
         size_ = max;
+        mask_ = (max > 1 && (max & (max-1)) == 0)? static_cast<uint16_t>(max-1) : 0;
         in_use_ = 0;
-        list_ = static_cast<uint32_t*>(mem_.alloc_fn(alignof(uint32_t), sizeof(uint32_t)*size_));
+        list_ = static_cast<uint32_t*>(storage->alloc(alignof(uint32_t), sizeof(uint32_t)*size_));
         _unlock();
       }
       void push(uint32_t p) {
         _lock();
         PX_SCHED_CHECK_FN(in_use_ < size_, "IndexQueue Overflow total in use %hu (max %hu)", in_use_, size_);
-        uint16_t pos = (current_ + in_use_)%size_;
+        uint16_t pos = wrap(current_ + in_use_);
         list_[pos] = p;
-        in_use_++;
+        in_use_ = static_cast<uint16_t>(in_use_ + 1);
+        _unlock();
+      }
+      // pushes n elements with a single lock
+      void pushN(const uint32_t *p, uint16_t n) {
+        _lock();
+        PX_SCHED_CHECK_FN(in_use_ + n <= size_, "IndexQueue Overflow total in use %hu (max %hu)", in_use_, size_);
+        uint16_t pos = wrap(current_ + in_use_);
+        for(uint16_t i = 0; i < n; ++i) {
+          list_[pos] = p[i];
+          pos = wrap(pos+1);
+        }
+        in_use_ = static_cast<uint16_t>(in_use_ + n);
         _unlock();
       }
       uint16_t in_use() {
@@ -408,18 +932,28 @@ namespace px_sched {
         _unlock();
         return result;
       }
+      // i-th element from the head of the queue (debug only)
+      bool at(uint16_t i, uint32_t *res) {
+        _lock();
+        bool result = i < in_use_;
+        if (result) *res = list_[wrap(current_ + i)];
+        _unlock();
+        return result;
+      }
       bool pop(uint32_t *res) {
         _lock();
         bool result = false;
         if (in_use_) {
           if (res) *res = list_[current_];
-          current_ = (current_+1)%size_;
-          in_use_--;
+          current_ = wrap(current_+1);
+          in_use_ = static_cast<uint16_t>(in_use_ - 1);
           result = true;
         }
         _unlock();
         return result;
       }
+      // a mask with power of two sizes
+      uint16_t wrap(uint32_t i) const { return static_cast<uint16_t>(mask_? (i & mask_) : i % size_); }
       void _unlock() { lock_.clear(std::memory_order_release); }
       void _lock() {
         while(lock_.test_and_set(std::memory_order_acquire)) {
@@ -428,12 +962,201 @@ namespace px_sched {
       }
       uint32_t *list_ = nullptr;
       std::atomic_flag lock_ = ATOMIC_FLAG_INIT;
-      MemCallbacks mem_;
+      detail::Storage mem_;
       volatile uint16_t size_ = 0;
+      uint16_t mask_ = 0;
       volatile uint16_t in_use_ = 0;
       volatile uint16_t current_ = 0;
     };
 
+    // Binary min-heap of ready tasks ordered by deadline, ties (and tasks
+    // without deadline) keep the order in which they became ready. Same
+    // interface as IndexQueue, and the same kind of lock.
+    struct DeadlineHeap {
+      struct Entry {
+        Clock::rep deadline;
+        uint32_t seq;
+        uint32_t task;
+      };
+      ~DeadlineHeap() {
+        PX_SCHED_CHECK_FN(heap_ == nullptr, "DeadlineHeap Resources leaked...");
+      }
+      void reset() {
+        if (heap_) {
+          mem_.free(heap_);
+          heap_ = nullptr;
+        }
+        size_ = 0;
+        in_use_ = 0;
+      }
+      void init(uint16_t max, ObjectPool<Task> *tasks, detail::Storage *storage) {
+        _lock();
+        reset();
+        mem_ = *storage;
+        tasks_ = tasks;
+        size_ = max;
+        heap_ = static_cast<Entry*>(storage->alloc(alignof(Entry), sizeof(Entry)*size_));
+        _unlock();
+      }
+      void push(uint32_t p) {
+        _lock();
+        PX_SCHED_CHECK_FN(in_use_ < size_, "DeadlineHeap Overflow total in use %hu (max %hu)", in_use_, size_);
+        _push(p);
+        _unlock();
+      }
+      void pushN(const uint32_t *p, uint16_t n) {
+        _lock();
+        PX_SCHED_CHECK_FN(in_use_ + n <= size_, "DeadlineHeap Overflow total in use %hu (max %hu)", in_use_, size_);
+        for(uint16_t i = 0; i < n; ++i) _push(p[i]);
+        _unlock();
+      }
+      uint16_t in_use() {
+        _lock();
+        uint16_t result = in_use_;
+        _unlock();
+        return result;
+      }
+      // i-th element of the heap, not in order (debug only)
+      bool at(uint16_t i, uint32_t *res) {
+        _lock();
+        bool result = i < in_use_;
+        if (result) *res = heap_[i].task;
+        _unlock();
+        return result;
+      }
+      bool pop(uint32_t *res) {
+        _lock();
+        bool result = false;
+        if (in_use_) {
+          if (res) *res = heap_[0].task;
+          in_use_--;
+          const Entry last = heap_[in_use_];
+          uint16_t pos = 0;
+          for(;;) {
+            uint32_t child = 2u*pos + 1;
+            if (child >= in_use_) break;
+            if (child + 1 < in_use_ && before(heap_[child+1], heap_[child])) child++;
+            if (!before(heap_[child], last)) break;
+            heap_[pos] = heap_[child];
+            pos = static_cast<uint16_t>(child);
+          }
+          heap_[pos] = last;
+          result = true;
+        }
+        _unlock();
+        return result;
+      }
+      // the sequence number wraps around, compared as a difference
+      static bool before(const Entry &a, const Entry &b) {
+        if (a.deadline != b.deadline) return a.deadline < b.deadline;
+        return static_cast<int32_t>(a.seq - b.seq) < 0;
+      }
+      void _push(uint32_t p) {
+        Entry e;
+        e.deadline = tasks_->get(p).deadline;
+        e.seq = seq_++;
+        e.task = p;
+        uint16_t pos = in_use_++;
+        while (pos) {
+          uint16_t parent = static_cast<uint16_t>((pos-1)/2);
+          if (!before(e, heap_[parent])) break;
+          heap_[pos] = heap_[parent];
+          pos = parent;
+        }
+        heap_[pos] = e;
+      }
+      void _unlock() { lock_.clear(std::memory_order_release); }
+      void _lock() {
+        while(lock_.test_and_set(std::memory_order_acquire)) {
+          std::this_thread::yield();
+        }
+      }
+      Entry *heap_ = nullptr;
+      ObjectPool<Task> *tasks_ = nullptr;
+      std::atomic_flag lock_ = ATOMIC_FLAG_INIT;
+      detail::Storage mem_;
+      uint32_t seq_ = 0;
+      uint16_t size_ = 0;
+      uint16_t in_use_ = 0;
+    };
+
+    // the ready queue, following SchedulerParams::ready_order
+    struct ReadyQueue {
+      void init(uint16_t max, ReadyOrder order, ObjectPool<Task> *tasks, detail::Storage *storage) {
+        by_deadline_ = order == ReadyOrder::EarliestDeadline;
+        if (by_deadline_) heap_.init(max, tasks, storage); else fifo_.init(max, storage);
+      }
+      void reset() { fifo_.reset(); heap_.reset(); }
+      void push(uint32_t p) { if (by_deadline_) heap_.push(p); else fifo_.push(p); }
+      void pushN(const uint32_t *p, uint16_t n) { if (by_deadline_) heap_.pushN(p, n); else fifo_.pushN(p, n); }
+      uint16_t in_use() { return by_deadline_? heap_.in_use() : fifo_.in_use(); }
+      bool at(uint16_t i, uint32_t *res) { return by_deadline_? heap_.at(i, res) : fifo_.at(i, res); }
+      bool pop(uint32_t *res) { return by_deadline_? heap_.pop(res) : fifo_.pop(res); }
+      IndexQueue fifo_;
+      DeadlineHeap heap_;
+      bool by_deadline_ = false;
+    };
+
+    // Tasks hinted to a worker (see hint_worker), in the order they arrived
+    // with the time they did, so other workers can take the ones that waited
+    // too long. A closed queue (retired worker) rejects new tasks.
+    struct LocalQueue {
+      struct Entry {
+        uint32_t task;
+        Clock::rep ready_at;
+      };
+      // false if the queue is full or closed
+      bool push(uint32_t p) {
+        const Clock::rep now = Clock::now().time_since_epoch().count();
+        _lock();
+        bool result = !closed_ && size_.load() < capacity_;
+        if (result) {
+          Entry &e = list_[(current_ + size_.load())%capacity_];
+          e.task = p;
+          e.ready_at = now;
+          size_.store(static_cast<uint16_t>(size_.load()+1));
+        }
+        _unlock();
+        return result;
+      }
+      // pops the oldest task if it arrived at or before the given time
+      bool pop(uint32_t *res, Clock::rep arrived_before = std::numeric_limits<Clock::rep>::max()) {
+        if (size_.load() == 0) return false;
+        _lock();
+        bool result = size_.load() && list_[current_].ready_at <= arrived_before;
+        if (result) {
+          *res = list_[current_].task;
+          current_ = static_cast<uint16_t>((current_+1)%capacity_);
+          size_.store(static_cast<uint16_t>(size_.load()-1));
+        }
+        _unlock();
+        return result;
+      }
+      uint16_t size() const { return size_.load(); }
+      void open() {
+        _lock();
+        closed_ = false;
+        _unlock();
+      }
+      void close() {
+        _lock();
+        closed_ = true;
+        _unlock();
+      }
+      void _unlock() { lock_.clear(std::memory_order_release); }
+      void _lock() {
+        while(lock_.test_and_set(std::memory_order_acquire)) {
+          std::this_thread::yield();
+        }
+      }
+      Entry *list_ = nullptr; // capacity_ entries (SchedulerParams::max_local_tasks)
+      uint16_t capacity_ = 0;
+      std::atomic_flag lock_ = ATOMIC_FLAG_INIT;
+      Atomic<uint16_t> size_;
+      uint16_t current_ = 0;
+      bool closed_ = false;
+    };
+
     struct WaitFor {
       explicit WaitFor() 
         : owner(std::this_thread::get_id())
@@ -446,9 +1169,13 @@ namespace px_sched {
         // TODO: instead of waiting, look for tasks that could be
         //       done from this thread.
         std::unique_lock<std::mutex> lk(mutex);
-        if(!ready) {
-          condition_variable.wait(lk);
-        }
+        condition_variable.wait(lk, [this]{ return ready; });
+      }
+      // returns false if the time was reached without being signaled
+      bool waitUntil(Clock::time_point t) {
+        PX_SCHED_TRACE_FN("WaitUntil");
+        std::unique_lock<std::mutex> lk(mutex);
+        return condition_variable.wait_until(lk, t, [this]{ return ready; });
       }
       void signal() {
         if (owner != std::this_thread::get_id()) {
@@ -459,6 +1186,10 @@ namespace px_sched {
           ready = true;
         }
       }
+      // waiters list of a sync object, protected by waiters_mutex_
+      WaitFor *next = nullptr;
+      uint32_t counter = 0;
+      bool listed = false;
     private:
       std::thread::id const owner;
       std::mutex mutex;
@@ -472,19 +1203,246 @@ namespace px_sched {
       Atomic<WaitFor*> wake_up;
       TLS *thread_tls = nullptr;
       uint16_t thread_index = 0xFFFF;
+      // only updated when the watchdog is enabled
+      Atomic<uint32_t> current_task;
+      Atomic<Clock::rep> current_task_start;
+      Atomic<uint32_t> tasks_done;
+      // 1 if the slot has a thread (elastic pools reuse retired slots)
+      Atomic<uint32_t> alive;
+      // idle stack: next worker (index+1, 0 none) and 1 while in the stack
+      Atomic<uint32_t> next_idle;
+      Atomic<uint32_t> in_idle_stack;
+      LocalQueue local;
+    };
+
+    struct Watchdog {
+      std::thread thread;
+      std::mutex mutex;
+      std::condition_variable condition_variable;
+      bool quit = false;
     };
 
     uint16_t wakeUpThreads(uint16_t max_num_threads);
+    // Lock-free (Treiber) stack of sleeping workers. The head packs a tag
+    // (high 32 bits, changed on every operation to avoid ABA) and the index+1
+    // of the top worker. Workers that wake up by themselves (timeouts) stay
+    // in the stack until popped, popping them just finds no wake_up.
+    void pushIdle(uint16_t worker_index);
+    bool popIdle(uint16_t *worker_index);
+    // sends the task to its lane (if any) or to the ready queue
+    void launchTask(uint32_t task_hnd);
+    // executes a task popped from the ready queue and releases it. With
+    // continuation, if that releases exactly one task (without lane) it is
+    // returned instead of going through the ready queue, so the same worker
+    // can run it next.
+    uint32_t runReadyTask(uint32_t task_hnd, bool continuation = false);
+    // unrefCounter that can take the released task as above
+    void unrefCounter(uint32_t counter_hnd, uint32_t *continuation);
+    // sends the task to the ready queue and wakes up a worker
+    void pushReady(uint32_t task_hnd);
+    // sends n tasks to the ready queue at once, and wakes up as many workers
+    // as needed (and allowed) in one pass
+    void pushReady(const uint32_t *task_hnds, uint16_t n);
+    void wakeUpThreadsFor(uint16_t num_tasks);
+    // sends the task to the local queue of the worker (and wakes it up if
+    // needed), false if that is not possible now
+    bool pushLocal(uint32_t task_hnd, uint16_t worker_index);
+    // next task for the worker: its local queue, the ready queue, and the
+    // tasks that waited too long in other local queues (for other threads,
+    // kNoWorker, the last two)
+    bool popTask(uint16_t worker_index, uint32_t *task_hnd);
+    // true if any worker has tasks in its local queue
+    bool anyLocalTasks() const;
+
+    // elastic pool
+    void spawnWorker();
+    bool tryRetire();
 
     Worker *workers_ = nullptr;
-    IndexQueue ready_tasks_;
-
-    static void WorkerThreadMain(Scheduler *schd, Worker *);
+    typename LocalQueue::Entry *local_entries_ = nullptr;
+    Atomic<uint64_t> idle_head_;
+    ReadyQueue ready_tasks_;
+    Watchdog watchdog_;
+    std::mutex spawn_mutex_;
+    std::mutex waiters_mutex_;
+    // signals every thread waiting for the released counter
+    void releaseWaiters(Counter &c);
+
+    static void WorkerThreadMain(BasicScheduler *schd, Worker *);
+    static void WatchdogThreadMain(BasicScheduler *schd);
 #endif 
 
 
   };
 
+  typedef BasicScheduler<Job> Scheduler;
+
+  // Instantiates the scheduler (and lanes) for a job type, only in the file
+  // that defines PX_SCHED_IMPLEMENTATION and outside of any namespace.
+  #define PX_SCHED_INSTANTIATE(JobType) \
+    template class px_sched::BasicScheduler<JobType>; \
+    template class px_sched::BasicLane<JobType>
+
+  //-- StaticScheduler ---------------------------------------------------------
+  // A Scheduler whose pools, ready queue, timers and workers live inside the
+  // object, sized at compile time, so it never allocates (getStallReport's
+  // scratch is reserved there too). Power of two
+  // sizes turn the index wrapping of pools and queues into masks. It is a
+  // Scheduler: lanes, channels, resources... take it as any other.
+  //
+  //    static px_sched::StaticScheduler<256, 256, 4> schd;
+  //    schd.init(); // params sizes are taken from the template arguments
+  template<uint16_t MaxTasks, uint16_t MaxCounters, uint16_t NumThreads, uint16_t MaxTimers = 64,
+      ReadyOrder Order = ReadyOrder::FIFO, uint16_t MaxLocalTasks = 0>
+  class StaticScheduler : public Scheduler {
+  public:
+    static_assert(MaxTasks > 0 && MaxCounters > 0 && NumThreads > 0, "Invalid StaticScheduler sizes");
+    StaticScheduler() = default;
+    ~StaticScheduler() { stop(); }
+
+    // same as Scheduler::init, but max_number_tasks, max_number_counters,
+    // num_threads, max_number_timers, ready_order and max_local_tasks are
+    // given by the template
+    void init(const SchedulerParams &params = SchedulerParams()) {
+      SchedulerParams p = params;
+      p.max_number_tasks = MaxTasks;
+      p.max_number_counters = MaxCounters;
+      p.num_threads = NumThreads;
+      p.max_number_timers = MaxTimers;
+      p.ready_order = Order;
+      p.max_local_tasks = MaxLocalTasks;
+      if (p.min_threads > NumThreads) p.min_threads = NumThreads;
+      Scheduler::init(p, buffer_, sizeof(buffer_));
+    }
+
+  private:
+    alignas(PX_SCHED_CACHE_LINE_SIZE) unsigned char buffer_[Scheduler::storageSize(MaxTasks, MaxCounters, NumThreads, MaxTimers, Order, MaxLocalTasks)];
+  };
+
+  //-- Introspection -----------------------------------------------------------
+  template<class JobT>
+  template<class F>
+  void BasicScheduler<JobT>::forEachTask(F &&f) {
+    for(uint32_t i = 0; i < tasks_.size(); ++i) {
+      uint32_t c;
+      uint32_t hnd = tasks_.info(i, &c, nullptr);
+      if (c == 0 || !tasks_.ref(hnd)) continue;
+      const Task &t = tasks_.get(hnd);
+      TaskInfo info;
+      info.id = hnd;
+      info.sync = t.counter_id;
+      info.next_sibling = t.next_sibling_task.load();
+#if PX_SCHED_TASK_LABELS
+      info.label = t.label;
+#endif
+      tasks_.unref(hnd);
+      f(static_cast<const TaskInfo&>(info));
+    }
+  }
+
+  template<class JobT>
+  template<class F>
+  void BasicScheduler<JobT>::forEachSync(F &&f) {
+    for(uint32_t i = 0; i < counters_.size(); ++i) {
+      uint32_t c;
+      uint32_t hnd = counters_.info(i, &c, nullptr);
+      if (c == 0 || !counters_.ref(hnd)) continue;
+      const Counter &counter = counters_.get(hnd);
+      SyncInfo info;
+      info.id = hnd;
+      info.pending = counters_.refCount(hnd) - 1; // without our reference
+      info.user_count = counter.user_count.load();
+      info.first_task = counter.task_id.load();
+      info.waited = counter.wait_ptr.load() != nullptr;
+      unrefCounter(hnd);
+      f(static_cast<const SyncInfo&>(info));
+    }
+  }
+
+  template<class JobT>
+  template<class F>
+  void BasicScheduler<JobT>::forEachWaitingTask(uint32_t sync_id, F &&f) {
+    if (!counters_.ref(sync_id)) return;
+    uint32_t tid = counters_.get(sync_id).task_id.load();
+    // chains might change meanwhile, never walk more than the max tasks
+    for(uint32_t n = 0; n < tasks_.size() && tasks_.ref(tid); ++n) {
+      const Task &t = tasks_.get(tid);
+      TaskInfo info;
+      info.id = tid;
+      info.sync = t.counter_id;
+      info.next_sibling = t.next_sibling_task.load();
+#if PX_SCHED_TASK_LABELS
+      info.label = t.label;
+#endif
+      tasks_.unref(tid);
+      f(static_cast<const TaskInfo&>(info));
+      tid = info.next_sibling;
+    }
+    unrefCounter(sync_id);
+  }
+
+  template<class JobT>
+  template<class F>
+  void BasicScheduler<JobT>::forEachReadyTask(F &&f) {
+#if PX_SCHED_IMP_REGULAR_THREADS
+    uint32_t tid = 0;
+    for(uint16_t i = 0; ready_tasks_.at(i, &tid); ++i) {
+      f(tid);
+    }
+#else
+    (void)f;
+#endif
+  }
+
+  //-- Lane --------------------------------------------------------------------
+  // Tasks launched through a lane are executed by the scheduler as any other
+  // task, but no more than max_concurrency of them at the same time. Tasks
+  // wait inside the lane (without blocking any worker) until a slot is free.
+  // Useful for disk access, calls to non thread-safe libraries, etc.
+  // On single threaded mode lanes are just a way to call the scheduler.
+  template<class JobT>
+  class BasicLane {
+  public:
+    typedef JobT Job;
+
+    BasicLane() = default;
+    ~BasicLane();
+    BasicLane(const BasicLane&) = delete;
+    BasicLane& operator=(const BasicLane&) = delete;
+
+    void init(BasicScheduler<JobT> *schd, uint16_t max_concurrency = 1);
+
+    // false only if the task could not be created (see
+    // SchedulerParams::overflow_policy, RunInline waits and helps here)
+    bool run(Job &&job, Sync *out_sync_obj = nullptr);
+    bool runAfter(Sync sync, Job &&job, Sync *out_sync_obj = nullptr);
+
+    uint32_t max_concurrency() const { return max_concurrency_; }
+    // tasks of the lane being executed
+    uint32_t num_running() const { return running_.load(); }
+    // tasks of the lane ready to run, but waiting for a free slot
+    uint32_t num_pending() const { return pending_.load(); }
+
+  private:
+    friend class BasicScheduler<JobT>;
+    void push(uint32_t task_hnd);
+    void promote();
+    void release();
+    void lock() { while(lock_.test_and_set(std::memory_order_acquire)) std::this_thread::yield(); }
+    void unlock() { lock_.clear(std::memory_order_release); }
+
+    BasicScheduler<JobT> *schd_ = nullptr;
+    uint32_t max_concurrency_ = 1;
+    Atomic<uint32_t> running_;
+    Atomic<uint32_t> pending_;
+    // pending tasks (linked with Task::next_sibling_task)
+    uint32_t first_ = 0;
+    uint32_t last_ = 0;
+    std::atomic_flag lock_ = ATOMIC_FLAG_INIT;
+  };
+
+  typedef BasicLane<Job> Lane;
+
   //-- Optional: Spinlock ------------------------------------------------------
   class Spinlock {
   public:
@@ -525,54 +1483,637 @@ namespace px_sched {
     uint32_t count_;
   };
 
-  //-- Object pool implementation ----------------------------------------------
-  template<class T>
-  inline ObjectPool<T>::~ObjectPool() {
-    reset();
-  }
-  
-  template<class T>
-  void ObjectPool<T>::newElement(uint32_t pos) const {
-    new (&data_[pos].element) T;
-    uint32_t i = 1;
-    in_use_.fetch_add(i);
+  //-- Optional: Locks ---------------------------------------------------------
+  // Non recursive spinlocks for short critical sections, all of them with
+  // lock/try_lock/unlock (usable with std::lock_guard) and stats():
+  //  - TTASLock: test and test-and-set with exponential backoff, cheapest
+  //    when there is little contention.
+  //  - TicketLock: FIFO (fair), waiters back off proportionally to their
+  //    position in the queue.
+  //  - MCSLock: FIFO queue lock, every waiter spins on its own cache line
+  //    (a node on its stack), scales with many waiters.
+  //  - RWSpinlock: many readers (lock_shared) or one writer, writers waiting
+  //    stop new readers from coming in.
+  // Waiters pause the cpu, and yield once the backoff gets long (so a waiter
+  // does not keep an oversubscribed core from the lock owner).
+
+  // pause instruction for spin loops
+  inline void cpu_relax() {
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+    _mm_pause();
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+    __builtin_ia32_pause();
+#elif defined(__GNUC__) && (defined(__aarch64__) || defined(__arm__))
+    __asm__ __volatile__("yield");
+#else
+    std::this_thread::yield();
+#endif
   }
 
-  template<class T>
-  void ObjectPool<T>::deleteElement(uint32_t pos) const {
-    data_[pos].element.~T();
-    uint32_t i = 1;
-    in_use_.fetch_sub(i);
-  }
+  struct LockStats {
+    uint64_t acquisitions = 0; // lock calls
+    uint64_t contended = 0;    // lock calls that had to wait
+    uint64_t backoffs = 0;     // backoff rounds while waiting
+  };
 
-  template<class T>
-  inline void ObjectPool<T>::init(uint32_t count, const MemCallbacks &mem_cb) {
-    reset();
-    mem_ = mem_cb;
-    data_ = static_cast<D*>(mem_.alloc_fn(alignof(D),sizeof(D)*count));
-    for(uint32_t i = 0; i < count; ++i) {
-      data_[i].state.store(0xFFFu<< kVerDisp);
-    }
-    count_ = count;
-    next_.store(0);
-  }
+  namespace detail {
+    class Backoff {
+    public:
+      static const uint32_t kMaxPauses = 64;
+      void pause(uint32_t factor = 1) {
+        if (count_ > kMaxPauses) {
+          std::this_thread::yield();
+        } else {
+          uint32_t n = count_*factor;
+          if (n > kMaxPauses) n = kMaxPauses;
+          for(uint32_t i = 0; i < n; ++i) cpu_relax();
+          count_ *= 2;
+        }
+        rounds_++;
+      }
+      uint32_t rounds() const { return rounds_; }
+    private:
+      uint32_t count_ = 1;
+      uint32_t rounds_ = 0;
+    };
 
-  template<class T>
-  inline void ObjectPool<T>::reset() {
-    count_ = 0;
-    next_.store(0);
-    if (data_) {
-      mem_.free_fn(data_);
-      data_ = nullptr;
-    }
-  }
+    class LockCounters {
+    public:
+#if PX_SCHED_LOCK_STATS
+      void add(const Backoff &b) {
+        acquisitions_.fetch_add(1, std::memory_order_relaxed);
+        if (b.rounds()) {
+          contended_.fetch_add(1, std::memory_order_relaxed);
+          backoffs_.fetch_add(b.rounds(), std::memory_order_relaxed);
+        }
+      }
+      LockStats stats() const {
+        LockStats s;
+        s.acquisitions = acquisitions_.load(std::memory_order_relaxed);
+        s.contended = contended_.load(std::memory_order_relaxed);
+        s.backoffs = backoffs_.load(std::memory_order_relaxed);
+        return s;
+      }
+    private:
+      std::atomic<uint64_t> acquisitions_ = {0};
+      std::atomic<uint64_t> contended_ = {0};
+      std::atomic<uint64_t> backoffs_ = {0};
+#else
+      void add(const Backoff &) {}
+      LockStats stats() const { return LockStats(); }
+#endif
+    };
+  } // detail namespace
 
-  // only access objects you've previously referenced
-  template<class T>
-  inline T& ObjectPool<T>::get(uint32_t hnd) {
+  class TTASLock {
+  public:
+    void lock() {
+      detail::Backoff b;
+      while (locked_.exchange(true, std::memory_order_acquire)) {
+        do { b.pause(); } while (locked_.load(std::memory_order_relaxed));
+      }
+      counters_.add(b);
+    }
+    bool try_lock() {
+      return !locked_.load(std::memory_order_relaxed) &&
+             !locked_.exchange(true, std::memory_order_acquire);
+    }
+    void unlock() { locked_.store(false, std::memory_order_release); }
+    LockStats stats() const { return counters_.stats(); }
+  private:
+    std::atomic<bool> locked_ = {false};
+    detail::LockCounters counters_;
+  };
+
+  class TicketLock {
+  public:
+    void lock() {
+      detail::Backoff b;
+      uint32_t ticket = next_.fetch_add(1, std::memory_order_relaxed);
+      for(;;) {
+        uint32_t serving = serving_.load(std::memory_order_acquire);
+        if (serving == ticket) break;
+        b.pause(ticket - serving);
+      }
+      counters_.add(b);
+    }
+    bool try_lock() {
+      uint32_t serving = serving_.load(std::memory_order_acquire);
+      uint32_t expected = serving;
+      return next_.compare_exchange_strong(expected, serving+1, std::memory_order_acquire);
+    }
+    void unlock() {
+      serving_.store(serving_.load(std::memory_order_relaxed)+1, std::memory_order_release);
+    }
+    LockStats stats() const { return counters_.stats(); }
+  private:
+    std::atomic<uint32_t> next_ = {0};
+    alignas(PX_SCHED_CACHE_LINE_SIZE) std::atomic<uint32_t> serving_ = {0};
+    detail::LockCounters counters_;
+  };
+
+  // K42 variant of the MCS lock: the lock itself is the queue node of the
+  // owner, so lock/unlock need no node from the caller. Waiters link a node
+  // from their stack and spin on it until the previous owner hands over.
+  class MCSLock {
+  public:
+    void lock() {
+      detail::Backoff b;
+      for(;;) {
+        Node *prev = tail_.load(std::memory_order_acquire);
+        if (prev == nullptr) {
+          if (tail_.compare_exchange_weak(prev, &self_, std::memory_order_acquire)) break;
+          continue;
+        }
+        Node me;
+        me.waiting.store(true, std::memory_order_relaxed);
+        if (!tail_.compare_exchange_weak(prev, &me, std::memory_order_acq_rel)) continue;
+        prev->next.store(&me, std::memory_order_release);
+        while (me.waiting.load(std::memory_order_acquire)) b.pause();
+        // owner now, move the successor (if any) to the lock node
+        Node *succ = me.next.load(std::memory_order_acquire);
+        if (succ == nullptr) {
+          self_.next.store(nullptr, std::memory_order_relaxed);
+          Node *expected = &me;
+          if (!tail_.compare_exchange_strong(expected, &self_, std::memory_order_acq_rel)) {
+            // somebody is linking after us
+            while ((succ = me.next.load(std::memory_order_acquire)) == nullptr) cpu_relax();
+            self_.next.store(succ, std::memory_order_release);
+          }
+        } else {
+          self_.next.store(succ, std::memory_order_release);
+        }
+        break;
+      }
+      counters_.add(b);
+    }
+    bool try_lock() {
+      Node *expected = nullptr;
+      return tail_.compare_exchange_strong(expected, &self_, std::memory_order_acquire);
+    }
+    void unlock() {
+      Node *succ = self_.next.load(std::memory_order_acquire);
+      if (succ == nullptr) {
+        Node *expected = &self_;
+        if (tail_.compare_exchange_strong(expected, nullptr, std::memory_order_release)) return;
+        while ((succ = self_.next.load(std::memory_order_acquire)) == nullptr) cpu_relax();
+      }
+      self_.next.store(nullptr, std::memory_order_relaxed);
+      succ->waiting.store(false, std::memory_order_release);
+    }
+    LockStats stats() const { return counters_.stats(); }
+  private:
+    struct alignas(PX_SCHED_CACHE_LINE_SIZE) Node {
+      std::atomic<Node*> next = {nullptr};
+      std::atomic<bool> waiting = {false};
+    };
+    std::atomic<Node*> tail_ = {nullptr}; // nullptr: free, &self_: owned
+    Node self_;
+    detail::LockCounters counters_;
+  };
+
+  class RWSpinlock {
+  public:
+    void lock() {
+      detail::Backoff b;
+      for(;;) {
+        uint32_t s = state_.load(std::memory_order_relaxed);
+        if ((s & ~kWriterWaiting) == 0) {
+          if (state_.compare_exchange_weak(s, kWriter, std::memory_order_acquire)) break;
+          continue;
+        }
+        if (!(s & kWriterWaiting)) state_.fetch_or(kWriterWaiting, std::memory_order_relaxed);
+        b.pause();
+      }
+      counters_.add(b);
+    }
+    bool try_lock() {
+      uint32_t s = state_.load(std::memory_order_relaxed);
+      return (s & ~kWriterWaiting) == 0 &&
+             state_.compare_exchange_strong(s, kWriter, std::memory_order_acquire);
+    }
+    void unlock() { state_.fetch_and(~kWriter, std::memory_order_release); }
+
+    void lock_shared() {
+      detail::Backoff b;
+      for(;;) {
+        uint32_t s = state_.load(std::memory_order_relaxed);
+        if ((s & (kWriter|kWriterWaiting)) == 0) {
+          if (state_.compare_exchange_weak(s, s + kReader, std::memory_order_acquire)) break;
+          continue;
+        }
+        b.pause();
+      }
+      counters_.add(b);
+    }
+    bool try_lock_shared() {
+      uint32_t s = state_.load(std::memory_order_relaxed);
+      return (s & (kWriter|kWriterWaiting)) == 0 &&
+             state_.compare_exchange_strong(s, s + kReader, std::memory_order_acquire);
+    }
+    void unlock_shared() { state_.fetch_sub(kReader, std::memory_order_release); }
+    LockStats stats() const { return counters_.stats(); }
+  private:
+    static const uint32_t kWriter = 1;
+    static const uint32_t kWriterWaiting = 2;
+    static const uint32_t kReader = 4;
+    std::atomic<uint32_t> state_ = {0};
+    detail::LockCounters counters_;
+  };
+
+  //-- Optional: Channel -------------------------------------------------------
+  // Fixed capacity MPMC channel (no allocations, items live inside it) that
+  // launches consumers as regular tasks when items arrive:
+  //  - onReceive(job) runs job once an item is there for it, the job gets
+  //    it with receive(). Every onReceive gets one item, at most N receivers
+  //    can be waiting for items at the same time.
+  //  - spaceSync() returns a sync object released once there is free space,
+  //    producers use it with runAfter instead of blocking a worker.
+  // trySend/tryReceive never wait, tryReceive never takes the items already
+  // promised to onReceive jobs.
+  template<class T, uint32_t N, class JobT = Job>
+  class Channel {
+  public:
+    typedef JobT Job;
+
+    Channel() = default;
+    ~Channel() {
+      PX_SCHED_CHECK_FN(num_receivers_ == 0, "Channel destroyed with receivers waiting");
+      PX_SCHED_CHECK_FN(claimed_ == 0, "Channel destroyed with items promised to receivers");
+      for(uint32_t i = 0; i < count_; ++i) {
+        reinterpret_cast<T*>(&items_[(first_ + i)%N])->~T();
+      }
+    }
+    Channel(const Channel&) = delete;
+    Channel& operator=(const Channel&) = delete;
+
+    void init(BasicScheduler<JobT> *schd) { schd_ = schd; }
+
+    // false if the channel is full
+    bool trySend(T &&item) { return push(std::move(item)); }
+    bool trySend(const T &item) { return push(T(item)); }
+
+    // false if there is no item (that is not promised to a receiver)
+    bool tryReceive(T *item) { return pop(item, false); }
+
+    // only from jobs launched by onReceive, takes the item they were given
+    void receive(T *item) {
+      bool ok = pop(item, true);
+      PX_SCHED_CHECK_FN(ok, "Channel::receive called without onReceive");
+      (void)ok;
+    }
+
+    // false if the job could not be launched (see
+    // SchedulerParams::overflow_policy), it is discarded
+    bool onReceive(Job &&job, Sync *out_sync_obj = nullptr) {
+      PX_SCHED_CHECK_FN(schd_ != nullptr, "Channel not initialized");
+      lock();
+      if (count_ > claimed_) {
+        claimed_++;
+        unlock();
+        if (schd_->run(std::move(job), out_sync_obj)) return true;
+        unclaim();
+        return false;
+      }
+      unlock();
+      // gate the job, then look again: an item might have arrived meanwhile
+      Sync gate;
+      schd_->incrementSync(&gate);
+      if (!schd_->runAfter(gate, std::move(job), out_sync_obj)) {
+        schd_->decrementSync(&gate);
+        return false;
+      }
+      lock();
+      if (count_ > claimed_) {
+        claimed_++;
+        unlock();
+        schd_->decrementSync(&gate);
+        return true;
+      }
+      PX_SCHED_CHECK_FN(num_receivers_ < N, "Too many receivers waiting on a Channel");
+      receivers_[(first_receiver_ + num_receivers_)%N] = gate;
+      num_receivers_++;
+      unlock();
+      return true;
+    }
+
+    // empty sync object if there is free space already. Other producers might
+    // take the space first, trySend can still fail once it is released.
+    Sync spaceSync() {
+      PX_SCHED_CHECK_FN(schd_ != nullptr, "Channel not initialized");
+      lock();
+      if (count_ == N && space_.id() == 0) {
+        schd_->incrementSync(&space_);
+      }
+      Sync result = (count_ == N)? space_ : Sync();
+      unlock();
+      return result;
+    }
+
+    uint32_t size() const {
+      lock();
+      uint32_t result = count_;
+      unlock();
+      return result;
+    }
+    static constexpr uint32_t capacity() { return N; }
+
+  private:
+    bool push(T &&item) {
+      lock();
+      if (count_ == N) {
+        unlock();
+        return false;
+      }
+      new (&items_[(first_ + count_)%N]) T(std::move(item));
+      count_++;
+      Sync gate = popReceiver();
+      if (gate.id()) claimed_++;
+      unlock();
+      if (gate.id()) schd_->decrementSync(&gate);
+      return true;
+    }
+
+    // gate of the first waiting receiver (lock held)
+    Sync popReceiver() {
+      Sync gate;
+      if (num_receivers_) {
+        gate = receivers_[first_receiver_];
+        receivers_[first_receiver_] = Sync();
+        first_receiver_ = (first_receiver_+1)%N;
+        num_receivers_--;
+      }
+      return gate;
+    }
+
+    // the receiver an item was promised to could not be launched, the item
+    // goes to the next waiting receiver (or back to the channel)
+    void unclaim() {
+      lock();
+      Sync gate = popReceiver();
+      if (!gate.id()) claimed_--;
+      unlock();
+      if (gate.id()) schd_->decrementSync(&gate);
+    }
+
+    bool pop(T *item, bool claimed) {
+      lock();
+      if (claimed? claimed_ == 0 : count_ <= claimed_) {
+        unlock();
+        return false;
+      }
+      if (claimed) claimed_--;
+      T *slot = reinterpret_cast<T*>(&items_[first_]);
+      *item = std::move(*slot);
+      slot->~T();
+      first_ = (first_+1)%N;
+      count_--;
+      Sync space = space_;
+      space_ = Sync();
+      unlock();
+      if (space.id()) schd_->decrementSync(&space);
+      return true;
+    }
+
+    void lock() const { while(lock_.test_and_set(std::memory_order_acquire)) std::this_thread::yield(); }
+    void unlock() const { lock_.clear(std::memory_order_release); }
+
+    BasicScheduler<JobT> *schd_ = nullptr;
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type items_[N];
+    uint32_t first_ = 0;
+    uint32_t count_ = 0;
+    uint32_t claimed_ = 0;        // items promised to onReceive jobs
+    Sync receivers_[N];           // gates of the receivers waiting for items
+    uint32_t first_receiver_ = 0;
+    uint32_t num_receivers_ = 0;
+    Sync space_;                  // released on the next pop while full
+    mutable std::atomic_flag lock_ = ATOMIC_FLAG_INIT;
+  };
+
+  //-- Optional: Resource ------------------------------------------------------
+  // Object shared between tasks: reads (func(const T*)) run concurrently,
+  // writes (func(T*)) alone, all of them in submission order. Consecutive
+  // reads form a batch joined by one sync object, the next write runs after
+  // it. Submitting a read takes no lock (only an epoch counter, so a write
+  // can tell when all the reads of its batch have been submitted), writes
+  // take a spinlock among themselves. finish_signal is released when the
+  // operation is done, the *Sync variants return their own.
+  template<class T, class JobT>
+  class Resource {
+  public:
+    Resource() = default;
+    ~Resource() { finish(); }
+    Resource(const Resource&) = delete;
+    Resource& operator=(const Resource&) = delete;
+
+    void init(BasicScheduler<JobT> *schd) {
+      finish();
+      schd_ = schd;
+      schd_->incrementSync(&batches_[current_.load()].join);
+    }
+
+    // waits for all the operations submitted so far, and detaches the
+    // resource from the scheduler
+    void finish() {
+      if (!schd_) return;
+      // the last write waited for everything before it, the current batch
+      // holds the reads after it
+      Batch &b = batches_[current_.load()];
+      Sync last_write = b.gate;
+      Sync reads = b.join;
+      schd_->decrementSync(&b.join);
+      schd_->waitFor(last_write);
+      schd_->waitFor(reads);
+      for(uint32_t i = 0; i < 2; ++i) {
+        batches_[i].gate = Sync();
+        batches_[i].join = Sync();
+        batches_[i].reads.store(0);
+      }
+      schd_ = nullptr;
+    }
+
+    // Both return false if the task could not be created (see
+    // SchedulerParams::overflow_policy, RunInline waits and helps here), the
+    // operation is discarded. Tasks are created before entering the batch,
+    // so helping never keeps a write waiting.
+    template<class F>
+    bool executeRead(F func, Sync *finish_signal = nullptr) {
+      PX_SCHED_CHECK_FN(schd_ != nullptr, "Resource not initialized");
+      BasicScheduler<JobT> *schd = schd_;
+      const T *obj = &obj_;
+      uint32_t t_ref;
+      if (finish_signal) {
+        schd->incrementSync(finish_signal);
+        Sync signal = *finish_signal;
+        t_ref = schd->createTaskWithPolicy([obj, func, schd, signal] {
+          func(obj);
+          Sync s = signal;
+          schd->decrementSync(&s);
+        }, nullptr, nullptr, schd->helpOnOverflow());
+        if (!t_ref) {
+          schd->decrementSync(&signal);
+          return false;
+        }
+      } else {
+        t_ref = schd->createTaskWithPolicy([obj, func] { func(obj); }, nullptr, nullptr, schd->helpOnOverflow());
+        if (!t_ref) return false;
+      }
+      // enter the current batch, retry if a write closed it meanwhile
+      uint32_t idx;
+      for(;;) {
+        idx = current_.load();
+        entering_[idx].fetch_add(1);
+        if (current_.load() == idx) break;
+        entering_[idx].fetch_sub(1);
+      }
+      Batch &b = batches_[idx];
+      b.reads.fetch_add(1);
+      Sync gate = b.gate;
+      schd->joinSync(t_ref, b.join);
+      entering_[idx].fetch_sub(1);
+      // launched once out of the batch, it might run inline (single threaded
+      // mode)
+      schd->runTaskAfter(gate, t_ref);
+      return true;
+    }
+
+    template<class F>
+    bool executeWrite(F func, Sync *finish_signal = nullptr) {
+      PX_SCHED_CHECK_FN(schd_ != nullptr, "Resource not initialized");
+      BasicScheduler<JobT> *schd = schd_;
+      T *obj = &obj_;
+      // gate of the next batch of reads, released by this write
+      Sync gate;
+      schd->incrementSync(&gate);
+      uint32_t t_ref = schd->createTaskWithPolicy([schd, obj, func, gate] {
+        func(obj);
+        Sync g = gate;
+        schd->decrementSync(&g);
+      }, finish_signal, nullptr, schd->helpOnOverflow());
+      if (!t_ref) {
+        schd->decrementSync(&gate);
+        return false;
+      }
+      std::lock_guard<Spinlock> lock(write_lock_);
+      uint32_t cur = current_.load();
+      Batch &prev = batches_[cur];
+      Batch &next = batches_[1-cur];
+      next.gate = gate;
+      next.join = Sync();
+      next.reads.store(0);
+      schd->incrementSync(&next.join);
+      current_.store(1-cur);
+      while (entering_[cur].load() != 0) std::this_thread::yield();
+      // all the reads of the previous batch are in its join now
+      Sync after = prev.reads.load()? prev.join : prev.gate;
+      schd->runTaskAfter(after, t_ref);
+      schd->decrementSync(&prev.join);
+      return true;
+    }
+
+    // (the sync object returned is already released if the operation was
+    // discarded)
+    template<class F>
+    Sync executeReadSync(F func) {
+      Sync s;
+      executeRead(std::move(func), &s);
+      return s;
+    }
+
+    template<class F>
+    Sync executeWriteSync(F func) {
+      Sync s;
+      executeWrite(std::move(func), &s);
+      return s;
+    }
+
+  private:
+    struct Batch {
+      Sync gate;             // previous write
+      Sync join;             // reads of the batch, kept alive until the next write
+      Atomic<uint32_t> reads;
+    };
+    T obj_;
+    BasicScheduler<JobT> *schd_ = nullptr;
+    Batch batches_[2];
+    Atomic<uint32_t> current_;
+    Atomic<uint32_t> entering_[2];
+    Spinlock write_lock_;
+  };
+
+  //-- Object pool implementation ----------------------------------------------
+  template<class T>
+  inline ObjectPool<T>::~ObjectPool() {
+    reset();
+  }
+  
+  template<class T>
+  void ObjectPool<T>::newElement(uint32_t pos) const {
+    new (&element(pos)) T;
+    uint32_t i = 1;
+    in_use_.fetch_add(i);
+  }
+
+  template<class T>
+  void ObjectPool<T>::deleteElement(uint32_t pos) const {
+    if (!std::is_trivially_destructible<T>::value) element(pos).~T();
+    uint32_t i = 1;
+    in_use_.fetch_sub(i);
+  }
+
+  template<class T>
+  inline void ObjectPool<T>::init(uint32_t count, const MemCallbacks &mem_cb) {
+    detail::Storage storage(mem_cb);
+    init(count, &storage);
+  }
+
+  template<class T>
+  inline void ObjectPool<T>::init(uint32_t count, detail::Storage *storage) {
+    reset();
+    mem_ = *storage;
+#if PX_SCHED_POOL_SOA
+    // the size of aligned allocations must be a multiple of the alignment
+    size_t states_size = sizeof(Atomic<uint32_t>)*kStateStride*count;
+    states_size = (states_size + PX_SCHED_CACHE_LINE_SIZE - 1)/PX_SCHED_CACHE_LINE_SIZE*PX_SCHED_CACHE_LINE_SIZE;
+    states_ = static_cast<Atomic<uint32_t>*>(storage->alloc(PX_SCHED_CACHE_LINE_SIZE, states_size));
+    elements_ = static_cast<T*>(storage->alloc(alignof(T), sizeof(T)*count));
+#else
+    data_ = static_cast<D*>(storage->alloc(alignof(D),sizeof(D)*count));
+#endif
+    for(uint32_t i = 0; i < count; ++i) {
+      state(i).store(0xFFFu<< kVerDisp);
+    }
+    count_ = count;
+    mask_ = (count > 1 && (count & (count-1)) == 0)? count-1 : 0;
+    next_.store(0);
+  }
+
+  template<class T>
+  inline void ObjectPool<T>::reset() {
+    count_ = 0;
+    mask_ = 0;
+    next_.store(0);
+#if PX_SCHED_POOL_SOA
+    if (states_) {
+      mem_.free(states_);
+      mem_.free(elements_);
+      states_ = nullptr;
+      elements_ = nullptr;
+    }
+#else
+    if (data_) {
+      mem_.free(data_);
+      data_ = nullptr;
+    }
+#endif
+  }
+
+  // only access objects you've previously referenced
+  template<class T>
+  inline T& ObjectPool<T>::get(uint32_t hnd) {
     uint32_t pos = hnd & kPosMask;
     PX_SCHED_CHECK_FN(pos < count_, "Invalid access to pos %u hnd:%u", pos, count_);
-    return data_[pos].element;
+    return element(pos);
   }
 
   // only access objects you've previously referenced
@@ -580,51 +2121,66 @@ namespace px_sched {
   inline const T&  ObjectPool<T>::get(uint32_t hnd) const {
     uint32_t pos = hnd & kPosMask;
     PX_SCHED_CHECK_FN(pos < count_, "Invalid access to pos %u hnd:%u", pos, count_);
-    return data_[pos].element;
+    return element(pos);
   }
 
   template< class T>
   inline uint32_t ObjectPool<T>::info(uint32_t pos, uint32_t *count, uint32_t *ver) const {
     PX_SCHED_CHECK_FN(pos < count_, "Invalid access to pos %u hnd:%u", pos, count_);
-    uint32_t s = data_[pos].state.load();
+    uint32_t s = state(pos).load();
     if (count) *count = (s & kRefMask);
     if (ver) *ver = (s & kVerMask) >> kVerDisp;
     return (s&kVerMask) | pos;
   }
 
+  template<class T>
+  inline uint32_t ObjectPool<T>::adquireAt(uint32_t pos) {
+    Atomic<uint32_t> &st = state(pos);
+    uint32_t version = (st.load() & kVerMask) >> kVerDisp;
+    // note: avoid 0 as version
+    uint32_t newver = (version+1) & 0xFFF;
+    if (newver == 0) newver = 1;
+    // instead of using 1 as initial ref, we use 2, when we see 1
+    // in the future we know the object must be freed, but it wont
+    // be actually freed until it reaches 0
+    uint32_t newvalue = (newver << kVerDisp) + 2;
+    uint32_t expected = version << kVerDisp;
+    if (st.compare_exchange_strong(expected, newvalue)) {
+      newElement(pos); //< initialize
+      return (newver << kVerDisp) | (pos & kPosMask);
+    }
+    return 0;
+  }
+
   template<class T>
   inline uint32_t ObjectPool<T>::adquireAndRef() {
     PX_SCHED_TRACE_FN("ObjectPool<T>::adquireAndRef");
     uint32_t tries = 0;
     for(;;) {
-      uint32_t pos = (next_.fetch_add(1)%count_);
-      D& d = data_[pos];
-      uint32_t version = (d.state.load() & kVerMask) >> kVerDisp;
-      // note: avoid 0 as version
-      uint32_t newver = (version+1) & 0xFFF;
-      if (newver == 0) newver = 1;
-      // instead of using 1 as initial ref, we use 2, when we see 1
-      // in the future we know the object must be freed, but it wont
-      // be actually freed until it reaches 0
-      uint32_t newvalue = (newver << kVerDisp) + 2;
-      uint32_t expected = version << kVerDisp;
-      if (d.state.compare_exchange_strong(expected, newvalue)) {
-        newElement(pos); //< initialize
-        return (newver << kVerDisp) | (pos & kPosMask);
-      }
+      uint32_t hnd = adquireAt(wrap(next_.fetch_add(1)));
+      if (hnd) return hnd;
       tries++;
-      // TODO... make this, optional...
       PX_SCHED_CHECK_FN(tries < count_*count_, "It was not possible to find a valid index after %u tries", tries);
     }
   }
 
+  template<class T>
+  inline uint32_t ObjectPool<T>::tryAdquireAndRef() {
+    PX_SCHED_TRACE_FN("ObjectPool<T>::tryAdquireAndRef");
+    for(uint32_t tries = 0; tries < count_ && in_use_.load() < count_; ++tries) {
+      uint32_t hnd = adquireAt(wrap(next_.fetch_add(1)));
+      if (hnd) return hnd;
+    }
+    return 0;
+  }
+
   template< class T>
   inline void ObjectPool<T>::unref(uint32_t hnd) const {
     uint32_t pos = hnd & kPosMask;
     uint32_t ver = (hnd & kVerMask);
-    D& d = data_[pos];
+    Atomic<uint32_t> &st = state(pos);
     for(;;) {
-      uint32_t prev = d.state.load();
+      uint32_t prev = st.load();
       uint32_t next = prev - 1;
       PX_SCHED_CHECK_FN((prev & kVerMask) == ver,
           "Invalid unref HND = %u(%u), Versions: %u vs %u",
@@ -632,10 +2188,10 @@ namespace px_sched {
       PX_SCHED_CHECK_FN((prev & kRefMask) > 1,
           "Invalid unref HND = %u(%u), invalid ref count",
           pos, hnd);
-      if (d.state.compare_exchange_strong(prev, next)) {
+      if (st.compare_exchange_strong(prev, next)) {
         if ((next & kRefMask) == 1) {
           deleteElement(pos);
-          d.state.store(0);
+          st.store(0);
         }
         return;
       }
@@ -649,9 +2205,9 @@ namespace px_sched {
   inline void ObjectPool<T>::unref(uint32_t hnd, F &&f) const {
     uint32_t pos = hnd & kPosMask;
     uint32_t ver = (hnd & kVerMask);
-    D& d = data_[pos];
+    Atomic<uint32_t> &st = state(pos);
     for(;;) {
-      uint32_t prev = d.state.load();
+      uint32_t prev = st.load();
       uint32_t next = prev - 1;
       PX_SCHED_CHECK_FN((prev & kVerMask) == ver,
           "Invalid unref HND = %u(%u), Versions: %u vs %u",
@@ -659,11 +2215,11 @@ namespace px_sched {
       PX_SCHED_CHECK_FN((prev & kRefMask) > 1,
           "Invalid unref HND = %u(%u), invalid ref count",
           pos, hnd);
-      if (d.state.compare_exchange_strong(prev, next)) {
+      if (st.compare_exchange_strong(prev, next)) {
         if ((next & kRefMask) == 1) {
-          f(d.element);
+          f(element(pos));
           deleteElement(pos);
-          d.state.store(0);
+          st.store(0);
         }
         return;
       }
@@ -675,14 +2231,14 @@ namespace px_sched {
     if (!hnd) return false;
     uint32_t pos = hnd & kPosMask;
     uint32_t ver = (hnd & kVerMask);
-    D& d = data_[pos];
+    Atomic<uint32_t> &st = state(pos);
     for (;;) {
-      uint32_t prev = d.state.load();
+      uint32_t prev = st.load();
       uint32_t next_c =((prev & kRefMask) +1);
       if ((prev & kVerMask) != ver || next_c <= 2) return false;
       PX_SCHED_CHECK_FN(next_c  == (next_c & kRefMask), "Too many references...");
       uint32_t next = (prev & kVerMask) | next_c ;
-      if (d.state.compare_exchange_strong(prev, next)) {
+      if (st.compare_exchange_strong(prev, next)) {
         return true;
       }
     }
@@ -693,8 +2249,7 @@ namespace px_sched {
     if (!hnd) return 0;
     uint32_t pos = hnd & kPosMask;
     uint32_t ver = (hnd & kVerMask);
-    D& d = data_[pos];
-    uint32_t current = d.state.load();
+    uint32_t current = state(pos).load();
     if ((current & kVerMask) != ver ) return 0;
     return (current & kRefMask);
   }
@@ -720,12 +2275,15 @@ namespace px_sched {
 
 namespace px_sched {
 
-  struct Scheduler::TLS {
+  template<class JobT>
+  struct BasicScheduler<JobT>::TLS {
     const char *name = nullptr;
-    Scheduler *scheduler = nullptr;
+    BasicScheduler *scheduler = nullptr;
+    uint16_t worker_index = kNoWorker;
   };
 
-  Scheduler::TLS* Scheduler::tls() {
+  template<class JobT>
+  typename BasicScheduler<JobT>::TLS* BasicScheduler<JobT>::tls() {
 #ifdef PX_SCHED_ATLERNATIVE_TLS
     static std::unordered_map<std::thread::id, TLS> data;
     static Atomic<uint32_t> in_use(0);
@@ -742,48 +2300,227 @@ namespace px_sched {
 #endif
   }
 
-  void Scheduler::set_current_thread_name(const char *name) {
+  template<class JobT>
+  void BasicScheduler<JobT>::set_current_thread_name(const char *name) {
     TLS *d = tls();
     d->name = name;
   }
 
-  const char *Scheduler::current_thread_name() {
+  template<class JobT>
+  const char *BasicScheduler<JobT>::current_thread_name() {
     TLS *d = tls();
     return d->name;
   }
 
+  template<class JobT>
+  uint16_t BasicScheduler<JobT>::current_worker_index() {
+    return tls()->worker_index;
+  }
+
 }
 
 // Common to all implementations of px_sched (Single Threaded and Multi Threaded)
 namespace px_sched {
-  uint32_t Scheduler::createCounter() {
+  template<class JobT>
+  uint32_t BasicScheduler<JobT>::createCounter(bool may_fail) {
     PX_SCHED_TRACE_FN("CreateCounter");
-    uint32_t hnd = counters_.adquireAndRef();
+    uint32_t hnd = may_fail? counters_.tryAdquireAndRef() : counters_.adquireAndRef();
+    if (!hnd) return 0;
     Counter *c = &counters_.get(hnd);
     c->task_id.store(0);
     c->user_count.store(0);
-    c->wait_ptr = nullptr;
+    c->wait_ptr.store(nullptr);
     return hnd;
   }
 
-  uint32_t Scheduler::createTask(Job &&job, Sync *sync_obj) {
+  template<class JobT>
+  uint32_t BasicScheduler<JobT>::createTask(Job &&job, Sync *sync_obj, const char *label, bool may_fail) {
     PX_SCHED_TRACE_FN("CreateTask");
-    uint32_t ref = tasks_.adquireAndRef();
-    Task *task = &tasks_.get(ref);
-    task->job = std::move(job);
-    task->counter_id = 0;
-    task->next_sibling_task.store(0);
+    uint32_t ref = may_fail? tasks_.tryAdquireAndRef() : tasks_.adquireAndRef();
+    if (!ref) return 0;
+    uint32_t counter = 0;
     if (sync_obj) {
       bool new_counter = !counters_.ref(sync_obj->hnd);
       if (new_counter) {
-        sync_obj->hnd = createCounter();
+        uint32_t hnd = createCounter(may_fail);
+        if (!hnd) {
+          tasks_.unref(ref);
+          return 0;
+        }
+        sync_obj->hnd = hnd;
       }
-      task->counter_id = sync_obj->hnd;
+      counter = sync_obj->hnd;
     }
+    Task *task = &tasks_.get(ref);
+    storeJob(&task->job, std::move(job), JobIsTrivial());
+    task->counter_id = counter;
+    task->next_sibling_task.store(0);
+    task->lane = nullptr;
+    task->deadline = kNoDeadline;
+    task->hint_worker = kNoWorker;
+#if PX_SCHED_TASK_LABELS
+    task->label = label;
+#else
+    (void)label;
+#endif
     return ref;
   }
 
-  void Scheduler::incrementSync(Sync *s) {
+  template<class JobT>
+  uint32_t BasicScheduler<JobT>::createTaskWithPolicy(Job &&job, Sync *sync_obj, const char *label, bool help) {
+    if (params_.overflow_policy == OverflowPolicy::Abort) {
+      return createTask(std::move(job), sync_obj, label);
+    }
+    for(;;) {
+      uint32_t t_ref = createTask(std::move(job), sync_obj, label, true);
+      if (t_ref || !help || !helpOnce()) return t_ref;
+    }
+  }
+
+  template<class JobT>
+  void BasicScheduler<JobT>::executeJob(Job &job, const char *label) {
+#if PX_SCHED_TASK_LABELS
+    PX_SCHED_TRACE_FN(label? label : "Task");
+#endif
+    (void)label; // unused when PX_SCHED_TRACE_FN is empty
+    job();
+  }
+
+  template<class JobT>
+  void BasicScheduler<JobT>::executeTask(Task &task) {
+#if PX_SCHED_TASK_LABELS
+    executeJob(task.job, task.label);
+#else
+    executeJob(task.job, nullptr);
+#endif
+  }
+
+  template<class JobT>
+  const char* BasicScheduler<JobT>::taskLabel(const Task &task) {
+#if PX_SCHED_TASK_LABELS
+    return task.label;
+#else
+    (void)task;
+    return nullptr;
+#endif
+  }
+
+  template<class JobT>
+  bool BasicScheduler<JobT>::run(Job &&job, Sync *s) {
+    return runImpl(std::move(job), s, nullptr, kNoDeadline);
+  }
+
+  template<class JobT>
+  bool BasicScheduler<JobT>::run(Job &&job, Sync *s, const char *label, uint16_t hint_worker) {
+    return runImpl(std::move(job), s, label, kNoDeadline, hint_worker);
+  }
+
+  template<class JobT>
+  bool BasicScheduler<JobT>::runWithDeadline(Clock::time_point deadline, Job &&job, Sync *s, const char *label) {
+    return runImpl(std::move(job), s, label, deadline.time_since_epoch().count());
+  }
+
+  template<class JobT>
+  bool BasicScheduler<JobT>::runAfter(Sync trigger, Job &&job, Sync *s) {
+    return runAfterImpl(trigger, std::move(job), s, nullptr, kNoDeadline);
+  }
+
+  template<class JobT>
+  bool BasicScheduler<JobT>::runAfter(Sync trigger, Job &&job, Sync *s, const char *label, uint16_t hint_worker) {
+    return runAfterImpl(trigger, std::move(job), s, label, kNoDeadline, hint_worker);
+  }
+
+  template<class JobT>
+  bool BasicScheduler<JobT>::runAfterWithDeadline(Sync trigger, Clock::time_point deadline, Job &&job, Sync *s, const char *label) {
+    return runAfterImpl(trigger, std::move(job), s, label, deadline.time_since_epoch().count());
+  }
+
+  template<class JobT>
+  bool BasicScheduler<JobT>::runAfterImpl(Sync trigger, Job &&job, Sync *s, const char *label, Clock::rep deadline, uint16_t hint_worker) {
+    PX_SCHED_TRACE_FN("RunTaskAfter");
+#if PX_SCHED_IMP_REGULAR_THREADS
+    PX_SCHED_CHECK_FN(running_.load(), "Scheduler not running");
+#endif
+    const OverflowPolicy policy = params_.overflow_policy;
+    uint32_t t_ref = createTaskWithPolicy(std::move(job), s, label, policy == OverflowPolicy::WaitAndHelp);
+    while (!t_ref && policy == OverflowPolicy::RunInline) {
+      // the job can only run inline once the trigger is released
+      if (hasFinished(trigger)) {
+        executeJob(job, label);
+        if (deadline != kNoDeadline) recordDeadline(deadline, label);
+        return true;
+      }
+      if (!helpOnce()) return false;
+      t_ref = createTask(std::move(job), s, label, true);
+    }
+    if (!t_ref) return false;
+    Task &task = tasks_.get(t_ref);
+    task.deadline = deadline;
+    task.hint_worker = hint_worker;
+    runTaskAfter(trigger, t_ref);
+    return true;
+  }
+
+  template<class JobT>
+  const typename BasicScheduler<JobT>::Clock::rep BasicScheduler<JobT>::kNoDeadline;
+  template<class JobT>
+  const uint32_t BasicScheduler<JobT>::kMaxDeadlineLabels;
+  template<class JobT>
+  const uint16_t BasicScheduler<JobT>::kNoWorker;
+
+  template<class JobT>
+  void BasicScheduler<JobT>::recordDeadline(Clock::rep deadline, const char *label) {
+    const Clock::rep now = Clock::now().time_since_epoch().count();
+    DeadlineTable &table = deadline_stats_;
+    table.lock();
+    DeadlineStats *entry = nullptr;
+    for(uint32_t i = 0; i < table.count && !entry; ++i) {
+      const char *l = table.entries[i].label;
+      if (l == label || (l && label && strcmp(l, label) == 0)) entry = &table.entries[i];
+    }
+    if (!entry) {
+      // the last entry is kept for nullptr (labels that do not fit)
+      if (table.count + 1 >= kMaxDeadlineLabels) {
+        label = nullptr;
+        for(uint32_t i = 0; i < table.count && !entry; ++i) {
+          if (table.entries[i].label == nullptr) entry = &table.entries[i];
+        }
+      }
+      if (!entry) {
+        entry = &table.entries[table.count++];
+        *entry = DeadlineStats();
+        entry->label = label;
+      }
+    }
+    entry->completed++;
+    if (now > deadline) {
+      entry->missed++;
+      const Clock::duration lateness(now - deadline);
+      if (lateness > entry->worst_lateness) entry->worst_lateness = lateness;
+    }
+    table.unlock();
+  }
+
+  template<class JobT>
+  uint32_t BasicScheduler<JobT>::getDeadlineStats(DeadlineStats *out, uint32_t max_entries) {
+    DeadlineTable &table = deadline_stats_;
+    table.lock();
+    const uint32_t count = table.count;
+    for(uint32_t i = 0; i < count && i < max_entries; ++i) out[i] = table.entries[i];
+    table.unlock();
+    return count;
+  }
+
+  template<class JobT>
+  void BasicScheduler<JobT>::resetDeadlineStats() {
+    DeadlineTable &table = deadline_stats_;
+    table.lock();
+    table.count = 0;
+    table.unlock();
+  }
+
+  template<class JobT>
+  void BasicScheduler<JobT>::incrementSync(Sync *s) {
     PX_SCHED_TRACE_FN("IncrementSync");
     if (!counters_.ref(s->hnd)) {
       s->hnd = createCounter();
@@ -795,7 +2532,8 @@ namespace px_sched {
     }
   }
 
-  void Scheduler::decrementSync(Sync *s) {
+  template<class JobT>
+  void BasicScheduler<JobT>::decrementSync(Sync *s) {
     PX_SCHED_TRACE_FN("DecrementSync");
     if (counters_.ref(s->hnd)) {
       Counter &c = counters_.get(s->hnd);
@@ -807,30 +2545,10 @@ namespace px_sched {
       unrefCounter(s->hnd);
     }
   }
-}
-
-#if PX_SCHED_IMP_SINGLE_THREAD
 
-namespace px_sched {
-  Scheduler::Scheduler() {}
-  Scheduler::~Scheduler() {}
-  void Scheduler::init(const SchedulerParams &params) {
-    params_ = params;
-    tasks_.init(params_.max_number_tasks, params_.mem_callbacks);
-    counters_.init(params_.max_number_tasks, params_.mem_callbacks);
-  }
-  void Scheduler::stop() {
-    tasks_.reset();
-    counters_.reset();
-  }
-  void Scheduler::run(Job &&job, Sync *s) {
-    job();
-    if (s) decrementSync(s);
-  }
-
-  void Scheduler::runAfter(Sync trigger, Job &&job, Sync *s) {
+  template<class JobT>
+  void BasicScheduler<JobT>::runTaskAfter(Sync trigger, uint32_t t_ref) {
     if (counters_.ref(trigger.hnd)) {
-      uint32_t t_ref = createTask(std::move(job), s);
       Counter *c = &counters_.get(trigger.hnd);
       for(;;) {
         uint32_t current = c->task_id.load();
@@ -842,44 +2560,782 @@ namespace px_sched {
       }
       unrefCounter(trigger.hnd);
     } else {
-      run(std::move(job), s);
+      runTaskChain(t_ref);
     }
   }
 
-  void Scheduler::waitFor(Sync s) {
-    PX_SCHED_CHECK_FN(!(counters_.ref(s.hnd)), "Invalid, on SingleThreaded mode we can not wait for a sync object...");
+  template<class JobT>
+  void BasicScheduler<JobT>::joinSync(uint32_t task_hnd, Sync s) {
+    bool alive = counters_.ref(s.hnd);
+    PX_SCHED_CHECK_FN(alive, "joinSync on a released sync object");
+    (void)alive;
+    tasks_.get(task_hnd).counter_id = s.hnd;
   }
 
-  uint32_t Scheduler::numPendingTasks(Sync s){
-    return counters_.refCount(s.hnd);
+  template<class JobT>
+  void BasicScheduler<JobT>::discardTask(uint32_t task_hnd) {
+    uint32_t counter = tasks_.get(task_hnd).counter_id;
+    tasks_.unref(task_hnd);
+    unrefCounter(counter);
+  }
+
+  //-- Timers ------------------------------------------------------------------
+  template<class JobT>
+  const uint32_t BasicScheduler<JobT>::TimerWheel::kLevels;
+  template<class JobT>
+  const uint32_t BasicScheduler<JobT>::TimerWheel::kSlotBits;
+  template<class JobT>
+  const uint32_t BasicScheduler<JobT>::TimerWheel::kSlots;
+  template<class JobT>
+  const uint64_t BasicScheduler<JobT>::TimerWheel::kNone;
+
+  template<class JobT>
+  void BasicScheduler<JobT>::TimerWheel::init(uint16_t max, detail::Storage *storage) {
+    reset();
+    mem_ = *storage;
+    max_entries = max;
+    if (max) {
+      entries = static_cast<Entry*>(storage->alloc(alignof(Entry), sizeof(Entry)*max));
+      for(uint32_t i = 0; i < max; ++i) {
+        new (&entries[i]) Entry();
+        entries[i].next = (i+1 < max)? i+2 : 0;
+      }
+      free_list = 1;
+    }
+  }
+
+  template<class JobT>
+  void BasicScheduler<JobT>::TimerWheel::reset() {
+    if (entries) {
+      mem_.free(entries);
+      entries = nullptr;
+    }
+    for(uint32_t l = 0; l < kLevels; ++l) {
+      for(uint32_t s = 0; s < kSlots; ++s) slots[l][s] = 0;
+    }
+    free_list = 0;
+    count = 0;
+    current = 0;
+    max_entries = 0;
+    next_tick.store(kNone);
+    keeper_tick.store(kNone);
+  }
+
+  template<class JobT>
+  void BasicScheduler<JobT>::TimerWheel::insert(uint32_t e) {
+    Entry &entry = entries[e-1];
+    // entries already expired go to the next tick to be processed
+    uint64_t deadline = (entry.deadline > current)? entry.deadline : current+1;
+    uint64_t delta = deadline - current;
+    uint32_t level = 0;
+    while (level+1 < kLevels && (delta >> (kSlotBits*(level+1))) != 0) level++;
+    // out of range, placed as far as possible and re-inserted when cascaded
+    const uint64_t max_delta = static_cast<uint64_t>(1) << (kSlotBits*kLevels);
+    if (delta >= max_delta) deadline = current + max_delta - 1;
+    uint32_t slot = static_cast<uint32_t>(deadline >> (kSlotBits*level)) & (kSlots-1);
+    entry.slot = static_cast<uint16_t>(level*kSlots + slot);
+    entry.prev = 0;
+    entry.next = slots[level][slot];
+    if (entry.next) entries[entry.next-1].prev = e;
+    slots[level][slot] = e;
+    count++;
+  }
+
+  template<class JobT>
+  void BasicScheduler<JobT>::TimerWheel::unlink(uint32_t e) {
+    Entry &entry = entries[e-1];
+    if (entry.slot == 0xFFFF) return;
+    if (entry.prev) {
+      entries[entry.prev-1].next = entry.next;
+    } else {
+      slots[entry.slot/kSlots][entry.slot%kSlots] = entry.next;
+    }
+    if (entry.next) entries[entry.next-1].prev = entry.prev;
+    entry.prev = 0;
+    entry.next = 0;
+    entry.slot = 0xFFFF;
+    count--;
+  }
+
+  template<class JobT>
+  uint32_t BasicScheduler<JobT>::TimerWheel::slotList(uint32_t level, uint64_t tick) const {
+    return slots[level][static_cast<uint32_t>(tick >> (kSlotBits*level)) & (kSlots-1)];
+  }
+
+  template<class JobT>
+  uint32_t BasicScheduler<JobT>::TimerWheel::advance(uint64_t tick) {
+    uint32_t fired = 0;
+    uint32_t fired_last = 0;
+    auto fire = [this, &fired, &fired_last](uint32_t e) {
+      unlink(e);
+      if (fired_last) entries[fired_last-1].next = e; else fired = e;
+      fired_last = e;
+    };
+    while (current < tick) {
+      uint64_t next_event = nextEventTick();
+      if (next_event > tick) {
+        current = tick;
+        break;
+      }
+      // nothing happens until next_event, jump there directly
+      if (next_event > current+1) current = next_event-1;
+      current++;
+      // cascade the upper levels (from top to bottom) when the lower level wraps
+      for(uint32_t level = kLevels-1; level > 0; --level) {
+        const uint64_t mask = (static_cast<uint64_t>(1) << (kSlotBits*level)) - 1;
+        if ((current & mask) != 0) continue;
+        uint32_t e = slotList(level, current);
+        while (e) {
+          uint32_t next_e = entries[e-1].next;
+          if (entries[e-1].deadline <= current) {
+            fire(e);
+          } else {
+            unlink(e);
+            insert(e);
+          }
+          e = next_e;
+        }
+      }
+      uint32_t e = slotList(0, current);
+      while (e) {
+        uint32_t next_e = entries[e-1].next;
+        if (entries[e-1].deadline <= current) {
+          fire(e);
+        } else {
+          unlink(e);
+          insert(e);
+        }
+        e = next_e;
+      }
+    }
+    if (fired_last) entries[fired_last-1].next = 0;
+    return fired;
+  }
+
+  template<class JobT>
+  uint64_t BasicScheduler<JobT>::TimerWheel::nextEventTick() const {
+    if (count == 0) return kNone;
+    uint64_t result = kNone;
+    for(uint64_t i = 1; i <= kSlots; ++i) {
+      if (slotList(0, current+i)) {
+        result = current+i;
+        break;
+      }
+    }
+    // upper levels: the moment they are cascaded into the level below
+    for(uint32_t level = 1; level < kLevels; ++level) {
+      const uint64_t block = current >> (kSlotBits*level);
+      for(uint64_t i = 1; i <= kSlots; ++i) {
+        uint64_t t = (block+i) << (kSlotBits*level);
+        if (t >= result) break;
+        if (slotList(level, t)) {
+          result = t;
+          break;
+        }
+      }
+    }
+    return result;
+  }
+
+  template<class JobT>
+  void BasicScheduler<JobT>::initTimers() {
+    timers_.init(params_.max_number_timers, &storage_);
+    timers_.epoch = Clock::now();
+    timers_.resolution = params_.timer_resolution_in_microseconds? params_.timer_resolution_in_microseconds : 1;
+  }
+
+  template<class JobT>
+  uint64_t BasicScheduler<JobT>::timeToTick(Clock::time_point t, bool round_up) const {
+    if (t <= timers_.epoch) return 0;
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(t - timers_.epoch).count();
+    uint64_t r = round_up? timers_.resolution-1 : 0;
+    return (static_cast<uint64_t>(us)+r)/timers_.resolution;
+  }
+
+  template<class JobT>
+  typename BasicScheduler<JobT>::Clock::time_point BasicScheduler<JobT>::tickToTime(uint64_t tick) const {
+    return timers_.epoch + std::chrono::microseconds(
+        static_cast<std::chrono::microseconds::rep>(tick*timers_.resolution));
+  }
+
+  template<class JobT>
+  Timer BasicScheduler<JobT>::addTimer(uint64_t deadline, uint64_t period, uint32_t task) {
+    PX_SCHED_TRACE_FN("AddTimer");
+    Timer result;
+    timers_.lock();
+    uint32_t e = timers_.free_list;
+    PX_SCHED_CHECK_FN(e != 0, "Too many timers (max %u)", timers_.max_entries);
+    if (e == 0) {
+      // only reached with checks disabled, the job is dropped (never
+      // launched before its time)
+      timers_.unlock();
+      discardTask(task);
+      return result;
+    }
+    typename TimerWheel::Entry &entry = timers_.entries[e-1];
+    timers_.free_list = entry.next;
+    entry.deadline = deadline;
+    entry.period = period;
+    entry.task = task;
+    entry.version = static_cast<uint16_t>(entry.version+1);
+    if (entry.version == 0) entry.version = 1;
+    timers_.insert(e);
+    result.hnd = (static_cast<uint32_t>(entry.version) << 16) | e;
+    uint64_t next = timers_.nextEventTick();
+    timers_.next_tick.store(next);
+    timers_.unlock();
+    // if a worker is sleeping until a later deadline, wake up another one
+    if (next < timers_.keeper_tick.load()) wakeUpOneThread();
+    return result;
+  }
+
+  template<class JobT>
+  bool BasicScheduler<JobT>::serviceTimers() {
+    uint64_t next = timers_.next_tick.load();
+    if (next == TimerWheel::kNone) return true;
+    uint64_t now = timeToTick(Clock::now());
+    if (now < next) return true;
+    if (!timers_.try_lock()) return false;
+    PX_SCHED_TRACE_FN("ServiceTimers");
+    uint32_t first = 0;
+    uint32_t last = 0;
+    uint32_t e = timers_.advance(now);
+    while (e) {
+      typename TimerWheel::Entry &entry = timers_.entries[e-1];
+      uint32_t next_e = entry.next;
+      uint32_t task = entry.task;
+      if (entry.period) {
+        // periodic timers keep the original task as template
+        Task &tmpl = tasks_.get(entry.task);
+        Sync s;
+        s.hnd = tmpl.counter_id;
+        // never blocks under the timers lock, with the task pool full this
+        // period is skipped
+        task = createTask(Job(tmpl.job), s.hnd? &s : nullptr, nullptr, true);
+        entry.deadline += entry.period;
+        if (entry.deadline <= now) {
+          // skip missed periods
+          entry.deadline += ((now - entry.deadline)/entry.period + 1)*entry.period;
+        }
+        timers_.insert(e);
+      } else {
+        entry.task = 0;
+        entry.next = timers_.free_list;
+        timers_.free_list = e;
+      }
+      if (task) {
+        if (last) tasks_.get(last).next_sibling_task.store(task); else first = task;
+        last = task;
+      }
+      e = next_e;
+    }
+    timers_.next_tick.store(timers_.nextEventTick());
+    timers_.unlock();
+    runTaskChain(first);
+    return true;
+  }
+
+  template<class JobT>
+  Timer BasicScheduler<JobT>::runAt(Clock::time_point when, Job &&job, Sync *out_sync_obj) {
+    PX_SCHED_TRACE_FN("RunAt");
+    uint32_t t_ref = createTask(std::move(job), out_sync_obj);
+    // round up, timers should never fire before the given time
+    return addTimer(timeToTick(when, true), 0, t_ref);
+  }
+
+  template<class JobT>
+  Timer BasicScheduler<JobT>::runAfterDelay(Clock::duration delay, Job &&job, Sync *out_sync_obj) {
+    return runAt(Clock::now() + delay, std::move(job), out_sync_obj);
+  }
+
+  template<class JobT>
+  Timer BasicScheduler<JobT>::runEvery(Clock::duration period, const Job &job, Sync *out_sync_obj) {
+    PX_SCHED_TRACE_FN("RunEvery");
+    uint64_t us = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(period).count());
+    uint64_t ticks = us/timers_.resolution;
+    if (ticks == 0) ticks = 1;
+    uint32_t t_ref = createTask(Job(job), out_sync_obj);
+    return addTimer(timeToTick(Clock::now(), true) + ticks, ticks, t_ref);
+  }
+
+  template<class JobT>
+  bool BasicScheduler<JobT>::cancelTimer(Timer t) {
+    PX_SCHED_TRACE_FN("CancelTimer");
+    uint32_t e = t.hnd & 0xFFFF;
+    uint32_t version = t.hnd >> 16;
+    if (e == 0 || e > timers_.max_entries) return false;
+    uint32_t task = 0;
+    timers_.lock();
+    typename TimerWheel::Entry &entry = timers_.entries[e-1];
+    if (entry.version == version && entry.slot != 0xFFFF) {
+      timers_.unlink(e);
+      task = entry.task;
+      entry.task = 0;
+      entry.next = timers_.free_list;
+      timers_.free_list = e;
+      timers_.next_tick.store(timers_.nextEventTick());
+    }
+    timers_.unlock();
+    if (task) discardTask(task);
+    return task != 0;
+  }
+}
+
+namespace px_sched {
+  //-- Debug -------------------------------------------------------------------
+  // appends to buffer (with buffer_size), p counts the characters needed even
+  // once the buffer is full
+  #define _ADD(...) { \
+      int n = snprintf((p < buffer_size)? buffer+p : nullptr, (p < buffer_size)? buffer_size-p : 0, __VA_ARGS__); \
+      if (n > 0) p += static_cast<size_t>(n); }
+
+  template<class JobT>
+  size_t BasicScheduler<JobT>::getDebugStatus(char *buffer, size_t buffer_size) {
+    PX_SCHED_TRACE_FN("GetDebugStatus");
+    size_t p = 0;
+    if (buffer_size) buffer[0] = 0;
+#if PX_SCHED_IMP_REGULAR_THREADS
+    if (workers_) {
+      _ADD("Workers:0    5    10   15   20   25   30   35   40   45   50   55   60   65   70   75\n");
+      _ADD("%3u/%3u:", active_threads_.load(), max_running_threads_.load());
+      for(size_t i = 0; i < params_.num_threads; ++i) {
+        _ADD( (workers_[i].wake_up.load() == nullptr)?"*":".");
+      }
+      _ADD("\nWorkers(%d):", params_.num_threads);
+      for(size_t i = 0; i < params_.num_threads; ++i) {
+        auto &w = workers_[i];
+        bool is_on =(w.wake_up.load() == nullptr);
+        if (!is_on) {
+          continue;
+        }
+        _ADD("\n  Worker: %d(%s) %s", w.thread_index, 
+            is_on?"ON":"OFF",
+            (w.thread_tls && w.thread_tls->name)? w.thread_tls->name: "-no-name-"
+            );
+      }
+    }
+#endif
+    _ADD("\nReady: ");
+    forEachReadyTask([&](uint32_t tid) { _ADD("%u,", tid); });
+    _ADD("\nTasks: ");
+    forEachTask([&](const TaskInfo &t) {
+      if (t.label) {
+        _ADD("%u(%s),", t.id, t.label);
+      } else {
+        _ADD("%u,", t.id);
+      }
+    });
+    _ADD("\nCounters:");
+    forEachSync([&](const SyncInfo &c) { _ADD("%u,", c.id); });
+    _ADD("\n");
+    return p;
+  }
+
+  template<class JobT>
+  size_t BasicScheduler<JobT>::exportJSON(char *buffer, size_t buffer_size) {
+    PX_SCHED_TRACE_FN("ExportJSON");
+    size_t p = 0;
+    if (buffer_size) buffer[0] = 0;
+    const char *sep = "";
+    _ADD("{\"tasks\":[");
+    forEachTask([&](const TaskInfo &t) {
+      _ADD("%s{\"id\":%u,\"sync\":%u}", sep, t.id, t.sync);
+      sep = ",";
+    });
+    _ADD("],\"syncs\":[");
+    sep = "";
+    forEachSync([&](const SyncInfo &c) {
+      _ADD("%s{\"id\":%u,\"pending\":%u,\"user_count\":%u,\"waited\":%s,\"waiting_tasks\":[",
+          sep, c.id, c.pending, c.user_count, c.waited? "true" : "false");
+      const char *tsep = "";
+      forEachWaitingTask(c.id, [&](const TaskInfo &t) {
+        _ADD("%s%u", tsep, t.id);
+        tsep = ",";
+      });
+      _ADD("]}");
+      sep = ",";
+    });
+    _ADD("],\"ready\":[");
+    sep = "";
+    forEachReadyTask([&](uint32_t tid) {
+      _ADD("%s%u", sep, tid);
+      sep = ",";
+    });
+    _ADD("]}\n");
+    return p;
   }
 
-  void Scheduler::getDebugStatus(char *buffer, size_t buffer_size) {
+  template<class JobT>
+  size_t BasicScheduler<JobT>::exportDOT(char *buffer, size_t buffer_size) {
+    PX_SCHED_TRACE_FN("ExportDOT");
+    size_t p = 0;
     if (buffer_size) buffer[0] = 0;
+    // tasks are boxes with an edge to the sync object they release, sync
+    // objects are ellipses with a dashed edge to the tasks they gate
+    _ADD("digraph px_sched {\n");
+    forEachTask([&](const TaskInfo &t) {
+      _ADD("  t%u [shape=box,label=\"task %u\"];\n", t.id, t.id);
+      if (t.sync) _ADD("  t%u -> s%u;\n", t.id, t.sync);
+    });
+    forEachSync([&](const SyncInfo &c) {
+      _ADD("  s%u [shape=ellipse,label=\"sync %u\\npending %u%s\"%s];\n", c.id, c.id, c.pending,
+          c.user_count? "\\nmanual" : "", c.waited? ",peripheries=2" : "");
+      forEachWaitingTask(c.id, [&](const TaskInfo &t) {
+        _ADD("  s%u -> t%u [style=dashed];\n", c.id, t.id);
+      });
+    });
+    forEachReadyTask([&](uint32_t tid) {
+      _ADD("  t%u [style=filled,fillcolor=palegreen];\n", tid);
+    });
+    _ADD("}\n");
+    return p;
+  }
+
+  //-- Stall report ------------------------------------------------------------
+  const uint32_t StallReport::kMaxEntries;
+
+  size_t StallReport::format(char *buffer, size_t buffer_size) const {
+    size_t p = 0;
+    _ADD("Long running tasks: %u\n", num_long_tasks);
+    for(uint32_t i = 0; i < num_long_tasks; ++i) {
+      const LongTask &t = long_tasks[i];
+      _ADD("  task %u%s%s%s on worker %u running for %llums (sync %u)\n", t.task,
+          t.label? " (" : "", t.label? t.label : "", t.label? ")" : "",
+          static_cast<unsigned>(t.worker), static_cast<unsigned long long>(t.running_us/1000), t.sync);
+    }
+    const char *names[2] = { "Orphan sync objects", "Sync cycles" };
+    const SyncInfo *lists[2] = { orphans, cycles };
+    const uint32_t counts[2] = { num_orphans, num_cycles };
+    for(uint32_t l = 0; l < 2; ++l) {
+      _ADD("%s: %u\n", names[l], counts[l]);
+      for(uint32_t i = 0; i < counts[l]; ++i) {
+        const SyncInfo &c = lists[l][i];
+        _ADD("  sync %u: pending %u, user count %u, owner tasks %u, waiting tasks %u%s\n",
+            c.sync, c.pending, c.user_count, c.owner_tasks, c.waiting_tasks, c.waited? ", waited" : "");
+      }
+    }
+    if (truncated) _ADD("(report truncated)\n");
+    if (!progress) _ADD("No task was completed since the previous sample\n");
+    return p;
+  }
+  #undef _ADD
+
+  template<class JobT>
+  void BasicScheduler<JobT>::getStallReport(StallReport *report, uint32_t threshold_us) {
+    PX_SCHED_TRACE_FN("GetStallReport");
+    StallReport &r = *report;
+    r = StallReport();
+#if PX_SCHED_IMP_REGULAR_THREADS
+    // workers only track their current task when the watchdog is enabled
+    if (workers_ && params_.watchdog_threshold_in_microseconds) {
+      const Clock::rep now = Clock::now().time_since_epoch().count();
+      for(uint16_t i = 0; i < params_.num_threads; ++i) {
+        Worker &w = workers_[i];
+        uint32_t task = w.current_task.load();
+        Clock::rep start = w.current_task_start.load();
+        if (!task || w.current_task.load() != task || start > now) continue;
+        uint64_t us = static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(Clock::duration(now - start)).count());
+        if (us < threshold_us) continue;
+        if (r.num_long_tasks == StallReport::kMaxEntries) {
+          r.truncated = true;
+          break;
+        }
+        StallReport::LongTask &lt = r.long_tasks[r.num_long_tasks++];
+        lt.worker = i;
+        lt.task = task;
+        lt.running_us = us;
+        if (tasks_.ref(task)) {
+          lt.sync = tasks_.get(task).counter_id;
+#if PX_SCHED_TASK_LABELS
+          lt.label = tasks_.get(task).label;
+#endif
+          tasks_.unref(task);
+        }
+      }
+    }
+#else
+    (void)threshold_us;
+#endif
+    const uint32_t num_counters = counters_.size();
+    const uint32_t num_tasks = tasks_.size();
+    if (!num_counters || !num_tasks) return;
+
+    // per counter position: owner tasks, waiting tasks, dfs state, cycle flag,
+    // dfs cursor and dfs stack. Then the graph "counter -> counter it waits
+    // for" in CSR form (first edge per counter + edge list).
+    const size_t words = stallReportWords(num_tasks, num_counters);
+    std::unique_lock<std::mutex> scratch_lock(report_mutex_, std::defer_lock);
+    uint32_t *mem = report_scratch_;
+    if (mem) {
+      // reports (the watchdog's too) take turns on the reserved scratch
+      scratch_lock.lock();
+    } else {
+      // aligned allocs need the size to be a multiple of the alignment (>= sizeof(void*))
+      const size_t bytes = (sizeof(uint32_t)*words + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+      mem = static_cast<uint32_t*>(params_.mem_callbacks.alloc_fn(alignof(uint32_t), bytes));
+    }
+    for(size_t i = 0; i < words; ++i) mem[i] = 0;
+    uint32_t *owners = mem;
+    uint32_t *waiting = owners + num_counters;
+    uint32_t *state = waiting + num_counters; // 0 new, 1 on the stack, 2 done
+    uint32_t *in_cycle = state + num_counters;
+    uint32_t *cursor = in_cycle + num_counters;
+    uint32_t *stack = cursor + num_counters;
+    uint32_t *first = stack + num_counters;
+    uint32_t *edge_from = first + num_counters + 1;
+    uint32_t *edge_to = edge_from + num_tasks;
+    uint32_t *adj = edge_to + num_tasks;
+
+    const uint32_t pos_mask = counters_.kPosMask;
+    forEachTask([owners, pos_mask](const TaskInfo &t) {
+      if (t.sync) owners[t.sync & pos_mask]++;
+    });
+
+    uint32_t num_edges = 0;
+    forEachSync([&](const SyncInfo &c) {
+      const uint32_t i = c.id & pos_mask;
+      forEachWaitingTask(c.id, [&](const TaskInfo &t) {
+        waiting[i]++;
+        if (t.sync && num_edges < num_tasks) {
+          edge_from[num_edges] = t.sync & pos_mask;
+          edge_to[num_edges] = i;
+          num_edges++;
+        }
+      });
+    });
+
+    for(uint32_t e = 0; e < num_edges; ++e) first[edge_from[e]+1]++;
+    for(uint32_t i = 0; i < num_counters; ++i) first[i+1] += first[i];
+    for(uint32_t e = 0; e < num_edges; ++e) {
+      uint32_t from = edge_from[e];
+      adj[first[from] + cursor[from]++] = edge_to[e];
+    }
+
+    // iterative DFS, a counter reached again while on the stack closes a cycle
+    for(uint32_t root = 0; root < num_counters; ++root) {
+      if (state[root] || first[root] == first[root+1]) continue;
+      uint32_t top = 0;
+      stack[top++] = root;
+      state[root] = 1;
+      cursor[root] = first[root];
+      while (top) {
+        uint32_t v = stack[top-1];
+        if (cursor[v] < first[v+1]) {
+          uint32_t u = adj[cursor[v]++];
+          if (state[u] == 0) {
+            state[u] = 1;
+            cursor[u] = first[u];
+            stack[top++] = u;
+          } else if (state[u] == 1) {
+            for(uint32_t k = top; k-- > 0;) {
+              in_cycle[stack[k]] = 1;
+              if (stack[k] == u) break;
+            }
+          }
+        } else {
+          state[v] = 2;
+          top--;
+        }
+      }
+    }
+
+    forEachSync([&](const SyncInfo &c) {
+      const uint32_t i = c.id & pos_mask;
+      StallReport::SyncInfo info;
+      info.sync = c.id;
+      info.pending = c.pending;
+      info.user_count = c.user_count;
+      info.owner_tasks = owners[i];
+      info.waiting_tasks = waiting[i];
+      info.waited = c.waited;
+      StallReport::SyncInfo *list = nullptr;
+      uint32_t *count = nullptr;
+      if (in_cycle[i]) {
+        list = r.cycles;
+        count = &r.num_cycles;
+      } else if (info.user_count && !info.owner_tasks && (info.waiting_tasks || info.waited)) {
+        list = r.orphans;
+        count = &r.num_orphans;
+      }
+      if (!list) return;
+      if (*count == StallReport::kMaxEntries) {
+        r.truncated = true;
+        return;
+      }
+      list[(*count)++] = info;
+    });
+    if (mem != report_scratch_) params_.mem_callbacks.free_fn(mem);
+  }
+
+  template<class JobT>
+  void BasicScheduler<JobT>::initReportScratch() {
+    // with static storage the MemCallbacks are never called, not even by
+    // the debug tools
+    report_scratch_ = nullptr;
+    if (storage_.end) {
+      report_scratch_ = static_cast<uint32_t*>(storage_.alloc(alignof(uint32_t),
+          sizeof(uint32_t)*stallReportWords(params_.max_number_tasks, numCounters())));
+    }
+  }
+}
+
+namespace px_sched {
+  template<class JobT>
+  BasicLane<JobT>::~BasicLane() {
+    PX_SCHED_CHECK_FN(pending_.load() == 0 && running_.load() == 0, "Lane destroyed with tasks still in flight");
+  }
+
+  template<class JobT>
+  void BasicLane<JobT>::init(BasicScheduler<JobT> *schd, uint16_t max_concurrency) {
+    PX_SCHED_CHECK_FN(pending_.load() == 0 && running_.load() == 0, "Lane re-initialized with tasks still in flight");
+    schd_ = schd;
+    max_concurrency_ = max_concurrency? max_concurrency : 1;
+  }
+
+  template<class JobT>
+  bool BasicLane<JobT>::run(Job &&job, Sync *out_sync_obj) {
+    PX_SCHED_CHECK_FN(schd_ != nullptr, "Lane not initialized");
+    uint32_t t_ref = schd_->createTaskWithPolicy(std::move(job), out_sync_obj, nullptr, schd_->helpOnOverflow());
+    if (!t_ref) return false;
+    schd_->tasks_.get(t_ref).lane = this;
+    schd_->runTaskChain(t_ref);
+    return true;
+  }
+
+  template<class JobT>
+  bool BasicLane<JobT>::runAfter(Sync sync, Job &&job, Sync *out_sync_obj) {
+    PX_SCHED_CHECK_FN(schd_ != nullptr, "Lane not initialized");
+    uint32_t t_ref = schd_->createTaskWithPolicy(std::move(job), out_sync_obj, nullptr, schd_->helpOnOverflow());
+    if (!t_ref) return false;
+    schd_->tasks_.get(t_ref).lane = this;
+    schd_->runTaskAfter(sync, t_ref);
+    return true;
+  }
+} // end of px_sched namespace
+
+#if PX_SCHED_IMP_SINGLE_THREAD
+
+namespace px_sched {
+  template<class JobT>
+  BasicScheduler<JobT>::BasicScheduler() {}
+  template<class JobT>
+  BasicScheduler<JobT>::~BasicScheduler() {}
+  template<class JobT>
+  void BasicScheduler<JobT>::init(const SchedulerParams &params) {
+    init(params, nullptr, 0);
+  }
+
+  template<class JobT>
+  void BasicScheduler<JobT>::init(const SchedulerParams &params, void *storage, size_t size) {
+    params_ = params;
+    storage_ = storage? detail::Storage(storage, size) : detail::Storage(params.mem_callbacks);
+    max_running_threads_.store(1);
+    tasks_.init(params_.max_number_tasks, &storage_);
+    counters_.init(numCounters(), &storage_);
+    initTimers();
+    initReportScratch();
+  }
+  template<class JobT>
+  void BasicScheduler<JobT>::stop() {
+    tasks_.reset();
+    counters_.reset();
+    timers_.reset();
+  }
+  template<class JobT>
+  bool BasicScheduler<JobT>::runImpl(Job &&job, Sync *s, const char *label, Clock::rep deadline, uint16_t) {
+    executeJob(job, label);
+    if (deadline != kNoDeadline) recordDeadline(deadline, label);
+    if (s) decrementSync(s);
+    return true;
+  }
+
+  template<class JobT>
+  bool BasicScheduler<JobT>::helpOnce() {
+    // tasks only run when their trigger is released by the user
+    return false;
+  }
+
+  template<class JobT>
+  void BasicScheduler<JobT>::waitFor(Sync s) {
+    waitUntil(s, nullptr);
+  }
+
+  template<class JobT>
+  bool BasicScheduler<JobT>::waitFor(Sync s, Clock::duration timeout) {
+    const Clock::time_point limit = Clock::now() + timeout;
+    return waitUntil(s, &limit);
+  }
+
+  template<class JobT>
+  bool BasicScheduler<JobT>::tryWait(Sync s) {
+    serviceTimers();
+    return numPendingTasks(s) == 0;
+  }
+
+  template<class JobT>
+  bool BasicScheduler<JobT>::waitUntil(Sync s, const Clock::time_point *limit) {
+    // only pending timers can release the sync object
+    while (counters_.refCount(s.hnd)) {
+      uint64_t next = timers_.next_tick.load();
+      if (limit) {
+        if (Clock::now() >= *limit) return false;
+        Clock::time_point t = *limit;
+        if (next != TimerWheel::kNone && tickToTime(next) < t) t = tickToTime(next);
+        std::this_thread::sleep_until(t);
+      } else {
+        PX_SCHED_CHECK_FN(next != TimerWheel::kNone, "Invalid, on SingleThreaded mode we can not wait for a sync object...");
+        if (next == TimerWheel::kNone) return false;
+        std::this_thread::sleep_until(tickToTime(next));
+      }
+      serviceTimers();
+    }
+    return true;
   }
 
-  void Scheduler::unrefCounter(uint32_t hnd) {
+  template<class JobT>
+  uint32_t BasicScheduler<JobT>::numPendingTasks(Sync s){
+    return counters_.refCount(s.hnd);
+  }
+
+  template<class JobT>
+  void BasicScheduler<JobT>::unrefCounter(uint32_t hnd) {
     if (counters_.ref(hnd)) {
       counters_.unref(hnd);
-      Scheduler *schd = this;
+      BasicScheduler *schd = this;
       counters_.unref(hnd, [schd](Counter &c) {
         // wake up all tasks 
-        uint32_t tid = c.task_id.load();
-        while (schd->tasks_.ref(tid)) {
-          Task &task = schd->tasks_.get(tid);
-          uint32_t next_tid = task.next_sibling_task.load(); 
-          uint32_t counter_id = task.counter_id;
-          task.next_sibling_task.store(0);
-          task.job(); // execute the task
-          schd->tasks_.unref(tid);
-          schd->unrefCounter(counter_id);
-          tid = next_tid;
-        }
+        schd->runTaskChain(c.task_id.load());
       });
     }
   }
 
-  void Scheduler::wakeUpOneThread() {}
+  template<class JobT>
+  void BasicScheduler<JobT>::runTaskChain(uint32_t tid) {
+    while (tasks_.ref(tid)) {
+      Task &task = tasks_.get(tid);
+      uint32_t next_tid = task.next_sibling_task.load();
+      uint32_t counter_id = task.counter_id;
+      task.next_sibling_task.store(0);
+      executeTask(task);
+      if (task.deadline != kNoDeadline) recordDeadline(task.deadline, taskLabel(task));
+      tasks_.unref(tid); // ref from the loop
+      tasks_.unref(tid); // ref from createTask
+      unrefCounter(counter_id);
+      tid = next_tid;
+    }
+  }
+
+  template<class JobT>
+  void BasicScheduler<JobT>::wakeUpOneThread() {}
+
+  template<class JobT>
+  void BasicScheduler<JobT>::setMaxRunningThreads(uint16_t) {}
+
+  template<class JobT>
+  BasicScheduler<JobT>::BlockingScope::BlockingScope(BasicScheduler *) {}
+  template<class JobT>
+  BasicScheduler<JobT>::BlockingScope::~BlockingScope() {}
 } // end of px namespace
 #endif // PX_SCHED_IMP_SINGLE_THREAD
 
@@ -887,211 +3343,559 @@ namespace px_sched {
 // Default implementation using threads 
 #include <thread>
 namespace px_sched {
-  Scheduler::Scheduler() {
+  template<class JobT>
+  BasicScheduler<JobT>::BasicScheduler() {
     active_threads_.store(0);
   }
 
-  Scheduler::~Scheduler() { stop(); }
+  template<class JobT>
+  BasicScheduler<JobT>::~BasicScheduler() { stop(); }
 
-  void Scheduler::init(const SchedulerParams &_params) {
+  template<class JobT>
+  void BasicScheduler<JobT>::init(const SchedulerParams &_params) {
+    init(_params, nullptr, 0);
+  }
+
+  template<class JobT>
+  void BasicScheduler<JobT>::init(const SchedulerParams &_params, void *storage, size_t size) {
     PX_SCHED_TRACE_FN("Init");
     stop();
     running_.store(true);
     params_ = _params;
+    storage_ = storage? detail::Storage(storage, size) : detail::Storage(params_.mem_callbacks);
     if (params_.max_running_threads == 0) {
       params_.max_running_threads = static_cast<uint16_t>(std::thread::hardware_concurrency());
     }
+    max_running_threads_.store(params_.max_running_threads);
     // create tasks
-    tasks_.init(params_.max_number_tasks, params_.mem_callbacks);
-    counters_.init(params_.max_number_tasks, params_.mem_callbacks);
-    ready_tasks_.init(params_.max_number_tasks, params_.mem_callbacks);
+    tasks_.init(params_.max_number_tasks, &storage_);
+    counters_.init(numCounters(), &storage_);
+    ready_tasks_.init(params_.max_number_tasks, params_.ready_order, &tasks_, &storage_);
+    initTimers();
+    initReportScratch();
     PX_SCHED_CHECK_FN(workers_ == nullptr, "workers_ ptr should be null here...");
-    workers_ = static_cast<Worker*>(params_.mem_callbacks.alloc_fn(alignof(Worker), sizeof(Worker)*params_.num_threads));
+    workers_ = static_cast<Worker*>(storage_.alloc(alignof(Worker), sizeof(Worker)*params_.num_threads));
+    if (params_.max_local_tasks) {
+      typedef typename LocalQueue::Entry Entry;
+      local_entries_ = static_cast<Entry*>(storage_.alloc(alignof(Entry), sizeof(Entry)*params_.max_local_tasks*params_.num_threads));
+    }
     for(uint16_t i = 0; i < params_.num_threads; ++i) {
       new (&workers_[i]) Worker();
       workers_[i].thread_index = i;
+      if (local_entries_) {
+        workers_[i].local.list_ = local_entries_ + i*params_.max_local_tasks;
+        workers_[i].local.capacity_ = params_.max_local_tasks;
+      }
     }
     PX_SCHED_CHECK_FN(active_threads_.load() == 0, "Invalid active threads num");
-    for(uint16_t i = 0; i < params_.num_threads; ++i) {
+    idle_head_.store(0);
+    uint16_t initial_threads = params_.num_threads;
+    if (params_.thread_retire_on_idle_in_microseconds && params_.min_threads < initial_threads) {
+      initial_threads = params_.min_threads;
+    }
+    live_threads_.store(initial_threads);
+    for(uint16_t i = 0; i < initial_threads; ++i) {
+      workers_[i].alive.store(1);
+      active_threads_.fetch_add(1);
       workers_[i].thread = std::thread(WorkerThreadMain, this, &workers_[i]);
     }
+    if (params_.watchdog_threshold_in_microseconds) {
+      watchdog_.quit = false;
+      watchdog_.thread = std::thread(WatchdogThreadMain, this);
+    }
   }
 
-  void Scheduler::stop() {
+  template<class JobT>
+  void BasicScheduler<JobT>::stop() {
     PX_SCHED_TRACE_FN("Stop");
     if (running_.load()) {
+      if (watchdog_.thread.joinable()) {
+        {
+          std::lock_guard<std::mutex> lk(watchdog_.mutex);
+          watchdog_.quit = true;
+          watchdog_.condition_variable.notify_all();
+        }
+        watchdog_.thread.join();
+      }
       running_.store(false);
+      // no more workers will be spawned after this point
+      { std::lock_guard<std::mutex> lk(spawn_mutex_); }
       for(uint16_t i = 0; i < params_.num_threads; ++i) {
         wakeUpThreads(params_.num_threads);
       }
       for(uint16_t i = 0; i < params_.num_threads; ++i) {
-        workers_[i].thread.join();
+        if (workers_[i].thread.joinable()) workers_[i].thread.join();
         workers_[i].~Worker();
       }
-      params_.mem_callbacks.free_fn(workers_);
+      live_threads_.store(0);
+      storage_.free(workers_);
       workers_ = nullptr;
+      if (local_entries_) {
+        storage_.free(local_entries_);
+        local_entries_ = nullptr;
+      }
       tasks_.reset();
       counters_.reset();
       ready_tasks_.reset();
+      timers_.reset();
       PX_SCHED_CHECK_FN(active_threads_.load() == 0, "Invalid active threads num --> %u", active_threads_.load());
     }
   }
   
-  void Scheduler::getDebugStatus(char *buffer, size_t buffer_size) {
-    PX_SCHED_TRACE_FN("GetDebugStatus");
-    size_t p = 0;
-    int n = 0;
-    #define _ADD(...) {p += static_cast<size_t>(n); (p < buffer_size) && (n = snprintf(buffer+p, buffer_size-p,__VA_ARGS__));}
-    _ADD("Workers:0    5    10   15   20   25   30   35   40   45   50   55   60   65   70   75\n");
-    _ADD("%3u/%3u:", active_threads_.load(), params_.max_running_threads);
-    for(size_t i = 0; i < params_.num_threads; ++i) {
-      _ADD( (workers_[i].wake_up.load() == nullptr)?"*":".");
-    }
-    _ADD("\nWorkers(%d):", params_.num_threads);
-    for(size_t i = 0; i < params_.num_threads; ++i) {
-      auto &w = workers_[i];
-      bool is_on =(w.wake_up.load() == nullptr);
-      if (!is_on) {
-        continue;
-      }
-      _ADD("\n  Worker: %d(%s) %s", w.thread_index, 
-          is_on?"ON":"OFF",
-          w.thread_tls->name? w.thread_tls->name: "-no-name-"
-          );
-    }
-    _ADD("\nReady: ");
-    for(uint32_t i = 0; i < ready_tasks_.in_use_; ++i) {
-      _ADD("%d,",ready_tasks_.list_[i]);
-    }
-    _ADD("\nTasks: ");
-    for(uint32_t i = 0; i < tasks_.size(); ++i) {
-      uint32_t c,v;
-      uint32_t hnd = tasks_.info(i, &c, &v);
-      if (c>0) { _ADD("%u,",hnd); }
+  template<class JobT>
+  void BasicScheduler<JobT>::pushIdle(uint16_t id) {
+    uint32_t not_in_stack = 0;
+    if (!workers_[id].in_idle_stack.compare_exchange_strong(not_in_stack, 1)) return;
+    uint64_t head = idle_head_.load();
+    for(;;) {
+      workers_[id].next_idle.store(static_cast<uint32_t>(head));
+      uint64_t next = (((head >> 32) + 1) << 32) | (static_cast<uint64_t>(id) + 1);
+      if (idle_head_.compare_exchange_weak(head, next)) return;
     }
-    _ADD("\nCounters:");
-    for(uint32_t i = 0; i < counters_.size(); ++i) {
-      uint32_t c,v;
-      uint32_t hnd = counters_.info(i, &c, &v);
-      if (c>0) { _ADD("%u,",hnd); }
+  }
+
+  template<class JobT>
+  bool BasicScheduler<JobT>::popIdle(uint16_t *id) {
+    uint64_t head = idle_head_.load();
+    for(;;) {
+      uint32_t top = static_cast<uint32_t>(head);
+      if (!top) return false;
+      uint64_t next = (((head >> 32) + 1) << 32) | workers_[top-1].next_idle.load();
+      if (idle_head_.compare_exchange_weak(head, next)) {
+        *id = static_cast<uint16_t>(top-1);
+        // from here the worker can push itself again (see WorkerThreadMain)
+        workers_[top-1].in_idle_stack.store(0);
+        return true;
+      }
     }
-    _ADD("\n");
-    #undef _ADD
   }
 
-  uint16_t Scheduler::wakeUpThreads(uint16_t max_num_threads) {
+  template<class JobT>
+  uint16_t BasicScheduler<JobT>::wakeUpThreads(uint16_t max_num_threads) {
     //PX_SCHED_TRACE_FN("WakeUpThreads");
     uint16_t total_woken_up = 0;
-    for(uint32_t i = 0; (i < params_.num_threads) && (total_woken_up < max_num_threads); ++i) {
+    uint16_t i;
+    while ((total_woken_up < max_num_threads) && popIdle(&i)) {
       WaitFor *wake_up = workers_[i].wake_up.exchange(nullptr);
       if (wake_up) {
+        // the thread is counted as active from now (before it actually is
+        // working again), so no more threads than needed are woken up
+        active_threads_.fetch_add(1);
         wake_up->signal();
         total_woken_up++;
-        // Add one to the total active threads, for later substracting it, this
-        // will take the thread as awake before the thread actually is again working
-        active_threads_.fetch_add(1);
       }
     }
-    active_threads_.fetch_sub(total_woken_up);
     return total_woken_up;
   }
 
-  void Scheduler::wakeUpOneThread() {
+  template<class JobT>
+  void BasicScheduler<JobT>::wakeUpOneThread() {
     PX_SCHED_TRACE_FN("WakeUpOneThread");
+    wakeUpThreadsFor(1);
+  }
+
+  template<class JobT>
+  void BasicScheduler<JobT>::wakeUpThreadsFor(uint16_t num_tasks) {
     // TODO: Investigate this, there is a situation where no matter how much we wait 
     //       it is unable to wakeup a single thread (Emscripten -> C++)
-    for(int tries = 0; tries < 1; ++tries) {
-      uint32_t active =  active_threads_.load();
-      if ((active >= params_.max_running_threads) ||
-          wakeUpThreads(1)) return;
-      // wait a bit...
-      std::this_thread::yield();
+    uint32_t active = active_threads_.load();
+    uint32_t max_running = max_running_threads_.load();
+    if (active >= max_running) return;
+    uint16_t wanted = (max_running - active < num_tasks)? static_cast<uint16_t>(max_running - active) : num_tasks;
+    uint16_t woken_up = wakeUpThreads(wanted);
+    // elastic pool: not enough workers were sleeping, start new ones
+    while (woken_up < wanted && live_threads_.load() < params_.num_threads) {
+      spawnWorker();
+      woken_up++;
+    }
+    // wait a bit...
+    if (!woken_up) std::this_thread::yield();
+  }
+
+  template<class JobT>
+  void BasicScheduler<JobT>::setMaxRunningThreads(uint16_t max_running) {
+    if (max_running == 0) {
+      max_running = static_cast<uint16_t>(std::thread::hardware_concurrency());
+    }
+    uint32_t prev = max_running_threads_.exchange(max_running);
+    if (max_running > prev && running_.load()) {
+      wakeUpThreads(static_cast<uint16_t>(max_running - prev));
     }
   }
 
-  void Scheduler::run(Job &&job, Sync *sync_obj) {
+  template<class JobT>
+  void BasicScheduler<JobT>::spawnWorker() {
+    PX_SCHED_TRACE_FN("SpawnWorker");
+    std::lock_guard<std::mutex> lk(spawn_mutex_);
+    if (!running_.load()) return;
+    for(uint16_t i = 0; i < params_.num_threads; ++i) {
+      uint32_t free_slot = 0;
+      if (workers_[i].alive.compare_exchange_strong(free_slot, 1)) {
+        // the previous thread of the slot (if any) has retired
+        if (workers_[i].thread.joinable()) workers_[i].thread.join();
+        live_threads_.fetch_add(1);
+        // counted as active from now, so the next wake up sees it
+        active_threads_.fetch_add(1);
+        workers_[i].thread = std::thread(WorkerThreadMain, this, &workers_[i]);
+        return;
+      }
+    }
+  }
+
+  template<class JobT>
+  bool BasicScheduler<JobT>::tryRetire() {
+    uint32_t live = live_threads_.load();
+    while (live > params_.min_threads) {
+      if (live_threads_.compare_exchange_weak(live, live-1)) return true;
+    }
+    return false;
+  }
+
+  template<class JobT>
+  bool BasicScheduler<JobT>::runImpl(Job &&job, Sync *sync_obj, const char *label, Clock::rep deadline, uint16_t hint_worker) {
     PX_SCHED_TRACE_FN("RunTask");
     PX_SCHED_CHECK_FN(running_.load(), "Scheduler not running");
-    uint32_t t_ref = createTask(std::move(job), sync_obj);
-    ready_tasks_.push(t_ref);
+    const OverflowPolicy policy = params_.overflow_policy;
+    uint32_t t_ref = createTaskWithPolicy(std::move(job), sync_obj, label, policy == OverflowPolicy::WaitAndHelp);
+    if (!t_ref) {
+      if (policy != OverflowPolicy::RunInline) return false;
+      // depth-first: the job is done before run returns, so the sync
+      // object has nothing to wait for
+      executeJob(job, label);
+      if (deadline != kNoDeadline) recordDeadline(deadline, label);
+      return true;
+    }
+    Task &task = tasks_.get(t_ref);
+    task.deadline = deadline;
+    task.hint_worker = hint_worker;
+    pushReady(t_ref);
+    return true;
+  }
+
+  template<class JobT>
+  bool BasicScheduler<JobT>::helpOnce() {
+    uint32_t tid;
+    TLS *tls_data = tls();
+    const uint16_t id = tls_data->scheduler == this? tls_data->worker_index : kNoWorker;
+    if (popTask(id, &tid)) {
+      runReadyTask(tid);
+    } else {
+      std::this_thread::yield();
+    }
+    return true;
+  }
+
+  template<class JobT>
+  uint32_t BasicScheduler<JobT>::runReadyTask(uint32_t tid, bool continuation) {
+    Task *t = &tasks_.get(tid);
+    executeTask(*t);
+    if (t->deadline != kNoDeadline) recordDeadline(t->deadline, taskLabel(*t));
+    uint32_t counter = t->counter_id;
+    // free the lane slot before the sync object can be released
+    if (t->lane) t->lane->release();
+    tasks_.unref(tid);
+    uint32_t next = 0;
+    unrefCounter(counter, continuation? &next : nullptr);
+    return next;
+  }
+
+  template<class JobT>
+  void BasicScheduler<JobT>::pushReady(uint32_t tid) {
+    const uint16_t hint = tasks_.get(tid).hint_worker;
+    if (hint != kNoWorker && pushLocal(tid, hint)) return;
+    ready_tasks_.push(tid);
     wakeUpOneThread();
   }
 
-  void Scheduler::runAfter(Sync _trigger, Job&& _job, Sync* _sync_obj) {
-    PX_SCHED_TRACE_FN("RunTaskAfter");
-    PX_SCHED_CHECK_FN(running_.load(), "Scheduler not running");
-    uint32_t trigger = _trigger.hnd;
-    uint32_t t_ref = createTask(std::move(_job), _sync_obj);
-    bool valid = counters_.ref(trigger);
-    if (valid) {
-      Counter *c = &counters_.get(trigger);
-      for(;;) {
-        uint32_t current = c->task_id.load();
-        if (c->task_id.compare_exchange_strong(current, t_ref)) {
-          Task *task = &tasks_.get(t_ref);
-          task->next_sibling_task.store(current);
-          break;
-        }
+  template<class JobT>
+  bool BasicScheduler<JobT>::pushLocal(uint32_t tid, uint16_t w) {
+    if (!local_entries_ || w >= params_.num_threads || !workers_[w].alive.load()) return false;
+    Worker &worker = workers_[w];
+    // a sleeping worker has to be woken up to take it
+    if (worker.wake_up.load() && active_threads_.load() >= max_running_threads_.load()) return false;
+    if (!worker.local.push(tid)) return false;
+    WaitFor *wake_up = worker.wake_up.exchange(nullptr);
+    TLS *tls_data = tls();
+    if (wake_up) {
+      active_threads_.fetch_add(1);
+      wake_up->signal();
+    } else if (tls_data->scheduler != this || w != tls_data->worker_index) {
+      // the worker is busy, somebody has to be awake to take the task if
+      // it waits for too long
+      wakeUpOneThread();
+    }
+    return true;
+  }
+
+  template<class JobT>
+  bool BasicScheduler<JobT>::popTask(uint16_t id, uint32_t *tid) {
+    const bool worker = id < params_.num_threads;
+    if (worker && workers_[id].local.pop(tid)) return true;
+    if (ready_tasks_.pop(tid)) return true;
+    if (!local_entries_) return false;
+    bool has_limit = false;
+    Clock::rep limit = 0;
+    for(uint16_t i = worker? 1 : 0; i < params_.num_threads; ++i) {
+      LocalQueue &q = workers_[(worker? id+i : i)%params_.num_threads].local;
+      if (!q.size()) continue;
+      if (!has_limit) {
+        limit = (Clock::now() - std::chrono::microseconds(params_.local_steal_after_in_microseconds)).time_since_epoch().count();
+        has_limit = true;
       }
-      unrefCounter(trigger);
+      if (q.pop(tid, limit)) return true;
+    }
+    return false;
+  }
+
+  template<class JobT>
+  bool BasicScheduler<JobT>::anyLocalTasks() const {
+    if (!local_entries_) return false;
+    for(uint16_t i = 0; i < params_.num_threads; ++i) {
+      if (workers_[i].local.size()) return true;
+    }
+    return false;
+  }
+
+  template<class JobT>
+  void BasicScheduler<JobT>::pushReady(const uint32_t *tids, uint16_t n) {
+    ready_tasks_.pushN(tids, n);
+    wakeUpThreadsFor(n);
+  }
+
+  template<class JobT>
+  void BasicScheduler<JobT>::launchTask(uint32_t tid) {
+    Lane *lane = tasks_.get(tid).lane;
+    if (lane) {
+      lane->push(tid);
     } else {
-      ready_tasks_.push(t_ref);
-      wakeUpOneThread();
+      pushReady(tid);
     }
   }
 
-  void Scheduler::waitFor(Sync s) {
+  template<class JobT>
+  void BasicLane<JobT>::push(uint32_t tid) {
+    schd_->tasks_.get(tid).next_sibling_task.store(0);
+    lock();
+    if (last_) {
+      schd_->tasks_.get(last_).next_sibling_task.store(tid);
+    } else {
+      first_ = tid;
+    }
+    last_ = tid;
+    pending_.fetch_add(1);
+    unlock();
+    promote();
+  }
+
+  template<class JobT>
+  void BasicLane<JobT>::promote() {
+    // move pending tasks to the ready queue while there are free slots
+    while (pending_.load() > 0) {
+      uint32_t running = running_.load();
+      if (running >= max_concurrency_) return;
+      if (!running_.compare_exchange_weak(running, running+1)) continue;
+      uint32_t tid = 0;
+      lock();
+      if (first_) {
+        tid = first_;
+        first_ = schd_->tasks_.get(tid).next_sibling_task.load();
+        if (!first_) last_ = 0;
+        pending_.fetch_sub(1);
+      }
+      unlock();
+      if (tid) {
+        schd_->tasks_.get(tid).next_sibling_task.store(0);
+        schd_->pushReady(tid);
+      } else {
+        // somebody else took it, give the slot back
+        running_.fetch_sub(1);
+      }
+    }
+  }
+
+  template<class JobT>
+  void BasicLane<JobT>::release() {
+    running_.fetch_sub(1);
+    promote();
+  }
+
+  template<class JobT>
+  void BasicScheduler<JobT>::waitFor(Sync s) {
+    waitUntil(s, nullptr);
+  }
+
+  template<class JobT>
+  bool BasicScheduler<JobT>::waitFor(Sync s, Clock::duration timeout) {
+    const Clock::time_point limit = Clock::now() + timeout;
+    return waitUntil(s, &limit);
+  }
+
+  template<class JobT>
+  bool BasicScheduler<JobT>::tryWait(Sync s) {
+    return numPendingTasks(s) == 0;
+  }
+
+  template<class JobT>
+  bool BasicScheduler<JobT>::waitUntil(Sync s, const Clock::time_point *limit) {
     PX_SCHED_TRACE_FN("WaitFor");
-    if (counters_.ref(s.hnd)) {
+    if (!counters_.ref(s.hnd)) return true;
+    WaitFor wf;
+    {
+      // our reference keeps the counter alive (and its waiters unreleased)
+      std::lock_guard<std::mutex> lk(waiters_mutex_);
       Counter &counter = counters_.get(s.hnd);
-      PX_SCHED_CHECK_FN(counter.wait_ptr == nullptr, "Sync object already used for waitFor operation, only one is permitted");
-      WaitFor wf;
-      counter.wait_ptr = &wf;
+      wf.counter = s.hnd;
+      wf.next = counter.wait_ptr.load();
+      wf.listed = true;
+      counter.wait_ptr.store(&wf);
+    }
+    {
+      // let other workers run the tasks we are waiting for
+      BlockingScope blocking(this);
       unrefCounter(s.hnd);
-      wf.wait();
+      if (limit) {
+        wf.waitUntil(*limit);
+      } else {
+        wf.wait();
+      }
+    }
+    // still listed means the time was reached, the counter is alive until
+    // it is released (and that needs the lock). Otherwise the lock also
+    // ensures releaseWaiters is done with wf.
+    std::lock_guard<std::mutex> lk(waiters_mutex_);
+    if (!wf.listed) return true;
+    Counter &counter = counters_.get(wf.counter);
+    WaitFor *prev = nullptr;
+    for(WaitFor *w = counter.wait_ptr.load(); w != &wf; w = w->next) prev = w;
+    if (prev) {
+      prev->next = wf.next;
+    } else {
+      counter.wait_ptr.store(wf.next);
     }
+    return false;
   }
 
-  uint32_t Scheduler::numPendingTasks(Sync s) {
-    return counters_.refCount(s.hnd);
+  template<class JobT>
+  void BasicScheduler<JobT>::releaseWaiters(Counter &c) {
+    std::lock_guard<std::mutex> lk(waiters_mutex_);
+    WaitFor *w = c.wait_ptr.load();
+    c.wait_ptr.store(nullptr);
+    while (w) {
+      WaitFor *next = w->next;
+      w->listed = false;
+      w->signal();
+      w = next;
+    }
+  }
+
+  template<class JobT>
+  BasicScheduler<JobT>::BlockingScope::BlockingScope(BasicScheduler *schd) {
+    PX_SCHED_TRACE_FN("BlockingScope");
+    if (!schd || tls()->scheduler != schd || !schd->running_.load()) return;
+    uint32_t cap = schd->params_.max_blocked_threads? schd->params_.max_blocked_threads : schd->params_.num_threads;
+    if (schd->blocked_threads_.fetch_add(1) >= cap) {
+      schd->blocked_threads_.fetch_sub(1);
+      return;
+    }
+    schd_ = schd;
+    schd->active_threads_.fetch_sub(1);
+    // tasks hinted to this worker wait for somebody awake to take them
+    if (schd->ready_tasks_.in_use() || schd->anyLocalTasks()) schd->wakeUpOneThread();
+  }
+
+  template<class JobT>
+  BasicScheduler<JobT>::BlockingScope::~BlockingScope() {
+    if (!schd_) return;
+    // might go above max running threads for a while, the extra worker
+    // will go to sleep after its current task
+    schd_->active_threads_.fetch_add(1);
+    schd_->blocked_threads_.fetch_sub(1);
   }
 
-  void Scheduler::unrefCounter(uint32_t hnd) {
+  template<class JobT>
+  uint32_t BasicScheduler<JobT>::numPendingTasks(Sync s) {
+    // 1 is a counter being released (its waiters might already be awake)
+    uint32_t n = counters_.refCount(s.hnd);
+    return n > 1? n : 0;
+  }
+
+  template<class JobT>
+  void BasicScheduler<JobT>::unrefCounter(uint32_t hnd) {
+    unrefCounter(hnd, nullptr);
+  }
+
+  template<class JobT>
+  void BasicScheduler<JobT>::unrefCounter(uint32_t hnd, uint32_t *continuation) {
     PX_SCHED_TRACE_FN("UnrefCounter");
     if (counters_.ref(hnd)) {
       counters_.unref(hnd);
-      Scheduler *schd = this;
-      counters_.unref(hnd, [schd](Counter &c) {
-        // wake up all tasks 
-        uint32_t tid = c.task_id.load();
-        while (schd->tasks_.ref(tid)) {
-          Task &task = schd->tasks_.get(tid);
-          uint32_t next_tid = task.next_sibling_task.load(); 
-          task.next_sibling_task.store(0);
-          schd->ready_tasks_.push(tid);
-          schd->wakeUpOneThread();
-          schd->tasks_.unref(tid);
-          tid = next_tid;
+      BasicScheduler *schd = this;
+      counters_.unref(hnd, [schd, continuation](Counter &c) {
+        uint32_t first = c.task_id.load();
+        // the counter is released, its chain of tasks can not grow anymore
+        if (continuation && schd->tasks_.ref(first)) {
+          const Task &t = schd->tasks_.get(first);
+          const bool single = t.next_sibling_task.load() == 0 && t.lane == nullptr && t.hint_worker == kNoWorker;
+          schd->tasks_.unref(first);
+          if (single) {
+            *continuation = first;
+            first = 0;
+          }
         }
-        if (c.wait_ptr) {
-          c.wait_ptr->signal();
+        // wake up all tasks 
+        schd->runTaskChain(first);
+        if (c.wait_ptr.load()) {
+          schd->releaseWaiters(c);
         }
       });
     }
   }
 
-  void Scheduler::WorkerThreadMain(Scheduler *schd, Scheduler::Worker *worker_data) {
+  template<class JobT>
+  void BasicScheduler<JobT>::runTaskChain(uint32_t tid) {
+    // tasks go to the ready queue in batches: one lock and one wake up pass
+    // per batch instead of per task
+    const uint16_t kBatchSize = 64;
+    uint32_t batch[kBatchSize];
+    uint16_t batch_size = 0;
+    while (tasks_.ref(tid)) {
+      Task &task = tasks_.get(tid);
+      uint32_t next_tid = task.next_sibling_task.load();
+      task.next_sibling_task.store(0);
+      if (task.lane) {
+        task.lane->push(tid);
+      } else if (task.hint_worker != kNoWorker) {
+        pushReady(tid);
+      } else {
+        batch[batch_size++] = tid;
+        if (batch_size == kBatchSize) {
+          pushReady(batch, batch_size);
+          batch_size = 0;
+        }
+      }
+      tasks_.unref(tid);
+      tid = next_tid;
+    }
+    if (batch_size) pushReady(batch, batch_size);
+  }
+
+  template<class JobT>
+  void BasicScheduler<JobT>::WorkerThreadMain(BasicScheduler *schd, Worker *worker_data) {
     char buffer[16];
 
     const uint16_t id = worker_data->thread_index;
     TLS *local_storage = tls();
 
     local_storage->scheduler = schd;
+    local_storage->worker_index = id;
     worker_data->thread_tls = local_storage;
+    worker_data->local.open();
 
     auto const ttl_wait = schd->params_.thread_sleep_on_idle_in_microseconds;
     auto const ttl_value = schd->params_.thread_num_tries_on_idle? schd->params_.thread_num_tries_on_idle:1;
-    schd->active_threads_.fetch_add(1);
+    const bool watchdog = schd->params_.watchdog_threshold_in_microseconds != 0;
+    const auto retire_timeout = std::chrono::microseconds(schd->params_.thread_retire_on_idle_in_microseconds);
+    // note: active_threads_ was already incremented by the creator
     snprintf(buffer,16,"Worker-%u", id);
     schd->set_current_thread_name(buffer);
     for(;;) {
@@ -1099,14 +3903,87 @@ namespace px_sched {
         PX_SCHED_TRACE_FN("WorkerGoToSleep");
         auto current_num = schd->active_threads_.fetch_sub(1);
         if (!schd->running_.load()) return;
-        if (schd->ready_tasks_.in_use() == 0 ||
-            current_num > schd->params_.max_running_threads) {
+        schd->serviceTimers();
+        if ((schd->ready_tasks_.in_use() == 0 && worker_data->local.size() == 0) ||
+            current_num > schd->max_running_threads_.load()) {
           WaitFor wf;
+          // wake_up must be visible before the worker is in the idle stack, as
+          // popIdle clears in_idle_stack before looking at wake_up
           schd->workers_[id].wake_up.store(&wf);
-          wf.wait();
-          if (!schd->running_.load()) return;
+          schd->pushIdle(id);
+          if (!schd->running_.load()) {
+            // stop() might have missed us, unless it is waking us already
+            if (schd->workers_[id].wake_up.exchange(nullptr) != &wf) {
+              wf.wait();
+              schd->active_threads_.fetch_sub(1);
+            }
+            return;
+          }
+          // only one worker sleeps until the next timer deadline
+          uint64_t tick = schd->timers_.next_tick.load();
+          uint64_t keeper = schd->timers_.keeper_tick.load();
+          bool timed = false;
+          while (!timed && tick < keeper) {
+            timed = schd->timers_.keeper_tick.compare_exchange_weak(keeper, tick);
+          }
+          // tasks in local queues (ours too, it might have arrived before
+          // wake_up was visible) are taken once they waited for too long
+          const bool local_tasks = schd->anyLocalTasks();
+          // wakeUpThreads counts the woken up workers as active, workers
+          // waking up by themselves (timeouts) have to do it
+          bool woken = true;
+          if (timed || local_tasks) {
+            Clock::time_point limit = timed? schd->tickToTime(tick) : Clock::time_point::max();
+            if (local_tasks) {
+              Clock::time_point steal = Clock::now() + std::chrono::microseconds(schd->params_.local_steal_after_in_microseconds);
+              if (steal < limit) limit = steal;
+            }
+            if (!wf.waitUntil(limit)) {
+              if (schd->workers_[id].wake_up.exchange(nullptr) != &wf) {
+                // somebody else is already waking us up
+                wf.wait();
+              } else {
+                woken = false;
+              }
+            }
+            if (timed) schd->timers_.keeper_tick.compare_exchange_strong(tick, TimerWheel::kNone);
+          } else if (retire_timeout.count()) {
+            if (!wf.waitUntil(Clock::now() + retire_timeout)) {
+              if (schd->workers_[id].wake_up.exchange(nullptr) != &wf) {
+                // somebody else is already waking us up
+                wf.wait();
+              } else if (schd->tryRetire()) {
+                // free the slot, unless a task arrived meanwhile and the slot
+                // was not taken yet by a new worker
+                uint32_t alive = 0;
+                worker_data->alive.store(0);
+                if (schd->ready_tasks_.in_use() == 0 ||
+                    !worker_data->alive.compare_exchange_strong(alive, 1)) {
+                  // tasks hinted to us go to the ready queue
+                  worker_data->local.close();
+                  uint32_t task_ref;
+                  while (worker_data->local.pop(&task_ref)) schd->pushReady(task_ref);
+                  break;
+                }
+                schd->live_threads_.fetch_add(1);
+                woken = false;
+              } else {
+                schd->workers_[id].wake_up.store(&wf);
+                schd->pushIdle(id);
+                wf.wait();
+              }
+            }
+          } else {
+            wf.wait();
+          }
+          if (!woken) schd->active_threads_.fetch_add(1);
+          if (!schd->running_.load()) {
+            schd->active_threads_.fetch_sub(1);
+            return;
+          }
+        } else {
+          schd->active_threads_.fetch_add(1);
         }
-        schd->active_threads_.fetch_add(1);
         schd->workers_[id].wake_up.store(nullptr);
       }
       auto ttl = ttl_value;
@@ -1114,28 +3991,80 @@ namespace px_sched {
         PX_SCHED_TRACE_FN("WorkerRunning");
         uint32_t task_ref;
         while (ttl && schd->running_.load()) {
-          if (!schd->ready_tasks_.pop(&task_ref)) {
+          if (!schd->popTask(id, &task_ref)) {
             PX_SCHED_TRACE_FN("No Task->sleep");
             ttl--;
             if (ttl_wait) std::this_thread::sleep_for(std::chrono::microseconds(ttl_wait));
             continue;
           }
           ttl = ttl_value;
-          Task *t = &schd->tasks_.get(task_ref);
-          t->job();
-          uint32_t counter = t->counter_id;
-          schd->tasks_.unref(task_ref);
-          schd->unrefCounter(counter);
+          // the successor released by a task runs next on this worker (not
+          // with EarliestDeadline, where it has to compete with the others)
+          const bool continuation = !schd->ready_tasks_.by_deadline_;
+          for(uint32_t chained = 0; task_ref; ++chained) {
+            if (watchdog) {
+              worker_data->current_task_start.store(Clock::now().time_since_epoch().count());
+              worker_data->current_task.store(task_ref);
+            }
+            task_ref = schd->runReadyTask(task_ref, continuation);
+            if (watchdog) {
+              worker_data->current_task.store(0);
+              worker_data->tasks_done.store(worker_data->tasks_done.load()+1);
+            }
+            if (task_ref && (chained+1 == kMaxContinuations ||
+                schd->active_threads_.load() > schd->max_running_threads_.load())) {
+              schd->pushReady(task_ref);
+              task_ref = 0;
+            }
+          }
+          // too many running threads (see setMaxRunningThreads)
+          if (schd->active_threads_.load() > schd->max_running_threads_.load()) break;
         }
       }
     }
     worker_data->thread_tls = nullptr;
     local_storage->scheduler = nullptr;
+    local_storage->worker_index = kNoWorker;
+    schd->set_current_thread_name(nullptr);
+  }
+
+  template<class JobT>
+  void BasicScheduler<JobT>::WatchdogThreadMain(BasicScheduler *schd) {
+    schd->set_current_thread_name("Watchdog");
+    const uint32_t threshold = schd->params_.watchdog_threshold_in_microseconds;
+    uint32_t last_done = 0;
+    StallReport report;
+    std::unique_lock<std::mutex> lk(schd->watchdog_.mutex);
+    for(;;) {
+      Watchdog &wd = schd->watchdog_;
+      if (wd.condition_variable.wait_for(lk, std::chrono::microseconds(threshold), [&wd]{ return wd.quit; })) break;
+      lk.unlock();
+      uint32_t done = 0;
+      for(uint16_t i = 0; i < schd->params_.num_threads; ++i) {
+        done += schd->workers_[i].tasks_done.load();
+      }
+      schd->getStallReport(&report, threshold);
+      report.progress = (done != last_done);
+      last_done = done;
+      if (report.num_long_tasks || report.num_cycles ||
+          (report.num_orphans && !report.progress)) {
+        if (schd->params_.watchdog_fn) {
+          schd->params_.watchdog_fn(report, schd->params_.watchdog_user_data);
+        } else {
+          char buffer[2048];
+          report.format(buffer, sizeof(buffer));
+          printf("-- PX_SCHED WATCHDOG: ----------------\n%s", buffer);
+        }
+      }
+      lk.lock();
+    }
     schd->set_current_thread_name(nullptr);
   }
 } // end of px_sched namespace
 #endif // PX_SCHED_IMP_REGULAR_THREADS
 
+PX_SCHED_INSTANTIATE(px_sched::Job);
+
 #endif // PX_SCHED_IMPLEMENTATION_DONE
 
 #endif // PX_SCHED_IMPLEMENTATION
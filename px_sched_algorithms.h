@@ -0,0 +1,621 @@
+/* -----------------------------------------------------------------------------
+Copyright (c) 2017-2023 Jose L. Hidalgo (PpluX)
+
+  px_sched_algorithms.h - Parallel algorithms on top of px_sched
+  parallel_for, parallel_sort, parallel_inclusive_scan, parallel_partition,
+  parallel_transform_reduce and Pipeline. They split the work in chunks
+  launched as regular tasks of the given Scheduler (no threads of their own)
+  and wait for them to finish, temporary memory is requested through the
+  scheduler memory callbacks.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+----------------------------------------------------------------------------- */
+
+// USAGE
+//
+// Header only, px_sched_algorithms must be included *AFTER* px_sched.h
+//
+// All algorithms work with random access iterators, and wait (waitFor) for
+// the launched tasks before returning. Jobs are built from lambdas so the
+// default job definition (std::function) is required. Tasks rejected by the
+// scheduler (OverflowPolicy::Fail) run on the thread that launched them.
+
+#ifndef PX_SCHED_ALGORITHMS
+#define PX_SCHED_ALGORITHMS
+
+#ifndef PX_SCHED
+#error px_sched must be included before px_sched_algorithms (because algorithms plugin does not include px_sched.h)
+#endif
+
+#ifdef PX_SCHED_CUSTOM_JOB_DEFINITION
+#error px_sched_algorithms needs the default job definition (std::function<void()>)
+#endif
+
+#include <algorithm>
+#include <iterator>
+#include <mutex>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+// minimum number of elements processed by one task
+#ifndef PX_SCHED_ALGORITHMS_MIN_CHUNK
+#define PX_SCHED_ALGORITHMS_MIN_CHUNK 2048
+#endif
+
+namespace px_sched {
+
+  // Runs fn(chunk_begin, chunk_end) over [begin, end) split in chunks of at
+  // least min_chunk elements.
+  template<class F>
+  void parallel_for(Scheduler &schd, size_t begin, size_t end, size_t min_chunk, F fn);
+
+  // Sorts [first, last) (stable parallel merge sort). Elements must be default
+  // constructible and movable.
+  template<class It, class Compare>
+  void parallel_sort(Scheduler &schd, It first, It last, Compare cmp);
+  template<class It>
+  void parallel_sort(Scheduler &schd, It first, It last);
+
+  // out[i] = in[0] op in[1] op ... op in[i], op must be associative. out can be
+  // the same as first (in place).
+  template<class It, class OutIt, class BinaryOp>
+  OutIt parallel_inclusive_scan(Scheduler &schd, It first, It last, OutIt out, BinaryOp op);
+  template<class It, class OutIt>
+  OutIt parallel_inclusive_scan(Scheduler &schd, It first, It last, OutIt out);
+
+  // Moves the elements that satisfy pred before the ones that don't, keeping
+  // their relative order (as std::stable_partition). Returns the iterator to
+  // the first element of the second group. pred is evaluated twice per
+  // element. Elements must be default constructible and movable.
+  template<class It, class Pred>
+  It parallel_partition(Scheduler &schd, It first, It last, Pred pred);
+
+  // init reduce transform(first[0]) reduce transform(first[1]) ..., reduce
+  // must be associative (but does not need to be commutative).
+  template<class It, class T, class Reduce, class Transform>
+  T parallel_transform_reduce(Scheduler &schd, It first, It last, T init, Reduce reduce, Transform transform);
+
+  // Linear pipeline (as TBB's parallel_pipeline): the input produces items
+  // that go through the stages in order, with at most max_tokens items in
+  // flight. Items are identified by a token (0..max_tokens-1), use it to
+  // index the buffers holding the item being processed, so memory use is
+  // bounded by max_tokens. Serial stages process one item at a time in the
+  // order produced by the input, parallel stages any number at once.
+  //
+  //    std::vector<Chunk> slots(8);
+  //    px_sched::Pipeline()
+  //      .input([&](size_t t) { return read(&slots[t]); })
+  //      .stage(px_sched::Pipeline::Mode::Parallel, [&](size_t t) { parse(&slots[t]); })
+  //      .stage(px_sched::Pipeline::Mode::SerialInOrder, [&](size_t t) { index(slots[t]); })
+  //      .run(schd, slots.size());
+  class Pipeline {
+  public:
+    enum class Mode {
+      SerialInOrder, // one item at a time, in input order
+      Parallel,      // any number of items at once
+    };
+    // fn(token) fills the token's buffers with the next item, returns false
+    // when there is no more input. It is called serially.
+    Pipeline& input(std::function<bool(size_t token)> fn);
+    Pipeline& stage(Mode mode, std::function<void(size_t token)> fn);
+    // waits until every item has gone through all the stages
+    void run(Scheduler &schd, size_t max_tokens);
+
+  private:
+    struct Stage {
+      Mode mode;
+      std::function<void(size_t token)> fn;
+    };
+    struct Run;
+    std::function<bool(size_t token)> input_;
+    std::vector<Stage> stages_;
+  };
+
+  //-- Implementation ----------------------------------------------------------
+  namespace algorithms_detail {
+
+    inline size_t num_chunks(const Scheduler &schd, size_t n, size_t min_chunk) {
+      if (min_chunk == 0) min_chunk = 1;
+      size_t max_chunks = static_cast<size_t>(schd.params().num_threads)*4;
+      // leave room for other tasks running at the same time
+      size_t max_tasks = schd.params().max_number_tasks/2;
+      if (max_chunks > max_tasks) max_chunks = max_tasks;
+      if (max_chunks == 0) max_chunks = 1;
+      size_t chunks = (n + min_chunk - 1)/min_chunk;
+      if (chunks > max_chunks) chunks = max_chunks;
+      return chunks? chunks : 1;
+    }
+
+    inline size_t chunk_begin(size_t n, size_t chunks, size_t c) {
+      return (n/chunks)*c + std::min(c, n%chunks);
+    }
+
+    // Temporary array allocated with the scheduler memory callbacks
+    template<class T>
+    class Buffer {
+    public:
+      Buffer(const Scheduler &schd, size_t n) : mem_(schd.params().mem_callbacks), size_(n) {
+        data_ = static_cast<T*>(mem_.alloc_fn(alignof(T), sizeof(T)*(n? n : 1)));
+      }
+      ~Buffer() {
+        for(size_t i = 0; i < constructed_; ++i) data_[i].~T();
+        mem_.free_fn(data_);
+      }
+      Buffer(const Buffer&) = delete;
+      Buffer& operator=(const Buffer&) = delete;
+      // default constructs all elements (in parallel)
+      void construct_all(Scheduler &schd) {
+        T *d = data_;
+        parallel_for(schd, 0, size_, PX_SCHED_ALGORITHMS_MIN_CHUNK*4, [d](size_t b, size_t e) {
+          for(size_t i = b; i < e; ++i) new (&d[i]) T();
+        });
+        constructed_ = size_;
+      }
+      // copy constructs one element (elements must be added in order)
+      void push(const T &v) { new (&data_[constructed_++]) T(v); }
+      T& operator[](size_t i) { return data_[i]; }
+      T* data() { return data_; }
+    private:
+      MemCallbacks mem_;
+      T *data_ = nullptr;
+      size_t size_ = 0;
+      size_t constructed_ = 0;
+    };
+
+    // number of elements taken from a (the rest from b) to produce the first k
+    // elements of the stable merge of a and b
+    template<class ItA, class ItB, class Compare>
+    size_t merge_split(ItA a, size_t na, ItB b, size_t nb, size_t k, Compare &cmp) {
+      size_t lo = (k > nb)? k - nb : 0;
+      size_t hi = (k < na)? k : na;
+      while (lo < hi) {
+        size_t i = lo + (hi - lo)/2;
+        size_t j = k - i;
+        // a[i] goes before b[j-1] (ties taken from a first) -> need more from a
+        if (j > 0 && !cmp(b[static_cast<std::ptrdiff_t>(j-1)], a[static_cast<std::ptrdiff_t>(i)])) {
+          lo = i+1;
+        } else {
+          hi = i;
+        }
+      }
+      return lo;
+    }
+
+    template<class Src, class Dst, class Compare>
+    void parallel_merge_pass(Scheduler &schd, Src src, Dst dst, size_t n, size_t run, size_t chunks, Compare &cmp) {
+      Sync s;
+      const size_t num_runs = (n + run - 1)/run;
+      const size_t num_pairs = (num_runs+1)/2;
+      size_t parts = chunks/num_pairs;
+      if (parts == 0) parts = 1;
+      for(size_t p = 0; p < num_pairs; ++p) {
+        const size_t a_begin = p*2*run;
+        const size_t a_size = std::min(run, n - a_begin);
+        const size_t b_begin = a_begin + a_size;
+        const size_t b_size = std::min(run, n - b_begin);
+        const size_t total = a_size + b_size;
+        size_t num_parts = std::min(parts, (total + PX_SCHED_ALGORITHMS_MIN_CHUNK - 1)/PX_SCHED_ALGORITHMS_MIN_CHUNK);
+        if (num_parts == 0) num_parts = 1;
+        for(size_t part = 0; part < num_parts; ++part) {
+          auto merge = [=, &cmp] {
+            Src a = src + static_cast<std::ptrdiff_t>(a_begin);
+            Src b = src + static_cast<std::ptrdiff_t>(b_begin);
+            size_t k0 = chunk_begin(total, num_parts, part);
+            size_t k1 = chunk_begin(total, num_parts, part+1);
+            size_t i0 = merge_split(a, a_size, b, b_size, k0, cmp);
+            size_t i1 = merge_split(a, a_size, b, b_size, k1, cmp);
+            std::merge(
+                std::make_move_iterator(a + static_cast<std::ptrdiff_t>(i0)),
+                std::make_move_iterator(a + static_cast<std::ptrdiff_t>(i1)),
+                std::make_move_iterator(b + static_cast<std::ptrdiff_t>(k0 - i0)),
+                std::make_move_iterator(b + static_cast<std::ptrdiff_t>(k1 - i1)),
+                dst + static_cast<std::ptrdiff_t>(a_begin + k0), cmp);
+          };
+          // rejected by the scheduler (OverflowPolicy::Fail), merge it here
+          if (!schd.run(merge, &s)) merge();
+        }
+      }
+      schd.waitFor(s);
+    }
+  } // algorithms_detail
+
+  template<class F>
+  void parallel_for(Scheduler &schd, size_t begin, size_t end, size_t min_chunk, F fn) {
+    PX_SCHED_TRACE_FN("parallel_for");
+    if (end <= begin) return;
+    const size_t n = end - begin;
+    const size_t chunks = algorithms_detail::num_chunks(schd, n, min_chunk);
+    if (chunks == 1) {
+      fn(begin, end);
+      return;
+    }
+    Sync s;
+    for(size_t c = 0; c < chunks; ++c) {
+      size_t b = begin + algorithms_detail::chunk_begin(n, chunks, c);
+      size_t e = begin + algorithms_detail::chunk_begin(n, chunks, c+1);
+      if (!schd.run([&fn, b, e] { fn(b, e); }, &s)) fn(b, e);
+    }
+    schd.waitFor(s);
+  }
+
+  template<class It, class Compare>
+  void parallel_sort(Scheduler &schd, It first, It last, Compare cmp) {
+    PX_SCHED_TRACE_FN("parallel_sort");
+    typedef typename std::iterator_traits<It>::value_type T;
+    const size_t n = static_cast<size_t>(last - first);
+    const size_t chunks = algorithms_detail::num_chunks(schd, n, PX_SCHED_ALGORITHMS_MIN_CHUNK);
+    if (chunks == 1) {
+      std::stable_sort(first, last, cmp);
+      return;
+    }
+    // (1) sort every chunk
+    size_t run = (n + chunks - 1)/chunks;
+    parallel_for(schd, 0, chunks, 1, [&](size_t b, size_t e) {
+      for(size_t c = b; c < e; ++c) {
+        size_t r0 = std::min(n, c*run);
+        size_t r1 = std::min(n, (c+1)*run);
+        std::stable_sort(first + static_cast<std::ptrdiff_t>(r0), first + static_cast<std::ptrdiff_t>(r1), cmp);
+      }
+    });
+    // (2) merge sorted runs in pairs, back and forth from the temporary buffer
+    algorithms_detail::Buffer<T> tmp(schd, n);
+    tmp.construct_all(schd);
+    bool in_tmp = false;
+    for(; run < n; run *= 2) {
+      if (in_tmp) {
+        algorithms_detail::parallel_merge_pass(schd, tmp.data(), first, n, run, chunks, cmp);
+      } else {
+        algorithms_detail::parallel_merge_pass(schd, first, tmp.data(), n, run, chunks, cmp);
+      }
+      in_tmp = !in_tmp;
+    }
+    if (in_tmp) {
+      T *src = tmp.data();
+      parallel_for(schd, 0, n, PX_SCHED_ALGORITHMS_MIN_CHUNK, [src, first](size_t b, size_t e) {
+        std::move(src + b, src + e, first + static_cast<std::ptrdiff_t>(b));
+      });
+    }
+  }
+
+  template<class It>
+  void parallel_sort(Scheduler &schd, It first, It last) {
+    typedef typename std::iterator_traits<It>::value_type T;
+    parallel_sort(schd, first, last, std::less<T>());
+  }
+
+  template<class It, class OutIt, class BinaryOp>
+  OutIt parallel_inclusive_scan(Scheduler &schd, It first, It last, OutIt out, BinaryOp op) {
+    PX_SCHED_TRACE_FN("parallel_inclusive_scan");
+    typedef typename std::iterator_traits<It>::value_type T;
+    const size_t n = static_cast<size_t>(last - first);
+    if (n == 0) return out;
+    const size_t chunks = algorithms_detail::num_chunks(schd, n, PX_SCHED_ALGORITHMS_MIN_CHUNK);
+    if (chunks == 1) return std::partial_sum(first, last, out, op);
+    // (1) reduce every chunk (but the last one)
+    algorithms_detail::Buffer<T> sums(schd, chunks);
+    {
+      algorithms_detail::Buffer<T> partial(schd, chunks);
+      for(size_t c = 0; c < chunks; ++c) {
+        partial.push(first[static_cast<std::ptrdiff_t>(algorithms_detail::chunk_begin(n, chunks, c))]);
+      }
+      parallel_for(schd, 0, chunks-1, 1, [&](size_t b, size_t e) {
+        for(size_t c = b; c < e; ++c) {
+          size_t i0 = algorithms_detail::chunk_begin(n, chunks, c);
+          size_t i1 = algorithms_detail::chunk_begin(n, chunks, c+1);
+          T acc = partial[c];
+          for(size_t i = i0+1; i < i1; ++i) acc = op(acc, first[static_cast<std::ptrdiff_t>(i)]);
+          partial[c] = acc;
+        }
+      });
+      // (2) scan of the chunk results (offset of every chunk)
+      sums.push(partial[0]);
+      for(size_t c = 1; c < chunks-1; ++c) sums.push(op(sums[c-1], partial[c]));
+    }
+    // (3) scan every chunk starting from its offset
+    parallel_for(schd, 0, chunks, 1, [&](size_t b, size_t e) {
+      for(size_t c = b; c < e; ++c) {
+        size_t i0 = algorithms_detail::chunk_begin(n, chunks, c);
+        size_t i1 = algorithms_detail::chunk_begin(n, chunks, c+1);
+        It in = first + static_cast<std::ptrdiff_t>(i0);
+        OutIt o = out + static_cast<std::ptrdiff_t>(i0);
+        if (c == 0) {
+          std::partial_sum(in, first + static_cast<std::ptrdiff_t>(i1), o, op);
+        } else {
+          T acc = sums[c-1];
+          for(size_t i = i0; i < i1; ++i, ++in, ++o) {
+            acc = op(acc, *in);
+            *o = acc;
+          }
+        }
+      }
+    });
+    return out + static_cast<std::ptrdiff_t>(n);
+  }
+
+  template<class It, class OutIt>
+  OutIt parallel_inclusive_scan(Scheduler &schd, It first, It last, OutIt out) {
+    typedef typename std::iterator_traits<It>::value_type T;
+    return parallel_inclusive_scan(schd, first, last, out, std::plus<T>());
+  }
+
+  template<class It, class Pred>
+  It parallel_partition(Scheduler &schd, It first, It last, Pred pred) {
+    PX_SCHED_TRACE_FN("parallel_partition");
+    typedef typename std::iterator_traits<It>::value_type T;
+    const size_t n = static_cast<size_t>(last - first);
+    const size_t chunks = algorithms_detail::num_chunks(schd, n, PX_SCHED_ALGORITHMS_MIN_CHUNK);
+    if (chunks == 1) return std::stable_partition(first, last, pred);
+    // (1) count elements that satisfy pred on every chunk
+    algorithms_detail::Buffer<size_t> count(schd, chunks);
+    count.construct_all(schd);
+    parallel_for(schd, 0, chunks, 1, [&](size_t b, size_t e) {
+      for(size_t c = b; c < e; ++c) {
+        size_t i0 = algorithms_detail::chunk_begin(n, chunks, c);
+        size_t i1 = algorithms_detail::chunk_begin(n, chunks, c+1);
+        size_t t = 0;
+        for(size_t i = i0; i < i1; ++i) if (pred(first[static_cast<std::ptrdiff_t>(i)])) ++t;
+        count[c] = t;
+      }
+    });
+    // (2) destination of both groups for every chunk
+    algorithms_detail::Buffer<size_t> true_pos(schd, chunks);
+    algorithms_detail::Buffer<size_t> false_pos(schd, chunks);
+    size_t total_true = 0;
+    for(size_t c = 0; c < chunks; ++c) {
+      true_pos.push(total_true);
+      total_true += count[c];
+    }
+    size_t total_false = total_true;
+    for(size_t c = 0; c < chunks; ++c) {
+      false_pos.push(total_false);
+      total_false += algorithms_detail::chunk_begin(n, chunks, c+1) - algorithms_detail::chunk_begin(n, chunks, c) - count[c];
+    }
+    // (3) scatter into the temporary buffer, and move back
+    algorithms_detail::Buffer<T> tmp(schd, n);
+    tmp.construct_all(schd);
+    T *dst = tmp.data();
+    parallel_for(schd, 0, chunks, 1, [&](size_t b, size_t e) {
+      for(size_t c = b; c < e; ++c) {
+        size_t i0 = algorithms_detail::chunk_begin(n, chunks, c);
+        size_t i1 = algorithms_detail::chunk_begin(n, chunks, c+1);
+        size_t t = true_pos[c];
+        size_t f = false_pos[c];
+        for(size_t i = i0; i < i1; ++i) {
+          T &v = first[static_cast<std::ptrdiff_t>(i)];
+          if (pred(v)) dst[t++] = std::move(v); else dst[f++] = std::move(v);
+        }
+      }
+    });
+    parallel_for(schd, 0, n, PX_SCHED_ALGORITHMS_MIN_CHUNK, [dst, first](size_t b, size_t e) {
+      std::move(dst + b, dst + e, first + static_cast<std::ptrdiff_t>(b));
+    });
+    return first + static_cast<std::ptrdiff_t>(total_true);
+  }
+
+  template<class It, class T, class Reduce, class Transform>
+  T parallel_transform_reduce(Scheduler &schd, It first, It last, T init, Reduce reduce, Transform transform) {
+    PX_SCHED_TRACE_FN("parallel_transform_reduce");
+    const size_t n = static_cast<size_t>(last - first);
+    if (n == 0) return init;
+    const size_t chunks = algorithms_detail::num_chunks(schd, n, PX_SCHED_ALGORITHMS_MIN_CHUNK);
+    algorithms_detail::Buffer<T> partial(schd, chunks);
+    for(size_t c = 0; c < chunks; ++c) partial.push(init);
+    parallel_for(schd, 0, chunks, 1, [&](size_t b, size_t e) {
+      for(size_t c = b; c < e; ++c) {
+        size_t i0 = algorithms_detail::chunk_begin(n, chunks, c);
+        size_t i1 = algorithms_detail::chunk_begin(n, chunks, c+1);
+        It it = first + static_cast<std::ptrdiff_t>(i0);
+        T acc = transform(*it);
+        for(size_t i = i0+1; i < i1; ++i) acc = reduce(acc, transform(*++it));
+        partial[c] = acc;
+      }
+    });
+    // chunks are combined in order, so reduce does not need to be commutative
+    T result = init;
+    for(size_t c = 0; c < chunks; ++c) result = reduce(result, partial[c]);
+    return result;
+  }
+
+  // State of Pipeline::run. Tokens move from the input through the stages and
+  // back to the free list; serial stages keep the tokens that arrived out of
+  // order in a slot per sequence number (there are never more than
+  // max_tokens in flight). All state is protected by a mutex, stage
+  // functions run (and new tasks are launched) outside of it.
+  struct Pipeline::Run {
+    static const uint32_t kInput = 0xFFFFFFFF;
+    struct SerialState {
+      size_t next_seq = 0;
+      bool busy = false;
+    };
+    struct Launches {
+      uint32_t token[3];
+      uint32_t stage[3];
+      uint32_t count = 0;
+      void add(uint32_t t, uint32_t s) { token[count] = t; stage[count] = s; count++; }
+    };
+
+    Run(Scheduler &s, const Pipeline &p, uint32_t max_tokens)
+      : schd(s), pipeline(p), tokens(max_tokens)
+      , free_tokens(s, max_tokens), token_seq(s, max_tokens)
+      , serial(s, p.stages_.size()), pending(s, p.stages_.size()*max_tokens) {
+      for(uint32_t t = 0; t < tokens; ++t) {
+        free_tokens.push(tokens-1-t);
+        token_seq.push(0);
+      }
+      num_free = tokens;
+      for(size_t i = 0; i < p.stages_.size(); ++i) serial.push(SerialState());
+      for(size_t i = 0; i < p.stages_.size()*tokens; ++i) pending.push(0);
+    }
+
+    // the token is ready for the given stage (lock held)
+    void dispatch(uint32_t token, uint32_t stage, Launches *out) {
+      if (stage == pipeline.stages_.size()) {
+        free_tokens[num_free++] = token;
+        in_flight--;
+        startInput(out);
+      } else if (pipeline.stages_[stage].mode == Mode::Parallel) {
+        out->add(token, stage);
+      } else {
+        pending[stage*tokens + token_seq[token]%tokens] = token+1;
+        startSerial(stage, out);
+      }
+    }
+
+    void startSerial(uint32_t stage, Launches *out) {
+      SerialState &st = serial[stage];
+      uint32_t &slot = pending[stage*tokens + st.next_seq%tokens];
+      if (st.busy || !slot) return;
+      st.busy = true;
+      out->add(slot-1, stage);
+      slot = 0;
+    }
+
+    void startInput(Launches *out) {
+      if (input_busy || input_done || !num_free) return;
+      input_busy = true;
+      uint32_t token = free_tokens[--num_free];
+      token_seq[token] = next_input_seq++;
+      in_flight++;
+      out->add(token, kInput);
+    }
+
+    void execute(uint32_t token, uint32_t stage) {
+      for(;;) {
+        Launches next;
+        bool more = true;
+        if (stage == kInput) {
+          more = pipeline.input_(token);
+        } else {
+          pipeline.stages_[stage].fn(token);
+        }
+        bool finished;
+        {
+          std::lock_guard<std::mutex> lk(mutex);
+          if (stage == kInput) {
+            input_busy = false;
+            if (more) {
+              dispatch(token, 0, &next);
+              startInput(&next);
+            } else {
+              input_done = true;
+              free_tokens[num_free++] = token;
+              in_flight--;
+            }
+          } else {
+            if (pipeline.stages_[stage].mode == Mode::SerialInOrder) {
+              serial[stage].busy = false;
+              serial[stage].next_seq++;
+              startSerial(stage, &next);
+            }
+            dispatch(token, stage+1, &next);
+          }
+          finished = input_done && in_flight == 0;
+        }
+        if (finished) {
+          // nothing else is running, run() returns (and this object is gone)
+          // as soon as the sync object is released
+          schd.decrementSync(&done);
+          return;
+        }
+        // the last launch rejected by the scheduler is executed here (instead
+        // of recursively) so an input that keeps being rejected does not
+        // grow the stack item after item
+        if (next.count == 0 || !launch(next, &token, &stage)) return;
+      }
+    }
+
+    // Launches are rejected under OverflowPolicy::Fail, all but the last
+    // rejected one run inline, that one is returned (true) for the caller to
+    // execute it. Once the last task is launched this object might be gone
+    // at any time, and with nothing to launch it might be gone already
+    // (another worker finished the run after the lock was released).
+    bool launch(const Launches &l, uint32_t *inline_token, uint32_t *inline_stage) {
+      if (l.count == 0) return false;
+      Scheduler &s = schd;
+      Run *self = this;
+      bool rejected = false;
+      for(uint32_t i = 0; i < l.count; ++i) {
+        uint32_t token = l.token[i];
+        uint32_t stage = l.stage[i];
+        if (s.run([self, token, stage] { self->execute(token, stage); })) continue;
+        // (the one kept is still pending, so this object is alive)
+        if (rejected) self->execute(*inline_token, *inline_stage);
+        rejected = true;
+        *inline_token = token;
+        *inline_stage = stage;
+      }
+      return rejected;
+    }
+
+    Scheduler &schd;
+    const Pipeline &pipeline;
+    const uint32_t tokens;
+    std::mutex mutex;
+    algorithms_detail::Buffer<uint32_t> free_tokens;
+    algorithms_detail::Buffer<size_t> token_seq;
+    algorithms_detail::Buffer<SerialState> serial;
+    algorithms_detail::Buffer<uint32_t> pending; // token+1 per stage and seq%tokens
+    uint32_t num_free = 0;
+    uint32_t in_flight = 0;
+    size_t next_input_seq = 0;
+    bool input_busy = false;
+    bool input_done = false;
+    Sync done;
+  };
+
+  inline Pipeline& Pipeline::input(std::function<bool(size_t token)> fn) {
+    input_ = std::move(fn);
+    return *this;
+  }
+
+  inline Pipeline& Pipeline::stage(Mode mode, std::function<void(size_t token)> fn) {
+    Stage s;
+    s.mode = mode;
+    s.fn = std::move(fn);
+    stages_.push_back(std::move(s));
+    return *this;
+  }
+
+  inline void Pipeline::run(Scheduler &schd, size_t max_tokens) {
+    PX_SCHED_TRACE_FN("Pipeline");
+    if (!input_) return;
+#if PX_SCHED_IMP_SINGLE_THREAD
+    // jobs would be executed inline anyway, items go one by one
+    (void)max_tokens;
+    while (input_(0)) {
+      for(size_t i = 0; i < stages_.size(); ++i) stages_[i].fn(0);
+    }
+#else
+    if (max_tokens == 0) max_tokens = 1;
+    Run r(schd, *this, static_cast<uint32_t>(max_tokens));
+    Run::Launches first;
+    schd.incrementSync(&r.done);
+    {
+      std::lock_guard<std::mutex> lk(r.mutex);
+      r.startInput(&first);
+    }
+    uint32_t token, stage;
+    if (r.launch(first, &token, &stage)) r.execute(token, stage);
+    schd.waitFor(r.done);
+#endif
+  }
+
+} // end of px_sched namespace
+
+#endif // PX_SCHED_ALGORITHMS
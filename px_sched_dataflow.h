@@ -0,0 +1,392 @@
+/* -----------------------------------------------------------------------------
+Copyright (c) 2017-2023 Jose L. Hidalgo (PpluX)
+
+  px_sched_dataflow.h - Dependencies inferred from the data tasks access
+  Tasks declare the data they read and write, and are launched once the
+  tasks they depend on finished, respecting those accesses in submission
+  order (as StarPU or OmpSs do): reads of the same datum run concurrently, a
+  write waits for the previous write and for the reads after it.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+----------------------------------------------------------------------------- */
+
+// USAGE
+//
+// Header only, px_sched_dataflow must be included *AFTER* px_sched.h
+//
+//    px_sched::Dataflow df;
+//    df.init(&schd);
+//    df.task([&]{ simulate(); }).reads(&input).writes(&world).submit();
+//    df.task([&]{ render(); }).reads(&world).submit();
+//    df.task([&]{ audio(); }).reads(&input).submit(); // along simulate
+//    df.waitAll();
+//
+// Data are identified by address: a buffer, a handle object, anything that
+// stays the same for every access. Jobs are wrapped in lambdas so the
+// default job definition (std::function) is required.
+
+#ifndef PX_SCHED_DATAFLOW
+#define PX_SCHED_DATAFLOW
+
+#ifndef PX_SCHED
+#error px_sched must be included before px_sched_dataflow (because dataflow plugin does not include px_sched.h)
+#endif
+
+#ifdef PX_SCHED_CUSTOM_JOB_DEFINITION
+#error px_sched_dataflow needs the default job definition (std::function<void()>)
+#endif
+
+#include <mutex>
+
+namespace px_sched {
+
+  struct DataflowParams {
+    uint32_t max_data = 1024; // data tracked between waitAll calls
+    uint32_t max_tasks = 256; // tasks submitted and not finished yet
+  };
+
+  class Dataflow {
+  public:
+    static const uint32_t kMaxAccesses = 16; // per task
+
+    class TaskBuilder {
+    public:
+      TaskBuilder& reads(const void *datum) { return access(datum, false); }
+      TaskBuilder& writes(const void *datum) { return access(datum, true); }
+      // launches the task, out_sync_obj works as in Scheduler::run. False if
+      // there was no room for it (see SchedulerParams::overflow_policy, with
+      // RunInline it waits and helps), the job is discarded.
+      bool submit(Sync *out_sync_obj = nullptr);
+    private:
+      friend class Dataflow;
+      TaskBuilder(Dataflow *df, Job &&job) : df_(df), job_(std::move(job)) {}
+      TaskBuilder& access(const void *datum, bool write);
+      Dataflow *df_;
+      Job job_;
+      const void *data_[kMaxAccesses];
+      bool write_[kMaxAccesses];
+      uint32_t count_ = 0;
+    };
+
+    Dataflow() = default;
+    ~Dataflow();
+    Dataflow(const Dataflow&) = delete;
+    Dataflow& operator=(const Dataflow&) = delete;
+
+    void init(Scheduler *schd, const DataflowParams &params = DataflowParams());
+    TaskBuilder task(Job job) { return TaskBuilder(this, std::move(job)); }
+    // waits for every task submitted so far, then forgets all data (the
+    // following tasks depend on nothing submitted before)
+    void waitAll();
+
+  private:
+    static const uint32_t kNone = 0xFFFFFFFFu;
+    // tasks accessing a datum in the same way, one after another: a write,
+    // or the reads after it. Tasks that depend on a group are linked in its
+    // waiters list (see Slot::wait_next) until all its members finished.
+    struct Group {
+      uint32_t pending;  // members not finished
+      uint32_t refs;     // members and data pointing to it
+      uint32_t waiters;  // first link, next free group when unused
+    };
+    struct Datum {
+      const void *key = nullptr;
+      uint32_t last_write = kNone;
+      uint32_t readers = kNone; // reads since the last write
+    };
+    // a task in flight, its job only captures the slot
+    struct Slot {
+      Job job;
+      Sync trigger;        // released once every dependency finished
+      Sync all;
+      uint32_t groups[kMaxAccesses]; // groups it is a member of
+      uint32_t num_groups = 0;
+      // one link per dependency (slot_index*kMaxAccesses + i)
+      uint32_t wait_next[kMaxAccesses];
+      uint32_t next_free = kNone;
+    };
+    Datum* find(const void *key);
+    bool submit(TaskBuilder *t, Sync *out_sync_obj);
+    void run(Slot *slot);
+    uint32_t allocGroup();
+    void unrefGroup(uint32_t g);
+    void releaseWaiters(uint32_t link);
+    void clear();
+
+    Scheduler *schd_ = nullptr;
+    Datum *data_ = nullptr;
+    uint32_t capacity_ = 0; // power of two
+    uint32_t max_data_ = 0;
+    uint32_t num_data_ = 0;
+    Slot *slots_ = nullptr;
+    uint32_t max_tasks_ = 0;
+    uint32_t free_slot_ = kNone;
+    Group *groups_ = nullptr;
+    uint32_t max_groups_ = 0;
+    uint32_t free_group_ = kNone;
+    Sync all_;
+    Spinlock lock_; // recursive: jobs might run inline and submit more tasks
+  };
+
+  //-- Implementation ----------------------------------------------------------
+
+  inline Dataflow::~Dataflow() {
+    if (schd_) {
+      waitAll();
+      for(uint32_t i = 0; i < max_tasks_; ++i) slots_[i].~Slot();
+      schd_->params().mem_callbacks.free_fn(data_);
+      schd_->params().mem_callbacks.free_fn(slots_);
+      schd_->params().mem_callbacks.free_fn(groups_);
+    }
+  }
+
+  inline void Dataflow::init(Scheduler *schd, const DataflowParams &params) {
+    PX_SCHED_CHECK_FN(schd_ == nullptr, "Dataflow initialized twice");
+    schd_ = schd;
+    const MemCallbacks &mem = schd->params().mem_callbacks;
+    max_data_ = params.max_data? params.max_data : 1;
+    capacity_ = 1;
+    while (capacity_ < max_data_*2) capacity_ *= 2;
+    void *ptr = mem.alloc_fn(alignof(Datum), sizeof(Datum)*capacity_);
+    data_ = static_cast<Datum*>(ptr);
+    for(uint32_t i = 0; i < capacity_; ++i) new (&data_[i]) Datum();
+
+    max_tasks_ = params.max_tasks? params.max_tasks : 1;
+    slots_ = static_cast<Slot*>(mem.alloc_fn(alignof(Slot), sizeof(Slot)*max_tasks_));
+    for(uint32_t i = 0; i < max_tasks_; ++i) {
+      new (&slots_[i]) Slot();
+      slots_[i].next_free = (i+1 < max_tasks_)? i+1 : kNone;
+    }
+    free_slot_ = 0;
+
+    // every datum points to two groups at most, and every task is a member
+    // of kMaxAccesses groups at most
+    max_groups_ = max_data_*2 + max_tasks_*kMaxAccesses;
+    groups_ = static_cast<Group*>(mem.alloc_fn(alignof(Group), sizeof(Group)*max_groups_));
+    for(uint32_t i = 0; i < max_groups_; ++i) {
+      groups_[i].pending = 0;
+      groups_[i].refs = 0;
+      groups_[i].waiters = (i+1 < max_groups_)? i+1 : kNone;
+    }
+    free_group_ = 0;
+  }
+
+  inline Dataflow::TaskBuilder& Dataflow::TaskBuilder::access(const void *datum, bool write) {
+    for(uint32_t i = 0; i < count_; ++i) {
+      if (data_[i] == datum) {
+        write_[i] = write_[i] || write;
+        return *this;
+      }
+    }
+    PX_SCHED_CHECK_FN(count_ < kMaxAccesses, "Too many data accessed by one Dataflow task (max %u)", kMaxAccesses);
+    data_[count_] = datum;
+    write_[count_] = write;
+    count_++;
+    return *this;
+  }
+
+  inline bool Dataflow::TaskBuilder::submit(Sync *out_sync_obj) {
+    return df_->submit(this, out_sync_obj);
+  }
+
+  inline Dataflow::Datum* Dataflow::find(const void *key) {
+    uintptr_t h = reinterpret_cast<uintptr_t>(key);
+    h ^= h >> 17;
+    h *= 0x9E3779B1u;
+    for(uint32_t i = static_cast<uint32_t>(h) & (capacity_-1);; i = (i+1) & (capacity_-1)) {
+      Datum &d = data_[i];
+      if (d.key == key) return &d;
+      if (d.key == nullptr) {
+        PX_SCHED_CHECK_FN(num_data_ < max_data_, "Dataflow tracks too many data (max_data %u), call waitAll more often", max_data_);
+        num_data_++;
+        d.key = key;
+        return &d;
+      }
+    }
+  }
+
+  inline uint32_t Dataflow::allocGroup() {
+    PX_SCHED_CHECK_FN(free_group_ != kNone, "Dataflow ran out of groups");
+    uint32_t g = free_group_;
+    free_group_ = groups_[g].waiters;
+    groups_[g].pending = 0;
+    groups_[g].refs = 0;
+    groups_[g].waiters = kNone;
+    return g;
+  }
+
+  inline void Dataflow::unrefGroup(uint32_t g) {
+    if (--groups_[g].refs) return;
+    groups_[g].waiters = free_group_;
+    free_group_ = g;
+  }
+
+  inline bool Dataflow::submit(TaskBuilder *t, Sync *out_sync_obj) {
+    PX_SCHED_CHECK_FN(schd_ != nullptr, "Dataflow not initialized");
+    PX_SCHED_TRACE_FN("Dataflow::submit");
+    Scheduler *schd = schd_;
+    const bool help = schd->helpOnOverflow();
+
+    // the slot and the task are taken before touching the data, so helping
+    // never runs with the lock held
+    Slot *slot = nullptr;
+    for(;;) {
+      {
+        std::lock_guard<Spinlock> lock(lock_);
+        if (free_slot_ != kNone) {
+          slot = &slots_[free_slot_];
+          free_slot_ = slot->next_free;
+          break;
+        }
+      }
+      if (schd->params().overflow_policy == OverflowPolicy::Fail) return false;
+      PX_SCHED_CHECK_FN(help, "Too many Dataflow tasks in flight (max_tasks %u)", max_tasks_);
+      if (!help || !schd->helpOnce()) return false;
+    }
+    Dataflow *df = this;
+    const uint32_t t_ref = schd->createTaskWithPolicy([df, slot] { df->run(slot); }, out_sync_obj, nullptr, help);
+    if (!t_ref) {
+      std::lock_guard<Spinlock> lock(lock_);
+      slot->next_free = free_slot_;
+      free_slot_ = static_cast<uint32_t>(slot - slots_);
+      return false;
+    }
+    slot->job = std::move(t->job_);
+    slot->trigger = Sync();
+    slot->num_groups = 0;
+    // held until the dependencies are linked
+    schd->incrementSync(&slot->trigger);
+
+    {
+      std::lock_guard<Spinlock> lock(lock_);
+      const uint32_t slot_index = static_cast<uint32_t>(slot - slots_);
+      Datum *data[kMaxAccesses];
+      uint32_t deps[kMaxAccesses];
+      uint32_t num_deps = 0;
+      for(uint32_t i = 0; i < t->count_; ++i) {
+        Datum *d = data[i] = find(t->data_[i]);
+        // reads since the last write ran after it, waiting for them is enough
+        uint32_t dep = (t->write_[i] && d->readers != kNone)? d->readers : d->last_write;
+        if (dep == kNone || groups_[dep].pending == 0) continue;
+        bool repeated = false;
+        for(uint32_t j = 0; j < num_deps && !repeated; ++j) repeated = deps[j] == dep;
+        if (repeated) continue;
+        const uint32_t link = slot_index*kMaxAccesses + num_deps;
+        slot->wait_next[num_deps] = groups_[dep].waiters;
+        groups_[dep].waiters = link;
+        deps[num_deps++] = dep;
+        schd->incrementSync(&slot->trigger);
+      }
+
+      // record the accesses
+      uint32_t write_group = kNone;
+      for(uint32_t i = 0; i < t->count_; ++i) {
+        Datum *d = data[i];
+        if (t->write_[i]) {
+          if (write_group == kNone) {
+            write_group = allocGroup();
+            groups_[write_group].pending = 1;
+            groups_[write_group].refs = 1;
+            slot->groups[slot->num_groups++] = write_group;
+          }
+          if (d->last_write != kNone) unrefGroup(d->last_write);
+          if (d->readers != kNone) unrefGroup(d->readers);
+          d->last_write = write_group;
+          d->readers = kNone;
+          groups_[write_group].refs++;
+        } else {
+          if (d->readers == kNone) {
+            d->readers = allocGroup();
+            groups_[d->readers].refs = 1;
+          }
+          Group &g = groups_[d->readers];
+          g.pending++;
+          g.refs++;
+          slot->groups[slot->num_groups++] = d->readers;
+        }
+      }
+      schd->incrementSync(&all_);
+      slot->all = all_;
+    }
+
+    Sync trigger = slot->trigger;
+    schd->runTaskAfter(trigger, t_ref);
+    schd->decrementSync(&trigger);
+    return true;
+  }
+
+  inline void Dataflow::run(Slot *slot) {
+    slot->job();
+    slot->job = nullptr;
+    const Sync all = slot->all;
+    uint32_t ready[kMaxAccesses];
+    uint32_t num_ready = 0;
+    {
+      std::lock_guard<Spinlock> lock(lock_);
+      for(uint32_t i = 0; i < slot->num_groups; ++i) {
+        Group &g = groups_[slot->groups[i]];
+        if (--g.pending == 0 && g.waiters != kNone) {
+          ready[num_ready++] = g.waiters;
+          g.waiters = kNone;
+        }
+        unrefGroup(slot->groups[i]);
+      }
+      slot->next_free = free_slot_;
+      free_slot_ = static_cast<uint32_t>(slot - slots_);
+    }
+    for(uint32_t i = 0; i < num_ready; ++i) releaseWaiters(ready[i]);
+    Sync s = all;
+    schd_->decrementSync(&s);
+  }
+
+  inline void Dataflow::releaseWaiters(uint32_t link) {
+    // the waiters can not start (and reuse their slots) before the last
+    // decrement, read the next link first
+    while (link != kNone) {
+      Slot &s = slots_[link / kMaxAccesses];
+      Sync trigger = s.trigger;
+      link = s.wait_next[link % kMaxAccesses];
+      schd_->decrementSync(&trigger);
+    }
+  }
+
+  inline void Dataflow::waitAll() {
+    PX_SCHED_CHECK_FN(schd_ != nullptr, "Dataflow not initialized");
+    Sync all;
+    {
+      std::lock_guard<Spinlock> lock(lock_);
+      all = all_;
+      all_ = Sync();
+      clear();
+    }
+    schd_->waitFor(all);
+  }
+
+  inline void Dataflow::clear() {
+    for(uint32_t i = 0; i < capacity_; ++i) {
+      Datum &d = data_[i];
+      if (d.last_write != kNone) unrefGroup(d.last_write);
+      if (d.readers != kNone) unrefGroup(d.readers);
+      d = Datum();
+    }
+    num_data_ = 0;
+  }
+
+} // end of px_sched namespace
+
+#endif // PX_SCHED_DATAFLOW
@@ -0,0 +1,427 @@
+/* -----------------------------------------------------------------------------
+Copyright (c) 2017-2023 Jose L. Hidalgo (PpluX)
+
+  px_sched_execution.h - Sender/receiver (P2300, std::execution) adapter
+  A px_sched scheduler seen as an execution scheduler: schedule() returns a
+  sender that completes on a worker, Sync objects can be awaited as senders
+  and bulk work is split in chunks as parallel_for does.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+----------------------------------------------------------------------------- */
+
+// USAGE
+//
+// Header only, px_sched_execution must be included *AFTER* px_sched.h and
+// px_sched_algorithms.h, it needs C++17.
+//
+//    px_sched::ExecutionScheduler sch(&schd);
+//    auto all = sch.bulk(sch.whenFinished(assets_loaded), meshes.size(),
+//                        [&](size_t i) { upload(meshes[i]); });
+//    auto op = all.connect(MyReceiver{...});
+//    op.start(); // MyReceiver::set_value() is called once all are uploaded
+//
+// Senders, receivers and operation states follow the member function form of
+// P2300: sender.connect(receiver), op.start(), receiver.set_value(),
+// receiver.set_error(e), receiver.set_stopped(). If std::execution (C++26) or
+// stdexec (C++20, <stdexec/execution.hpp>) is available they also declare the
+// concept tags, completion signatures and environments those libraries look
+// for, and the completion functions are called through their customization
+// points. That path is not built by the examples (they use the member
+// protocol only). Set PX_SCHED_EXECUTION_INTEROP to 0 to disable it.
+//
+// Operation states live where the receiver's owner puts them, tasks only
+// capture a pointer to them, so nothing is allocated per operation (the
+// default std::function keeps such small jobs inline). Operation states must
+// stay alive, and not move, until they complete.
+
+#ifndef PX_SCHED_EXECUTION
+#define PX_SCHED_EXECUTION
+
+#ifndef PX_SCHED
+#error px_sched must be included before px_sched_execution (because execution plugin does not include px_sched.h)
+#endif
+
+#ifndef PX_SCHED_ALGORITHMS
+#error px_sched_algorithms must be included before px_sched_execution
+#endif
+
+#if __cplusplus < 201703L
+#error px_sched_execution needs C++17 (operation states can not be moved)
+#endif
+
+#include <atomic>
+#include <exception>
+#include <type_traits>
+#include <utility>
+#if __has_include(<version>)
+#include <version>
+#endif
+
+#ifndef PX_SCHED_EXECUTION_INTEROP
+#  if defined(__cpp_lib_senders)
+#    define PX_SCHED_EXECUTION_INTEROP 1
+#  elif __cplusplus >= 202002L && __has_include(<stdexec/execution.hpp>)
+#    define PX_SCHED_EXECUTION_INTEROP 1
+#  else
+#    define PX_SCHED_EXECUTION_INTEROP 0
+#  endif
+#endif
+
+#if PX_SCHED_EXECUTION_INTEROP
+#  if defined(__cpp_lib_senders)
+#    include <execution>
+     namespace px_sched { namespace execution_detail { namespace ex = std::execution; } }
+#  else
+#    include <stdexec/execution.hpp>
+     namespace px_sched { namespace execution_detail { namespace ex = stdexec; } }
+#  endif
+#endif
+
+namespace px_sched {
+
+  class ExecutionScheduler;
+
+  namespace execution_detail {
+
+    template<class R>
+    void setValue(R &r) noexcept {
+#if PX_SCHED_EXECUTION_INTEROP
+      ex::set_value(std::move(r));
+#else
+      std::move(r).set_value();
+#endif
+    }
+
+    template<class R>
+    void setStopped(R &r) noexcept {
+#if PX_SCHED_EXECUTION_INTEROP
+      ex::set_stopped(std::move(r));
+#else
+      std::move(r).set_stopped();
+#endif
+    }
+
+    template<class R, class E>
+    void setError(R &r, E &&e) noexcept {
+#if PX_SCHED_EXECUTION_INTEROP
+      ex::set_error(std::move(r), std::forward<E>(e));
+#else
+      std::move(r).set_error(std::forward<E>(e));
+#endif
+    }
+
+    template<class R>
+    bool stopRequested(const R &r) noexcept {
+#if PX_SCHED_EXECUTION_INTEROP
+      return ex::get_stop_token(ex::get_env(r)).stop_requested();
+#else
+      (void)r;
+      return false;
+#endif
+    }
+
+#if PX_SCHED_EXECUTION_INTEROP
+    // error types a sender declares in its completion_signatures member
+    // (exception_ptr left out, bulk always declares it), none if it has no
+    // such member
+    template<class... Es> struct ErrorList {};
+    template<class L, class Sig> struct AddError { typedef L type; };
+    template<class... Es, class E> struct AddError<ErrorList<Es...>, ex::set_error_t(E)> {
+      typedef typename std::conditional<
+          std::is_same<std::decay_t<E>, std::exception_ptr>::value || (std::is_same<std::decay_t<E>, Es>::value || ...),
+          ErrorList<Es...>, ErrorList<Es..., std::decay_t<E>>>::type type;
+    };
+    template<class L, class... Sigs> struct CollectErrors { typedef L type; };
+    template<class L, class S, class... Sigs> struct CollectErrors<L, S, Sigs...> {
+      typedef typename CollectErrors<typename AddError<L, S>::type, Sigs...>::type type;
+    };
+    template<class Sigs> struct SignatureErrors { typedef ErrorList<> type; };
+    template<class... Sigs> struct SignatureErrors<ex::completion_signatures<Sigs...>> {
+      typedef typename CollectErrors<ErrorList<>, Sigs...>::type type;
+    };
+    template<class S, class = void> struct DeclaredErrors { typedef ErrorList<> type; };
+    template<class S> struct DeclaredErrors<S, std::void_t<typename S::completion_signatures>> {
+      typedef typename SignatureErrors<typename S::completion_signatures>::type type;
+    };
+    template<class E, class L> struct InErrorList;
+    template<class E, class... Es> struct InErrorList<E, ErrorList<Es...>>
+      : std::bool_constant<(std::is_same<E, Es>::value || ...)> {};
+    template<class L> struct BulkSignatures;
+    template<class... Es> struct BulkSignatures<ErrorList<Es...>> {
+      typedef ex::completion_signatures<ex::set_value_t(), ex::set_error_t(std::exception_ptr),
+          ex::set_error_t(Es)..., ex::set_stopped_t()> type;
+    };
+#endif
+
+    // forwards an error of Pred as declared by BulkSender<Pred>: errors Pred
+    // does not declare go on as an exception_ptr
+    template<class Pred, class R, class E>
+    void forwardError(R &r, E &&e) noexcept {
+#if PX_SCHED_EXECUTION_INTEROP
+      typedef std::decay_t<E> T;
+      if constexpr (std::is_same<T, std::exception_ptr>::value || InErrorList<T, typename DeclaredErrors<Pred>::type>::value) {
+        setError(r, std::forward<E>(e));
+      } else {
+        setError(r, std::make_exception_ptr(std::forward<E>(e)));
+      }
+#else
+      setError(r, std::forward<E>(e));
+#endif
+    }
+
+    template<class S, class R>
+    auto connect(S &&s, R &&r) {
+#if PX_SCHED_EXECUTION_INTEROP
+      return ex::connect(std::forward<S>(s), std::forward<R>(r));
+#else
+      return std::forward<S>(s).connect(std::forward<R>(r));
+#endif
+    }
+
+    // answers get_completion_scheduler<set_value_t> for the senders that
+    // complete on a worker
+    struct SchedulerEnv {
+      Scheduler *schd;
+#if PX_SCHED_EXECUTION_INTEROP
+      ExecutionScheduler query(ex::get_completion_scheduler_t<ex::set_value_t>) const noexcept;
+#endif
+    };
+
+    template<class R>
+    class ScheduleOperation {
+    public:
+#if PX_SCHED_EXECUTION_INTEROP
+      using operation_state_concept = ex::operation_state_t;
+#endif
+      ScheduleOperation(Scheduler *schd, Sync after, R rcvr)
+        : schd_(schd), after_(after), rcvr_(std::move(rcvr)) {}
+      ScheduleOperation(const ScheduleOperation&) = delete;
+      ScheduleOperation& operator=(const ScheduleOperation&) = delete;
+
+      void start() noexcept {
+        // only fails with OverflowPolicy::Fail
+        if (!schd_->runAfter(after_, [this] { complete(); })) setStopped(rcvr_);
+      }
+
+    private:
+      void complete() noexcept {
+        if (stopRequested(rcvr_)) {
+          setStopped(rcvr_);
+        } else {
+          setValue(rcvr_);
+        }
+      }
+      Scheduler *schd_;
+      Sync after_;
+      R rcvr_;
+    };
+
+    template<class Shape, class F, class R>
+    class BulkState {
+    public:
+      BulkState(Scheduler *schd, Shape shape, F fn, R rcvr)
+        : schd_(schd), shape_(shape), fn_(std::move(fn)), rcvr_(std::move(rcvr)) {}
+
+      // called once the predecessor has completed, the last chunk to finish
+      // completes the operation (with the first exception thrown, if any)
+      void launch() noexcept {
+        const size_t n = static_cast<size_t>(shape_);
+        if (n == 0) {
+          setValue(rcvr_);
+          return;
+        }
+        const size_t chunks = algorithms_detail::num_chunks(*schd_, n, 1);
+        chunks_ = chunks;
+        remaining_.store(chunks);
+        Scheduler *schd = schd_;
+        // the operation might be gone once the last chunk is launched, only
+        // locals are used from here
+        for(size_t c = 0; c < chunks; ++c) {
+          // [this, c] fits inside std::function, no allocation
+          if (!schd->run([this, c] { runChunk(c); })) runChunk(c);
+        }
+      }
+
+      R& receiver() noexcept { return rcvr_; }
+
+    private:
+      void runChunk(size_t c) noexcept {
+        const size_t n = static_cast<size_t>(shape_);
+        const size_t b = algorithms_detail::chunk_begin(n, chunks_, c);
+        const size_t e = algorithms_detail::chunk_begin(n, chunks_, c+1);
+        try {
+          for(size_t i = b; i < e; ++i) fn_(static_cast<Shape>(i));
+        } catch (...) {
+          bool first = false;
+          if (failed_.compare_exchange_strong(first, true)) error_ = std::current_exception();
+        }
+        if (remaining_.fetch_sub(1) != 1) return;
+        if (failed_.load()) {
+          setError(rcvr_, std::move(error_));
+        } else {
+          setValue(rcvr_);
+        }
+      }
+      Scheduler *schd_;
+      Shape shape_;
+      F fn_;
+      R rcvr_;
+      size_t chunks_ = 0;
+      std::atomic<size_t> remaining_ = {0};
+      std::atomic<bool> failed_ = {false};
+      std::exception_ptr error_;
+    };
+
+    // receives the predecessor's completion, and launches the chunks
+    template<class State, class Pred>
+    struct BulkReceiver {
+#if PX_SCHED_EXECUTION_INTEROP
+      using receiver_concept = ex::receiver_t;
+      auto get_env() const noexcept { return ex::get_env(state->receiver()); }
+#endif
+      void set_value() && noexcept { state->launch(); }
+      template<class E>
+      void set_error(E &&e) && noexcept { forwardError<Pred>(state->receiver(), std::forward<E>(e)); }
+      void set_stopped() && noexcept { setStopped(state->receiver()); }
+      State *state;
+    };
+
+    template<class Pred, class Shape, class F, class R>
+    class BulkOperation {
+      typedef BulkState<Shape, F, R> State;
+      typedef BulkReceiver<State, Pred> Receiver;
+      typedef decltype(connect(std::declval<Pred>(), std::declval<Receiver>())) PredOperation;
+    public:
+#if PX_SCHED_EXECUTION_INTEROP
+      using operation_state_concept = ex::operation_state_t;
+#endif
+      BulkOperation(Pred &&pred, Scheduler *schd, Shape shape, F fn, R rcvr)
+        : state_(schd, shape, std::move(fn), std::move(rcvr))
+        , pred_(connect(std::move(pred), Receiver{&state_})) {}
+      BulkOperation(const BulkOperation&) = delete;
+      BulkOperation& operator=(const BulkOperation&) = delete;
+
+      void start() noexcept { pred_.start(); }
+
+    private:
+      State state_;
+      PredOperation pred_;
+    };
+
+  } // execution_detail
+
+  // Sender returned by schedule() and whenFinished(), completes with
+  // set_value() on a worker. It completes with set_stopped() if the receiver
+  // asked to stop, or if the scheduler had no room for the task
+  // (OverflowPolicy::Fail).
+  class ScheduleSender {
+  public:
+#if PX_SCHED_EXECUTION_INTEROP
+    using sender_concept = execution_detail::ex::sender_t;
+    using completion_signatures = execution_detail::ex::completion_signatures<
+        execution_detail::ex::set_value_t(), execution_detail::ex::set_stopped_t()>;
+#endif
+    ScheduleSender(Scheduler *schd, Sync after) : schd_(schd), after_(after) {}
+
+    template<class R>
+    execution_detail::ScheduleOperation<R> connect(R rcvr) const {
+      return execution_detail::ScheduleOperation<R>(schd_, after_, std::move(rcvr));
+    }
+    execution_detail::SchedulerEnv get_env() const noexcept { return {schd_}; }
+
+  private:
+    Scheduler *schd_;
+    Sync after_;
+  };
+
+  // Sender returned by bulk(), calls fn(i) for every i in [0, shape) once the
+  // predecessor has completed (with no values), split in chunks of tasks as
+  // parallel_for does. Completes on a worker with set_value(), or with
+  // set_error(exception_ptr) if fn threw (the first exception, the other
+  // chunks still run). Errors and stops of the predecessor are forwarded,
+  // errors it does not declare as an exception_ptr.
+  template<class Pred, class Shape, class F>
+  class BulkSender {
+  public:
+#if PX_SCHED_EXECUTION_INTEROP
+    using sender_concept = execution_detail::ex::sender_t;
+    using completion_signatures = typename execution_detail::BulkSignatures<
+        typename execution_detail::DeclaredErrors<Pred>::type>::type;
+#endif
+    BulkSender(Pred pred, Scheduler *schd, Shape shape, F fn)
+      : pred_(std::move(pred)), schd_(schd), shape_(shape), fn_(std::move(fn)) {}
+
+    template<class R>
+    execution_detail::BulkOperation<Pred, Shape, F, R> connect(R rcvr) && {
+      return execution_detail::BulkOperation<Pred, Shape, F, R>(std::move(pred_), schd_, shape_, std::move(fn_), std::move(rcvr));
+    }
+    template<class R>
+    execution_detail::BulkOperation<Pred, Shape, F, R> connect(R rcvr) const & {
+      Pred pred = pred_;
+      return execution_detail::BulkOperation<Pred, Shape, F, R>(std::move(pred), schd_, shape_, fn_, std::move(rcvr));
+    }
+    execution_detail::SchedulerEnv get_env() const noexcept { return {schd_}; }
+
+  private:
+    Pred pred_;
+    Scheduler *schd_;
+    Shape shape_;
+    F fn_;
+  };
+
+  // A px_sched scheduler as a P2300 scheduler, it is a pointer: cheap to copy
+  // and equal to any other adapter of the same scheduler.
+  class ExecutionScheduler {
+  public:
+#if PX_SCHED_EXECUTION_INTEROP
+    using scheduler_concept = execution_detail::ex::scheduler_t;
+#endif
+    explicit ExecutionScheduler(Scheduler *schd) : schd_(schd) {}
+
+    ScheduleSender schedule() const noexcept { return ScheduleSender(schd_, Sync()); }
+    // completes on a worker once the sync object has been released
+    ScheduleSender whenFinished(Sync s) const noexcept { return ScheduleSender(schd_, s); }
+
+    template<class Pred, class Shape, class F>
+    BulkSender<typename std::decay<Pred>::type, Shape, F> bulk(Pred &&pred, Shape shape, F fn) const {
+      static_assert(std::is_integral<Shape>::value, "bulk shape must be an integral type");
+      return BulkSender<typename std::decay<Pred>::type, Shape, F>(std::forward<Pred>(pred), schd_, shape, std::move(fn));
+    }
+    template<class Shape, class F>
+    BulkSender<ScheduleSender, Shape, F> bulk(Shape shape, F fn) const {
+      return bulk(schedule(), shape, std::move(fn));
+    }
+
+    Scheduler* scheduler() const { return schd_; }
+    bool operator==(const ExecutionScheduler &o) const noexcept { return schd_ == o.schd_; }
+    bool operator!=(const ExecutionScheduler &o) const noexcept { return schd_ != o.schd_; }
+
+  private:
+    Scheduler *schd_;
+  };
+
+#if PX_SCHED_EXECUTION_INTEROP
+  inline ExecutionScheduler execution_detail::SchedulerEnv::query(
+      ex::get_completion_scheduler_t<ex::set_value_t>) const noexcept {
+    return ExecutionScheduler(schd);
+  }
+#endif
+
+} // px_sched
+
+#endif // PX_SCHED_EXECUTION
@@ -0,0 +1,519 @@
+/* -----------------------------------------------------------------------------
+Copyright (c) 2017-2023 Jose L. Hidalgo (PpluX)
+
+  px_sched_io.h - Asynchronous file reads for px_sched
+  Reads are submitted without blocking the calling thread, and every read
+  completes into a px_sched::Sync object, so I/O and tasks can be chained
+  with Scheduler::runAfter. On Linux reads are submitted through io_uring,
+  elsewhere (or if io_uring is not available) a small pool of I/O threads
+  performs blocking reads on behalf of the workers.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+----------------------------------------------------------------------------- */
+
+// USAGE
+//
+// In *ONE* C++ file you need to declare
+// #define PX_SCHED_IO_IMPLEMENTATION 1
+// before including the file that contains px_sched_io.h
+//
+// px_sched_io must be included *AFTER* px_sched.h
+//
+// Example:
+//
+//    px_sched::IO io;
+//    io.init(&schd);
+//    px_sched::Sync read_done;
+//    int64_t bytes = 0;
+//    io.read(fd, buffer, size, offset, &read_done, &bytes);
+//    schd.runAfter(read_done, [&]{ decode(buffer, bytes); });
+//
+// Only files descriptors are used, opening and closing files is up to the
+// user. Files and buffers must be valid until the read has completed.
+//
+// At most IOParams::max_pending_reads reads are in flight. A read that finds
+// them all taken does not block the calling thread: it executes ready tasks
+// of the scheduler (as WaitAndHelp does) until one completes. With
+// OverflowPolicy::Fail the read returns false instead.
+
+#ifndef PX_SCHED_IO
+#define PX_SCHED_IO
+
+#ifndef PX_SCHED
+#error px_sched must be included before px_sched_io (because io plugin does not include px_sched.h)
+#endif
+
+#ifdef _WIN32
+#error px_sched_io: only posix file descriptors are supported right now
+#endif
+
+// Use io_uring on linux, define PX_SCHED_IO_URING to 0 to always use the pool
+// of I/O threads
+#ifndef PX_SCHED_IO_URING
+#  ifdef __linux__
+#    define PX_SCHED_IO_URING 1
+#  else
+#    define PX_SCHED_IO_URING 0
+#  endif
+#endif
+
+#include <mutex>
+#include <sys/uio.h>
+
+namespace px_sched {
+
+  struct IOParams {
+    uint16_t max_pending_reads = 64;  // max number of reads in flight
+    uint16_t num_io_threads = 2;      // threads used when io_uring is not available
+    bool force_io_threads = false;    // never use io_uring (mainly for testing)
+  };
+
+  class IO {
+  public:
+    IO() = default;
+    ~IO() { stop(); }
+    IO(const IO&) = delete;
+    IO& operator=(const IO&) = delete;
+
+    void init(Scheduler *schd, const IOParams &params = IOParams());
+
+    // waits for all pending reads to finish
+    void stop();
+
+    // Reads up to size bytes of fd starting at offset into buffer. The sync
+    // object will be held until the read completes; optionally result receives
+    // the total number of bytes read (less than size only at end of file) or
+    // -errno on failure. If there are already max_pending_reads in flight the
+    // calling thread runs ready tasks until one of them completes, or returns
+    // false with OverflowPolicy::Fail (nothing is read then, and the sync
+    // object is left untouched).
+    bool read(int fd, void *buffer, size_t size, uint64_t offset,
+              Sync *out_sync_obj, int64_t *result = nullptr);
+
+    // true if reads are submitted through io_uring
+    bool usingIOUring() const { return ring_fd_ >= 0; }
+
+    uint32_t num_pending_reads() const { return pending_.load(); }
+
+    const IOParams& params() const { return params_; }
+
+  private:
+    struct Request {
+      int fd = -1;
+      char *buffer = nullptr;
+      size_t size = 0;   // remaining bytes
+      uint64_t offset = 0;
+      int64_t total = 0; // bytes read so far
+      int64_t *result = nullptr;
+      Sync sync;
+      uint32_t next = 0; // free list / queue of pending requests (index+1)
+      iovec iov;
+    };
+
+    // 0 if there are none free and the scheduler's policy is Fail
+    uint32_t adquireRequest();
+    void complete(uint32_t r, int64_t res);
+    void freeRequest(uint32_t r);
+
+    bool initIOUring();
+    void submitIOUring(uint32_t r);
+    static void IOUringThreadMain(IO *io);
+
+    static void IOThreadMain(IO *io);
+
+    Scheduler *schd_ = nullptr;
+    IOParams params_;
+    Request *requests_ = nullptr;
+    uint32_t free_list_ = 0;
+    std::atomic_flag free_lock_ = ATOMIC_FLAG_INIT;
+    Atomic<uint32_t> pending_;
+
+    // io_uring backend
+    int ring_fd_ = -1;
+    void *sq_ring_ = nullptr;
+    void *cq_ring_ = nullptr;
+    void *sqes_ = nullptr;
+    void *cqes_ = nullptr;
+    uint32_t *sq_tail_ = nullptr;
+    uint32_t *sq_mask_ = nullptr;
+    uint32_t *sq_array_ = nullptr;
+    uint32_t *cq_head_ = nullptr;
+    uint32_t *cq_tail_ = nullptr;
+    uint32_t *cq_mask_ = nullptr;
+    size_t sq_ring_size_ = 0;
+    size_t cq_ring_size_ = 0;
+    size_t sqes_size_ = 0;
+    std::atomic_flag submit_lock_ = ATOMIC_FLAG_INIT;
+
+    // I/O threads backend (and the io_uring completion thread)
+    std::thread *threads_ = nullptr;
+    uint16_t num_threads_ = 0;
+    std::mutex queue_mutex_;
+    std::condition_variable queue_cv_;
+    uint32_t queue_first_ = 0;
+    uint32_t queue_last_ = 0;
+    bool running_ = false;
+  };
+
+} // end of px_sched namespace
+
+#endif // PX_SCHED_IO
+
+//----------------------------------------------------------------------------
+// -- IMPLEMENTATION ---------------------------------------------------------
+//----------------------------------------------------------------------------
+
+#if defined(PX_SCHED_IO_IMPLEMENTATION) && !defined(PX_SCHED_IO_IMPLEMENTATION_DONE)
+#define PX_SCHED_IO_IMPLEMENTATION_DONE 1
+
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+
+#if PX_SCHED_IO_URING
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+namespace px_sched {
+
+  void IO::init(Scheduler *schd, const IOParams &params) {
+    stop();
+    schd_ = schd;
+    params_ = params;
+    if (params_.max_pending_reads == 0) params_.max_pending_reads = 1;
+    const MemCallbacks &mem = schd_->params().mem_callbacks;
+    requests_ = static_cast<Request*>(mem.alloc_fn(alignof(Request), sizeof(Request)*params_.max_pending_reads));
+    for(uint32_t i = 0; i < params_.max_pending_reads; ++i) {
+      new (&requests_[i]) Request();
+      requests_[i].next = (i+1 < params_.max_pending_reads)? i+2 : 0;
+    }
+    free_list_ = 1;
+    pending_.store(0);
+    running_ = true;
+#if PX_SCHED_IMP_REGULAR_THREADS
+    if (!params_.force_io_threads && initIOUring()) {
+      // only one thread, to reap completions
+      num_threads_ = 1;
+      threads_ = static_cast<std::thread*>(mem.alloc_fn(alignof(std::thread), sizeof(std::thread)));
+      new (&threads_[0]) std::thread(IOUringThreadMain, this);
+    } else {
+      num_threads_ = params_.num_io_threads? params_.num_io_threads : 1;
+      threads_ = static_cast<std::thread*>(mem.alloc_fn(alignof(std::thread), sizeof(std::thread)*num_threads_));
+      for(uint16_t i = 0; i < num_threads_; ++i) {
+        new (&threads_[i]) std::thread(IOThreadMain, this);
+      }
+    }
+#endif
+  }
+
+  void IO::stop() {
+    if (!running_) return;
+    PX_SCHED_TRACE_FN("IO::stop");
+    while (pending_.load()) std::this_thread::yield();
+    {
+      std::lock_guard<std::mutex> lk(queue_mutex_);
+      running_ = false;
+    }
+    queue_cv_.notify_all();
+#if PX_SCHED_IO_URING
+    if (ring_fd_ >= 0) {
+      // a NOP without request wakes up (and finishes) the completion thread
+      submitIOUring(0);
+    }
+#endif
+    const MemCallbacks &mem = schd_->params().mem_callbacks;
+    for(uint16_t i = 0; i < num_threads_; ++i) {
+      threads_[i].join();
+      threads_[i].~thread();
+    }
+    if (threads_) mem.free_fn(threads_);
+    threads_ = nullptr;
+    num_threads_ = 0;
+#if PX_SCHED_IO_URING
+    if (ring_fd_ >= 0) {
+      munmap(sqes_, sqes_size_);
+      if (cq_ring_ != sq_ring_) munmap(cq_ring_, cq_ring_size_);
+      munmap(sq_ring_, sq_ring_size_);
+      close(ring_fd_);
+      ring_fd_ = -1;
+      sq_ring_ = cq_ring_ = sqes_ = cqes_ = nullptr;
+    }
+#endif
+    mem.free_fn(requests_);
+    requests_ = nullptr;
+    free_list_ = 0;
+    queue_first_ = queue_last_ = 0;
+    schd_ = nullptr;
+  }
+
+  uint32_t IO::adquireRequest() {
+    for(;;) {
+      while (free_lock_.test_and_set(std::memory_order_acquire)) std::this_thread::yield();
+      uint32_t r = free_list_;
+      if (r) free_list_ = requests_[r-1].next;
+      free_lock_.clear(std::memory_order_release);
+      if (r) return r;
+      if (schd_->params().overflow_policy == OverflowPolicy::Fail) return 0;
+      PX_SCHED_TRACE_FN("IO::WaitForFreeRequest");
+      // keep the scheduler going meanwhile (completions only need the I/O
+      // threads)
+      if (!schd_->helpOnce()) std::this_thread::yield();
+    }
+  }
+
+  void IO::freeRequest(uint32_t r) {
+    while (free_lock_.test_and_set(std::memory_order_acquire)) std::this_thread::yield();
+    requests_[r-1].next = free_list_;
+    free_list_ = r;
+    free_lock_.clear(std::memory_order_release);
+  }
+
+  void IO::complete(uint32_t r, int64_t res) {
+    Request &req = requests_[r-1];
+    if (req.result) *req.result = (res < 0)? res : req.total;
+    Sync s = req.sync;
+    freeRequest(r);
+    pending_.fetch_sub(1);
+    schd_->decrementSync(&s);
+  }
+
+  bool IO::read(int fd, void *buffer, size_t size, uint64_t offset,
+                Sync *out_sync_obj, int64_t *result) {
+    PX_SCHED_TRACE_FN("IO::read");
+    PX_SCHED_CHECK_FN(running_, "IO not initialized");
+#if PX_SCHED_IMP_SINGLE_THREAD
+    // everything is executed in place on single threaded mode
+    int64_t total = 0;
+    char *dst = static_cast<char*>(buffer);
+    while (size) {
+      ssize_t n = pread(fd, dst, size, static_cast<off_t>(offset));
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) {
+        if (n < 0) total = -errno;
+        break;
+      }
+      total += n;
+      dst += n;
+      size -= static_cast<size_t>(n);
+      offset += static_cast<uint64_t>(n);
+    }
+    if (result) *result = total;
+    (void)out_sync_obj;
+#else
+    uint32_t r = adquireRequest();
+    if (!r) return false;
+    if (out_sync_obj) schd_->incrementSync(out_sync_obj);
+    Request &req = requests_[r-1];
+    req.fd = fd;
+    req.buffer = static_cast<char*>(buffer);
+    req.size = size;
+    req.offset = offset;
+    req.total = 0;
+    req.result = result;
+    req.sync = out_sync_obj? *out_sync_obj : Sync();
+    req.next = 0;
+    pending_.fetch_add(1);
+    if (ring_fd_ >= 0) {
+      submitIOUring(r);
+    } else {
+      {
+        std::lock_guard<std::mutex> lk(queue_mutex_);
+        if (queue_last_) requests_[queue_last_-1].next = r; else queue_first_ = r;
+        queue_last_ = r;
+      }
+      queue_cv_.notify_one();
+    }
+#endif
+    return true;
+  }
+
+  //-- I/O Threads -------------------------------------------------------------
+  void IO::IOThreadMain(IO *io) {
+    Scheduler::set_current_thread_name("IO-Thread");
+    for(;;) {
+      uint32_t r = 0;
+      {
+        std::unique_lock<std::mutex> lk(io->queue_mutex_);
+        io->queue_cv_.wait(lk, [io]{ return io->queue_first_ || !io->running_; });
+        if (!io->queue_first_) break;
+        r = io->queue_first_;
+        io->queue_first_ = io->requests_[r-1].next;
+        if (!io->queue_first_) io->queue_last_ = 0;
+      }
+      PX_SCHED_TRACE_FN("IO::Read");
+      Request &req = io->requests_[r-1];
+      int64_t res = 0;
+      while (req.size) {
+        ssize_t n = pread(req.fd, req.buffer, req.size, static_cast<off_t>(req.offset));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+          if (n < 0) res = -errno;
+          break;
+        }
+        req.total += n;
+        req.buffer += n;
+        req.size -= static_cast<size_t>(n);
+        req.offset += static_cast<uint64_t>(n);
+      }
+      io->complete(r, res);
+    }
+    Scheduler::set_current_thread_name(nullptr);
+  }
+
+  //-- io_uring ----------------------------------------------------------------
+#if PX_SCHED_IO_URING
+  namespace {
+    template<class T>
+    T* ring_ptr(void *base, uint32_t offset) {
+      return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+    }
+  }
+
+  bool IO::initIOUring() {
+    io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    long fd = syscall(__NR_io_uring_setup, params_.max_pending_reads, &p);
+    if (fd < 0) return false;
+    ring_fd_ = static_cast<int>(fd);
+    sq_ring_size_ = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+    cq_ring_size_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+      if (cq_ring_size_ > sq_ring_size_) sq_ring_size_ = cq_ring_size_;
+      cq_ring_size_ = sq_ring_size_;
+    }
+    void *const map_failed = reinterpret_cast<void*>(static_cast<intptr_t>(-1));
+    sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+    if (sq_ring_ == map_failed) {
+      close(ring_fd_);
+      ring_fd_ = -1;
+      return false;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+      cq_ring_ = sq_ring_;
+    } else {
+      cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+          MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+    }
+    sqes_size_ = p.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+    if (cq_ring_ == map_failed || sqes_ == map_failed) {
+      if (sqes_ != map_failed) munmap(sqes_, sqes_size_);
+      if (cq_ring_ != map_failed && cq_ring_ != sq_ring_) munmap(cq_ring_, cq_ring_size_);
+      munmap(sq_ring_, sq_ring_size_);
+      close(ring_fd_);
+      ring_fd_ = -1;
+      sq_ring_ = cq_ring_ = sqes_ = nullptr;
+      return false;
+    }
+    sq_tail_  = ring_ptr<uint32_t>(sq_ring_, p.sq_off.tail);
+    sq_mask_  = ring_ptr<uint32_t>(sq_ring_, p.sq_off.ring_mask);
+    sq_array_ = ring_ptr<uint32_t>(sq_ring_, p.sq_off.array);
+    cq_head_  = ring_ptr<uint32_t>(cq_ring_, p.cq_off.head);
+    cq_tail_  = ring_ptr<uint32_t>(cq_ring_, p.cq_off.tail);
+    cq_mask_  = ring_ptr<uint32_t>(cq_ring_, p.cq_off.ring_mask);
+    cqes_     = ring_ptr<void>(cq_ring_, p.cq_off.cqes);
+    return true;
+  }
+
+  // r == 0 submits a NOP, used to finish the completion thread
+  void IO::submitIOUring(uint32_t r) {
+    PX_SCHED_TRACE_FN("IO::SubmitIOUring");
+    while (submit_lock_.test_and_set(std::memory_order_acquire)) std::this_thread::yield();
+    // only submitters (under the lock) write the tail
+    uint32_t tail = *sq_tail_;
+    uint32_t idx = tail & *sq_mask_;
+    io_uring_sqe *sqe = static_cast<io_uring_sqe*>(sqes_) + idx;
+    memset(sqe, 0, sizeof(*sqe));
+    if (r) {
+      Request &req = requests_[r-1];
+      req.iov.iov_base = req.buffer;
+      req.iov.iov_len = req.size;
+      sqe->opcode = IORING_OP_READV;
+      sqe->fd = req.fd;
+      sqe->addr = reinterpret_cast<uint64_t>(&req.iov);
+      sqe->len = 1;
+      sqe->off = req.offset;
+    } else {
+      sqe->opcode = IORING_OP_NOP;
+    }
+    sqe->user_data = r;
+    sq_array_[idx] = idx;
+    __atomic_store_n(sq_tail_, tail+1, __ATOMIC_RELEASE);
+    for(;;) {
+      long ret = syscall(__NR_io_uring_enter, ring_fd_, 1, 0, 0, nullptr, 0);
+      if (ret >= 0) break;
+      PX_SCHED_CHECK_FN(errno == EINTR || errno == EAGAIN || errno == EBUSY,
+          "io_uring_enter failed (%s)", strerror(errno));
+      std::this_thread::yield();
+    }
+    submit_lock_.clear(std::memory_order_release);
+  }
+
+  void IO::IOUringThreadMain(IO *io) {
+    Scheduler::set_current_thread_name("IO-Completion");
+    io_uring_cqe *cqes = static_cast<io_uring_cqe*>(io->cqes_);
+    bool finish = false;
+    while (!finish) {
+      // only this thread writes the head
+      uint32_t head = *io->cq_head_;
+      uint32_t tail = __atomic_load_n(io->cq_tail_, __ATOMIC_ACQUIRE);
+      if (head == tail) {
+        syscall(__NR_io_uring_enter, io->ring_fd_, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+        continue;
+      }
+      PX_SCHED_TRACE_FN("IO::Completion");
+      for(; head != tail; ++head) {
+        const io_uring_cqe &cqe = cqes[head & *io->cq_mask_];
+        uint32_t r = static_cast<uint32_t>(cqe.user_data);
+        int32_t res = cqe.res;
+        __atomic_store_n(io->cq_head_, head+1, __ATOMIC_RELEASE);
+        if (r == 0) {
+          finish = true;
+          continue;
+        }
+        Request &req = io->requests_[r-1];
+        if (res > 0) {
+          size_t n = static_cast<size_t>(res);
+          req.total += res;
+          if (n < req.size) {
+            // short read, ask for the rest (a read of 0 bytes means end of file)
+            req.buffer += n;
+            req.size -= n;
+            req.offset += n;
+            io->submitIOUring(r);
+            continue;
+          }
+        }
+        io->complete(r, (res < 0)? res : 0);
+      }
+    }
+    Scheduler::set_current_thread_name(nullptr);
+  }
+#else
+  bool IO::initIOUring() { return false; }
+  void IO::submitIOUring(uint32_t) {}
+  void IO::IOUringThreadMain(IO*) {}
+#endif // PX_SCHED_IO_URING
+
+} // end of px_sched namespace
+
+#endif // PX_SCHED_IO_IMPLEMENTATION